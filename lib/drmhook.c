@@ -8,21 +8,35 @@
  * @file drmhook.c
  * @brief DRM connector mode preference hook
  *
- * This hook intercepts drmModeGetConnector calls to override the preferred display mode
- * based on a configuration file. Useful for forcing specific resolutions/refresh rates
+ * This hook intercepts drmModeGetConnector and drmModeGetConnectorCurrent calls to
+ * override the preferred display mode based on a configuration file. Useful for forcing specific resolutions/refresh rates
  * on DRM (Direct Rendering Manager) supported systems.
  *
  * Usage:
  * 1. Compile as a shared library: gcc -shared -fPIC drmhook.c -o drmhook.so -ldl
  * 2. Create a configuration file at /tmp/drmMode with format "WIDTHxHEIGHT@REFRESHRATE" (e.g., "1920x1080@60")
  * 3. Preload the library: LD_PRELOAD=./drmhook.so <application>
+ *
+ * When regmsgd is running, preferences are read from its shared-memory control
+ * region (/var/run/regmsgd-drmhook) without any file I/O. The region holds one entry
+ * per connector id with the exact timings of the preferred mode, so modes sharing a
+ * resolution and integer refresh rate (e.g., 60 and 59.94 Hz) are told apart. The
+ * configuration file is only used until the daemon publishes a preference; its parsed mode is
+ * cached and only re-read when the file's inode, size or modification time changes.
+ * Set DRMHOOK_DEBUG=1 to log hook decisions to stderr.
  */
 
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <sched.h>
 #include <dlfcn.h>
 #include <stdint.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
@@ -31,9 +45,115 @@
 #endif
 
 #define DRM_CONFIG_PATH "/var/run/drmMode"
+#define DRM_DEBUG_ENV "DRMHOOK_DEBUG"
+
+// Shared with src/bin/daemon/screen/hook_control.rs
+#define DRM_CONTROL_PATH "/var/run/regmsgd-drmhook"
+#define DRM_CONTROL_MAGIC 0x5247444du
+#define DRM_CONTROL_VERSION 2u
+#define DRM_CONTROL_SLOTS 16u
+#define DRM_CONTROL_TABLE_VALID 0x1u
+#define DRM_CONTROL_MAX_RETRIES 64
 
 typedef drmModeConnector *(*drmModeGetConnector_t)(int fd, uint32_t connector_id);
 
+/**
+ * @brief Parsed configuration file together with the file identity it was read from
+ */
+struct mode_cache
+{
+    int loaded;              // Non-zero once the file has been read at least once
+    int valid;               // Non-zero if the last read parsed successfully
+    dev_t dev;               // Device of the file that was parsed
+    ino_t ino;               // Inode of the file that was parsed
+    off_t size;              // Size of the file that was parsed
+    struct timespec mtime;   // Modification time of the file that was parsed
+    uint32_t width;
+    uint32_t height;
+    uint32_t refresh;
+};
+
+/**
+ * @brief Preferred mode of one connector, with the exact timings of drmModeModeInfo
+ */
+struct drmhook_entry
+{
+    uint32_t connector_id;   // DRM object id, 0 for a free slot
+    uint32_t clock;          // Pixel clock in kHz
+    uint32_t hdisplay;
+    uint32_t hsync_start;
+    uint32_t hsync_end;
+    uint32_t htotal;
+    uint32_t hskew;
+    uint32_t vdisplay;
+    uint32_t vsync_start;
+    uint32_t vsync_end;
+    uint32_t vtotal;
+    uint32_t vscan;
+    uint32_t flags;          // DRM_MODE_FLAG_* bits
+    uint32_t reserved[3];
+};
+
+/**
+ * @brief Control region published by regmsgd, written under a sequence lock
+ *
+ * The sequence number is odd while the daemon updates the payload. Readers take a
+ * snapshot only when they see the same even value before and after reading it.
+ * Entries are indexed by connector_id modulo DRM_CONTROL_SLOTS with linear probing.
+ */
+struct drmhook_control
+{
+    uint32_t magic;          // DRM_CONTROL_MAGIC once initialized by the daemon
+    uint32_t version;        // DRM_CONTROL_VERSION
+    uint32_t seq;            // Sequence lock
+    uint32_t flags;          // DRM_CONTROL_TABLE_VALID once a preference was published
+    uint32_t reserved[12];
+    struct drmhook_entry entries[DRM_CONTROL_SLOTS];
+};
+
+/**
+ * @brief Preference resolved for one connector
+ */
+struct mode_pref
+{
+    int exact;                   // Non-zero when `timing` identifies the mode exactly
+    struct drmhook_entry timing; // Timings published in the control region
+    uint32_t width;              // Global preference from the configuration file
+    uint32_t height;
+    uint32_t refresh;
+};
+
+static struct mode_cache cached_mode;
+static volatile int cache_lock = 0;
+static const struct drmhook_control *control = NULL;
+
+/**
+ * @brief Logs a hook message to stderr when DRMHOOK_DEBUG is set
+ *
+ * The environment is only inspected on the first call, so disabled logging costs a
+ * single branch per message afterwards.
+ */
+static void hook_log(const char *fmt, ...)
+{
+    static int enabled = -1;
+
+    if (enabled < 0)
+    {
+        const char *env = getenv(DRM_DEBUG_ENV);
+        enabled = (env && *env && strcmp(env, "0") != 0) ? 1 : 0;
+    }
+    if (!enabled)
+    {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    fputs("[HOOK] ", stderr);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+}
+
 /**
  * @brief Reads preferred mode configuration from a file
  *
@@ -74,73 +194,295 @@ int read_preferred_mode(const char *path, uint32_t *h, uint32_t *v, uint32_t *r)
 }
 
 /**
- * @brief Hook function for drmModeGetConnector that overrides preferred mode
+ * @brief Maps the regmsgd control region read-only
  *
- * This function intercepts calls to drmModeGetConnector, retrieves the original
- * connector information, and modifies the mode list to set a user-specified mode
- * as preferred based on the configuration file /tmp/drmMode. It uses dynamic
- * linking to call the original function.
+ * Called with cache_lock held. A failed attempt is retried on the next call, so a
+ * daemon started after the application is picked up once it creates the region.
+ * The region is only trusted when it is a regular file owned by root (or by the
+ * user running the application) that nobody else can write to.
  *
- * @param fd DRM file descriptor for the device
- * @param connector_id Connector ID to query (e.g., HDMI, DisplayPort)
- * @return drmModeConnector* Pointer to the modified connector information,
- *                           or NULL if an error occurs
+ * @return int Returns 1 if the region is mapped, 0 otherwise
  */
-drmModeConnector *drmModeGetConnector(int fd, uint32_t connector_id)
+static int map_control(void)
 {
-    static drmModeGetConnector_t real_drmModeGetConnector = NULL;
+    if (control)
+    {
+        return 1;
+    }
 
-    if (!real_drmModeGetConnector)
+    int fd = open(DRM_CONTROL_PATH, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0)
     {
-        // Load the original drmModeGetConnector function using RTLD_NEXT to access
-        // the next occurrence of the symbol in the search order (i.e., the real function).
-        real_drmModeGetConnector = (drmModeGetConnector_t)dlsym(RTLD_NEXT, "drmModeGetConnector");
-        if (!real_drmModeGetConnector)
+        return 0;
+    }
+
+    struct stat st;
+    void *addr = MAP_FAILED;
+    if (fstat(fd, &st) != 0)
+    {
+        hook_log("Failed to stat control region %s.\n", DRM_CONTROL_PATH);
+    }
+    else if (!S_ISREG(st.st_mode) || (st.st_uid != 0 && st.st_uid != geteuid()) ||
+             (st.st_mode & (S_IWGRP | S_IWOTH)))
+    {
+        hook_log("Ignoring untrusted control region %s.\n", DRM_CONTROL_PATH);
+    }
+    else if (st.st_size >= (off_t)sizeof(struct drmhook_control))
+    {
+        addr = mmap(NULL, sizeof(struct drmhook_control), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (addr == MAP_FAILED)
+    {
+        return 0;
+    }
+
+    __atomic_store_n(&control, (const struct drmhook_control *)addr, __ATOMIC_RELEASE);
+    hook_log("Mapped control region %s.\n", DRM_CONTROL_PATH);
+    return 1;
+}
+
+/**
+ * @brief Copies an entry out of the control region one word at a time
+ */
+static void copy_entry(struct drmhook_entry *dst, const struct drmhook_entry *src)
+{
+    const uint32_t *from = (const uint32_t *)src;
+    uint32_t *to = (uint32_t *)dst;
+
+    for (size_t i = 0; i < sizeof(*dst) / sizeof(uint32_t); i++)
+    {
+        to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Looks up the preferred mode of a connector in the regmsgd control region
+ *
+ * @param connector_id Connector to look up
+ * @param entry [out] Pointer to store the published timings
+ * @return int Returns 1 if a preference was found, 0 if the daemon published none for
+ *             this connector, or -1 if the region is unavailable and the configuration
+ *             file should be used instead
+ */
+static int read_control_mode(uint32_t connector_id, struct drmhook_entry *entry)
+{
+    const struct drmhook_control *ctl = __atomic_load_n(&control, __ATOMIC_ACQUIRE);
+
+    if (!ctl ||
+        __atomic_load_n(&ctl->magic, __ATOMIC_ACQUIRE) != DRM_CONTROL_MAGIC ||
+        __atomic_load_n(&ctl->version, __ATOMIC_RELAXED) != DRM_CONTROL_VERSION)
+    {
+        return -1;
+    }
+
+    for (int attempt = 0; attempt < DRM_CONTROL_MAX_RETRIES; attempt++)
+    {
+        uint32_t before = __atomic_load_n(&ctl->seq, __ATOMIC_ACQUIRE);
+        if (before & 1)
         {
-            // Symbol resolution failed, likely due to missing libdrm or incompatible environment.
-            fprintf(stderr, "Failed to find original drmModeGetConnector: %s\n", dlerror());
-            return NULL;
+            sched_yield();
+            continue;
+        }
+
+        uint32_t flags = __atomic_load_n(&ctl->flags, __ATOMIC_RELAXED);
+        int found = 0;
+        for (uint32_t probe = 0; probe < DRM_CONTROL_SLOTS; probe++)
+        {
+            const struct drmhook_entry *slot =
+                &ctl->entries[(connector_id + probe) % DRM_CONTROL_SLOTS];
+            uint32_t id = __atomic_load_n(&slot->connector_id, __ATOMIC_RELAXED);
+            if (id == 0)
+            {
+                break;
+            }
+            if (id == connector_id)
+            {
+                copy_entry(entry, slot);
+                found = 1;
+                break;
+            }
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&ctl->seq, __ATOMIC_RELAXED) == before)
+        {
+            return (flags & DRM_CONTROL_TABLE_VALID) ? found : -1;
         }
     }
 
-    drmModeConnector *connector = real_drmModeGetConnector(fd, connector_id);
+    hook_log("Control region kept changing, falling back to %s.\n", DRM_CONFIG_PATH);
+    return -1;
+}
+
+/**
+ * @brief Returns the preferred mode, re-reading the configuration file only when it changed
+ *
+ * A stat() call is compared against the identity (device, inode, size, mtime) of the
+ * file the cached values were parsed from. The file is only opened and parsed again
+ * when one of them differs, which covers both in-place writes and atomic renames.
+ *
+ * @param h [out] Pointer to store the width value
+ * @param v [out] Pointer to store the height value
+ * @param r [out] Pointer to store the refresh rate value
+ * @return int Returns 1 if a valid mode is configured, 0 otherwise
+ */
+static int get_preferred_mode(uint32_t *h, uint32_t *v, uint32_t *r)
+{
+    struct stat st;
+    int found = 0;
+
+    while (__atomic_test_and_set(&cache_lock, __ATOMIC_ACQUIRE))
+    {
+        sched_yield();
+    }
+
+    if (stat(DRM_CONFIG_PATH, &st) != 0)
+    {
+        // No configuration file: forget whatever was cached before
+        cached_mode.loaded = 0;
+        cached_mode.valid = 0;
+    }
+    else
+    {
+        if (!cached_mode.loaded ||
+            cached_mode.dev != st.st_dev ||
+            cached_mode.ino != st.st_ino ||
+            cached_mode.size != st.st_size ||
+            cached_mode.mtime.tv_sec != st.st_mtim.tv_sec ||
+            cached_mode.mtime.tv_nsec != st.st_mtim.tv_nsec)
+        {
+            cached_mode.valid = read_preferred_mode(DRM_CONFIG_PATH, &cached_mode.width,
+                                                    &cached_mode.height, &cached_mode.refresh);
+            cached_mode.loaded = 1;
+            cached_mode.dev = st.st_dev;
+            cached_mode.ino = st.st_ino;
+            cached_mode.size = st.st_size;
+            cached_mode.mtime = st.st_mtim;
+            hook_log("Reloaded %s (%s).\n", DRM_CONFIG_PATH,
+                     cached_mode.valid ? "valid" : "invalid");
+        }
+
+        if (cached_mode.valid)
+        {
+            *h = cached_mode.width;
+            *v = cached_mode.height;
+            *r = cached_mode.refresh;
+            found = 1;
+        }
+    }
+
+    __atomic_clear(&cache_lock, __ATOMIC_RELEASE);
+    return found;
+}
+
+/**
+ * @brief Resolves the preference of a connector
+ *
+ * The control region is authoritative once regmsgd has published a preference: a
+ * connector without an entry keeps its original preferred mode. The configuration
+ * file only applies while the region is unavailable.
+ *
+ * @param connector_id Connector to look up
+ * @param pref [out] Pointer to store the resolved preference
+ * @return int Returns 1 if a preference applies to the connector, 0 otherwise
+ */
+static int get_preference(uint32_t connector_id, struct mode_pref *pref)
+{
+    int found = read_control_mode(connector_id, &pref->timing);
+
+    if (found < 0 && !__atomic_load_n(&control, __ATOMIC_ACQUIRE))
+    {
+        while (__atomic_test_and_set(&cache_lock, __ATOMIC_ACQUIRE))
+        {
+            sched_yield();
+        }
+        int mapped = map_control();
+        __atomic_clear(&cache_lock, __ATOMIC_RELEASE);
+
+        if (mapped)
+        {
+            found = read_control_mode(connector_id, &pref->timing);
+        }
+    }
+
+    if (found >= 0)
+    {
+        pref->exact = 1;
+        return found;
+    }
+
+    pref->exact = 0;
+    return get_preferred_mode(&pref->width, &pref->height, &pref->refresh);
+}
+
+/**
+ * @brief Checks whether a connector mode is the preferred one
+ *
+ * Preferences from the control region must match the clock and every timing field;
+ * the configuration file only carries the resolution and integer refresh rate.
+ */
+static int mode_matches(const drmModeModeInfo *mode, const struct mode_pref *pref)
+{
+    if (!pref->exact)
+    {
+        return mode->hdisplay == pref->width &&
+               mode->vdisplay == pref->height &&
+               mode->vrefresh == pref->refresh;
+    }
+
+    const struct drmhook_entry *t = &pref->timing;
+    return mode->clock == t->clock &&
+           mode->hdisplay == t->hdisplay &&
+           mode->hsync_start == t->hsync_start &&
+           mode->hsync_end == t->hsync_end &&
+           mode->htotal == t->htotal &&
+           mode->hskew == t->hskew &&
+           mode->vdisplay == t->vdisplay &&
+           mode->vsync_start == t->vsync_start &&
+           mode->vsync_end == t->vsync_end &&
+           mode->vtotal == t->vtotal &&
+           mode->vscan == t->vscan &&
+           mode->flags == t->flags;
+}
+
+/**
+ * @brief Marks the preferred mode of a connector and moves it to the front of the list
+ *
+ * @param connector Connector returned by libdrm, modified in place
+ */
+static void apply_preference(drmModeConnector *connector)
+{
     if (!connector || connector->count_modes <= 0)
     {
-        printf("[HOOK] No modes found or connector is NULL.\n");
-        return connector;
+        hook_log("No modes found or connector is NULL.\n");
+        return;
     }
 
-    uint32_t pref_width = 0, pref_height = 0, pref_refresh = 0;
-    if (!read_preferred_mode(DRM_CONFIG_PATH, &pref_width, &pref_height, &pref_refresh))
+    struct mode_pref pref;
+    if (!get_preference(connector->connector_id, &pref))
     {
-        printf("[HOOK] Failed to read %s, keeping original preferred mode.\n", DRM_CONFIG_PATH);
-        return connector;
+        hook_log("No mode preference for connector %u, keeping original preferred mode.\n",
+                 connector->connector_id);
+        return;
     }
 
     int pref_index = -1;
     for (int i = 0; i < connector->count_modes; i++)
     {
         drmModeModeInfo *mode = &connector->modes[i];
-        if (mode->hdisplay == pref_width &&
-            mode->vdisplay == pref_height &&
-            mode->vrefresh == pref_refresh)
+        if (pref_index == -1 && mode_matches(mode, &pref))
         {
-            if (pref_index == -1)
-            {
-                mode->type |= DRM_MODE_TYPE_PREFERRED;
-                pref_index = i;
-                printf("[HOOK] Updated preferred mode to: %s %dx%d@%dHz\n",
-                       mode->name, mode->hdisplay, mode->vdisplay, mode->vrefresh);
-            }
-            else
-            {
-                // If we find another matching mode, we can remove the preferred flag
-                // from the previous one to avoid multiple preferred modes.
-                mode->type &= ~DRM_MODE_TYPE_PREFERRED;
-            }
+            mode->type |= DRM_MODE_TYPE_PREFERRED;
+            pref_index = i;
+            hook_log("Updated preferred mode of connector %u to: %s %dx%d@%dHz (%u kHz)\n",
+                     connector->connector_id, mode->name, mode->hdisplay, mode->vdisplay,
+                     mode->vrefresh, mode->clock);
         }
         else
         {
+            // Only one mode may carry the preferred flag, including duplicates of the match
             mode->type &= ~DRM_MODE_TYPE_PREFERRED;
         }
     }
@@ -153,8 +495,94 @@ drmModeConnector *drmModeGetConnector(int fd, uint32_t connector_id)
     }
     else if (pref_index == -1)
     {
-        printf("[HOOK] Preferred mode %ux%u@%u not found in mode list.\n",
-               pref_width, pref_height, pref_refresh);
+        if (pref.exact)
+        {
+            hook_log("Preferred mode %ux%u (%u kHz) not found on connector %u.\n",
+                     pref.timing.hdisplay, pref.timing.vdisplay, pref.timing.clock,
+                     connector->connector_id);
+        }
+        else
+        {
+            hook_log("Preferred mode %ux%u@%u not found in mode list.\n",
+                     pref.width, pref.height, pref.refresh);
+        }
+    }
+}
+
+/**
+ * @brief Resolves the libdrm implementation of a hooked function
+ *
+ * Uses RTLD_NEXT to access the next occurrence of the symbol in the search order
+ * (i.e., the real function).
+ */
+static void *resolve_real(const char *name)
+{
+    void *sym = dlsym(RTLD_NEXT, name);
+    if (!sym)
+    {
+        // Symbol resolution failed, likely due to missing libdrm or incompatible environment.
+        fprintf(stderr, "Failed to find original %s: %s\n", name, dlerror());
     }
+    return sym;
+}
+
+/**
+ * @brief Hook function for drmModeGetConnector that overrides preferred mode
+ *
+ * This function intercepts calls to drmModeGetConnector, retrieves the original
+ * connector information (forcing a probe), and modifies the mode list to set the
+ * preferred mode published for this connector. It uses dynamic linking to call the
+ * original function.
+ *
+ * @param fd DRM file descriptor for the device
+ * @param connector_id Connector ID to query (e.g., HDMI, DisplayPort)
+ * @return drmModeConnector* Pointer to the modified connector information,
+ *                           or NULL if an error occurs
+ */
+drmModeConnector *drmModeGetConnector(int fd, uint32_t connector_id)
+{
+    static drmModeGetConnector_t real_drmModeGetConnector = NULL;
+
+    if (!real_drmModeGetConnector)
+    {
+        real_drmModeGetConnector = (drmModeGetConnector_t)resolve_real("drmModeGetConnector");
+        if (!real_drmModeGetConnector)
+        {
+            return NULL;
+        }
+    }
+
+    drmModeConnector *connector = real_drmModeGetConnector(fd, connector_id);
+    apply_preference(connector);
+    return connector;
+}
+
+/**
+ * @brief Hook function for drmModeGetConnectorCurrent that overrides preferred mode
+ *
+ * Same as drmModeGetConnector, for applications using the non-probing call that
+ * returns the connector state already known to the kernel.
+ *
+ * @param fd DRM file descriptor for the device
+ * @param connector_id Connector ID to query (e.g., HDMI, DisplayPort)
+ * @return drmModeConnector* Pointer to the modified connector information,
+ *                           or NULL if an error occurs
+ */
+drmModeConnector *drmModeGetConnectorCurrent(int fd, uint32_t connector_id)
+{
+    static drmModeGetConnector_t real_drmModeGetConnectorCurrent = NULL;
+
+    if (!real_drmModeGetConnectorCurrent)
+    {
+        real_drmModeGetConnectorCurrent =
+            (drmModeGetConnector_t)resolve_real("drmModeGetConnectorCurrent");
+        if (!real_drmModeGetConnectorCurrent)
+        {
+            return NULL;
+        }
+    }
+
+    drmModeConnector *connector = real_drmModeGetConnectorCurrent(fd, connector_id);
+    apply_preference(connector);
     return connector;
 }
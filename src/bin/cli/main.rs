@@ -1,7 +1,9 @@
 #![cfg(feature = "cli")]
 
-use clap::{Parser, Subcommand};
-use tracing::{error, info, debug};
+use clap::error::ErrorKind;
+use clap::{CommandFactory, Parser, Subcommand};
+use std::io::Read;
+use tracing::{error, info, debug, warn};
 use zeromq::ReqSocket; // or DealerSocket, RouterSocket, etc.
 use zeromq::ZmqMessage;
 use zeromq::prelude::*; // traits
@@ -14,9 +16,18 @@ struct Cli {
     #[arg(short = 's', long)]
     screen: Option<String>,
 
+    /// Reply format: plain text or the daemon's structures as JSON
+    #[arg(short = 'f', long, default_value = "text", value_parser = ["text", "json"])]
+    format: String,
+
+    /// Run the commands read from FILE (stdin when FILE is omitted or "-"), one per
+    /// line, over a single daemon connection
+    #[arg(short = 'b', long, value_name = "FILE", num_args = 0..=1, default_missing_value = "-")]
+    batch: Option<String>,
+
     /// Subcommand to execute
     #[command(subcommand)]
-    command: Commands,
+    command: Option<Commands>,
 
     /// Additional arguments passed to the daemon
     #[arg(last = true)]
@@ -54,15 +65,36 @@ enum Commands {
         rotation: String,
     },
     #[command(about = "Takes a screenshot of the current screen.")]
-    GetScreenshot,
+    GetScreenshot {
+        #[arg(value_parser = ["png", "qoi", "ppm"])]
+        format: Option<String>,
+        #[arg(help = "PNG compression level (0-9)", value_parser = clap::value_parser!(u32).range(0..=9))]
+        level: Option<u32>,
+    },
     #[command(about = "Maps the touchscreen to the correct display.")]
     MapTouchScreen,
+    #[command(about = "Applies a display profile to all its outputs at once.")]
+    ApplyProfile {
+        #[arg(
+            required = true,
+            help = "Profile name, or OUTPUT:MODE[:ROTATION[:X,Y]] and touchscreen:OUTPUT specs"
+        )]
+        specs: Vec<String>,
+    },
     #[command(
         about = "Sets the screen resolution to the maximum supported resolution (e.g., 1920x1080)."
     )]
     MinToMaxResolution,
+    #[command(about = "Shows the daemon log filter, or replaces it (e.g., debug).")]
+    LogLevel {
+        #[arg(help = "Filter directives in RUST_LOG syntax (e.g., info,regmsgd::screen=trace)")]
+        directives: Option<String>,
+    },
 }
 
+/// Maximum number of commands sent in one request, the daemon's batch limit
+const MAX_BATCH_COMMANDS: usize = 64;
+
 /// Entry point
 #[async_std::main]
 async fn main() -> Result<(), Box<dyn std::error::Error>> {
@@ -74,6 +106,17 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
     let cli = Cli::parse();
     debug!("Parsed CLI arguments: {:?}", cli);
 
+    // Exactly one of a subcommand and a batch script says what to run
+    match (&cli.batch, &cli.command) {
+        (None, None) => Cli::command()
+            .error(ErrorKind::MissingSubcommand, "a subcommand or --batch is required")
+            .exit(),
+        (Some(_), Some(_)) => Cli::command()
+            .error(ErrorKind::ArgumentConflict, "--batch cannot be combined with a subcommand")
+            .exit(),
+        _ => {}
+    }
+
     // Connect to the daemon via ZeroMQ
     let mut socket = ReqSocket::new();
     match socket.connect("ipc:///var/run/regmsgd.sock").await {
@@ -84,8 +127,13 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
         }
     }
 
-    // Execute the command
-    if let Err(e) = handle_command(&cli, socket).await {
+    // Execute the command or the batch script
+    let result = match (&cli.batch, &cli.command) {
+        (Some(source), _) => run_batch(&cli, source, socket).await,
+        (None, Some(command)) => handle_command(&cli, command, socket).await,
+        (None, None) => unreachable!("checked after parsing"),
+    };
+    if let Err(e) = result {
         error!("Error executing command: {e}");
         std::process::exit(1);
     }
@@ -97,12 +145,20 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
 /// Execute the selected subcommand
 async fn handle_command(
     cli: &Cli,
+    command: &Commands,
     mut socket: zeromq::ReqSocket,
 ) -> Result<(), Box<dyn std::error::Error>> {
     let mut msg = String::new();
 
+    // Ask the daemon for a structured reply
+    if cli.format != "text" {
+        msg.push_str("--format ");
+        msg.push_str(&cli.format);
+        msg.push(' ');
+    }
+
     // Build the command based on the enum
-    match &cli.command {
+    match command {
         Commands::ListModes => {
             msg.push_str("listModes");
             info!("Listing available display modes");
@@ -150,18 +206,42 @@ async fn handle_command(
             msg.push_str(rotation);
             info!("Setting screen rotation to: {} degrees", rotation);
         },
-        Commands::GetScreenshot => {
+        Commands::GetScreenshot { format, level } => {
             msg.push_str("getScreenshot");
+            if let Some(format) = format {
+                msg.push(' ');
+                msg.push_str(format);
+            }
+            if let Some(level) = level {
+                // The level is positional after the format, which defaults to PNG
+                if format.is_none() {
+                    msg.push_str(" png");
+                }
+                msg.push_str(&format!(" {}", level));
+            }
             info!("Taking screenshot");
         },
         Commands::MapTouchScreen => {
             msg.push_str("mapTouchScreen");
             info!("Mapping touchscreen to display");
         },
+        Commands::ApplyProfile { specs } => {
+            msg.push_str("applyProfile ");
+            msg.push_str(&specs.join(" "));
+            info!("Applying display profile: {}", specs.join(" "));
+        },
         Commands::MinToMaxResolution => {
             msg.push_str("minToMaxResolution");
             info!("Setting resolution to maximum supported");
         },
+        Commands::LogLevel { directives } => {
+            msg.push_str("logLevel");
+            if let Some(directives) = directives {
+                msg.push(' ');
+                msg.push_str(directives);
+            }
+            info!("Querying or setting daemon log level");
+        },
     }
 
     // Add --screen if specified
@@ -212,3 +292,95 @@ async fn handle_command(
 
     Ok(())
 }
+
+/// Adds the global `--format` and `--screen` options to a command line of a batch script
+fn batch_command_line(cli: &Cli, line: &str) -> String {
+    let mut msg = String::new();
+    if cli.format != "text" && !line.starts_with("--format") {
+        msg.push_str("--format ");
+        msg.push_str(&cli.format);
+        msg.push(' ');
+    }
+    msg.push_str(line);
+    if let Some(screen) = &cli.screen {
+        if !line.contains("--screen") {
+            msg.push_str(" --screen ");
+            msg.push_str(screen);
+        }
+    }
+    msg
+}
+
+/// Run the commands of a batch script over one connection
+///
+/// Every non-empty line not starting with `#` is a daemon command line, e.g.
+/// `setMode 1920x1080@60`; the global `--format` and `--screen` options apply to each
+/// of them. The commands are sent as batch requests of up to `MAX_BATCH_COMMANDS`
+/// frames, so they run in order, and the replies are printed in the same order.
+///
+/// # Arguments
+/// * `cli` - The parsed global arguments
+/// * `source` - The script file, or "-" for stdin
+/// * `socket` - The connected daemon socket
+///
+/// # Returns
+/// * `Result<(), Box<dyn std::error::Error>>` - An error if the script cannot be read,
+///   the daemon cannot be reached or any command failed
+async fn run_batch(
+    cli: &Cli,
+    source: &str,
+    mut socket: zeromq::ReqSocket,
+) -> Result<(), Box<dyn std::error::Error>> {
+    let script = if source == "-" {
+        let mut script = String::new();
+        std::io::stdin().read_to_string(&mut script)?;
+        script
+    } else {
+        std::fs::read_to_string(source)?
+    };
+
+    let cmdlines: Vec<String> = script
+        .lines()
+        .map(str::trim)
+        .filter(|line| !line.is_empty() && !line.starts_with('#'))
+        .map(|line| batch_command_line(cli, line))
+        .collect();
+    info!("Running {} commands from {}", cmdlines.len(), source);
+
+    let mut failed = 0;
+    for chunk in cmdlines.chunks(MAX_BATCH_COMMANDS) {
+        let mut request = ZmqMessage::from(chunk[0].clone());
+        for cmdline in &chunk[1..] {
+            request.push_back(cmdline.clone().into());
+        }
+        debug!("Sending batch of {} commands to daemon", chunk.len());
+        socket.send(request).await?;
+
+        let reply = socket.recv().await?;
+        if reply.len() != chunk.len() {
+            warn!(
+                "Daemon sent {} replies for {} commands",
+                reply.len(),
+                chunk.len()
+            );
+        }
+
+        // One reply frame per command, in order; a missing frame counts as a failure
+        for (index, cmdline) in chunk.iter().enumerate() {
+            let reply_str = match reply.get(index) {
+                Some(frame) => String::from_utf8_lossy(frame).into_owned(),
+                None => "Error: No reply from daemon".to_string(),
+            };
+            if reply_str.starts_with("Error") {
+                failed += 1;
+                debug!("Command '{}' failed: {}", cmdline, reply_str);
+            }
+            println!("{}", reply_str);
+        }
+    }
+
+    if failed > 0 {
+        return Err(format!("{} of {} commands failed", failed, cmdlines.len()).into());
+    }
+    Ok(())
+}
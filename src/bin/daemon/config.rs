@@ -4,7 +4,27 @@
 
 /// Constants for default settings
 pub const DEFAULT_SOCKET_PATH: &str = "/var/run/regmsgd.sock";
+pub const DEFAULT_EVENTS_SOCKET_PATH: &str = "/var/run/regmsgd-events.sock";
+pub const DEFAULT_READY_PATH: &str = "/var/run/regmsgd.ready";
 pub const DEFAULT_SCREENSHOT_DIR: &str = "/userdata/screenshots";
+pub const DEFAULT_PROFILE_DIR: &str = "/userdata/system/configs/regmsg/profiles";
 pub const DEFAULT_MAX_RESOLUTION: &str = "1920x1080";
 pub const DEFAULT_LOG_PATH: &str = "/var/log/regmsg.log";
 pub const DEFAULT_SWAYSOCK_PATH: &str = "/var/run/sway-ipc.0.sock";
+pub const JOURNALD_SOCKET_PATH: &str = "/run/systemd/journal/socket";
+
+/// Time a mode setter waits for a newer request to the same screen, in milliseconds;
+/// of a burst of setters only the last one is applied
+pub const SETTER_COALESCE_WINDOW_MS: u64 = 30;
+
+/// Requests logged at info level per second, the others are logged at debug level
+pub const REQUEST_LOG_RATE: u32 = 10;
+
+/// Environment variable selecting the log sink ("file", "console", "both" or "journald")
+pub const LOG_SINK_ENV: &str = "REGMSGD_LOG";
+
+/// Environment variable selecting the server socket pattern ("router" or "rep")
+pub const SOCKET_MODE_ENV: &str = "REGMSGD_SOCKET_MODE";
+
+/// Environment variable naming a display recording to serve instead of the hardware
+pub const REPLAY_ENV: &str = "REGMSGD_REPLAY";
@@ -11,6 +11,7 @@ mod server;
 
 use async_std::channel::bounded;
 use async_std::stream::StreamExt;
+use server::readiness;
 use server::server::DaemonServer;
 use signal_hook::consts::signal::{SIGTERM, SIGINT};
 use signal_hook_async_std::Signals;
@@ -27,11 +28,12 @@ use signal_hook_async_std::Signals;
 async fn main() -> Result<(), Box<dyn std::error::Error>> {
     // Initialize tracing with file and console output
     crate::utils::tracing::setup_tracing();
+    crate::utils::stats::start();
 
     tracing::info!("Starting regmsg daemon");
 
     // Create the daemon server with integrated command registry
-    let mut daemon_server = DaemonServer::new()?;
+    let mut daemon_server = DaemonServer::new().await?;
 
     // Channel for graceful shutdown
     let (shutdown_tx, shutdown_rx) = bounded(1);
@@ -43,6 +45,9 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
     // Spawn async task to handle OS signals
     let signal_task = async_std::task::spawn(handle_signals(signals, shutdown_tx));
 
+    // The sockets are bound and signals handled, let the init script continue
+    readiness::notify_ready();
+
     // Run the daemon server with shutdown receiver
     let result = daemon_server.run(shutdown_rx).await;
 
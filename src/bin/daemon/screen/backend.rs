@@ -3,26 +3,151 @@
 //! This module defines traits and implementations for different display backends
 //! (Wayland, DRM/KMS, etc.), enabling a more modular and extensible architecture.
 
-use crate::utils::error::Result;
-use serde::{Deserialize, Serialize};
+use crate::screen::cache::OutputCache;
+use crate::screen::screenshot::Frame;
+use crate::utils::error::{RegmsgError, Result};
+use crate::utils::stats;
+use serde::ser::SerializeStruct;
+use serde::{Deserialize, Serialize, Serializer};
+use std::collections::HashMap;
+use std::fmt;
+use std::sync::Arc;
 
 /// Structure that represents display mode information
-#[derive(Debug, Clone, Serialize, Deserialize)]
+///
+/// Modes are plain `Copy` values so that mode lists need no allocation per mode; the
+/// name shown to users ("1920x1080@60Hz") is formatted on demand through `Display`.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash, Deserialize)]
+#[serde(from = "ModeRecord")]
 pub struct DisplayMode {
     pub width: u32,
     pub height: u32,
-    pub refresh_rate: u32,
-    pub name: String,
+    /// Exact refresh rate in mHz, e.g. 59940 for NTSC timings
+    pub refresh_mhz: u32,
+    /// Whether the display advertises this mode as its preferred one
+    pub preferred: bool,
+    /// Whether the mode uses interlaced timings
+    pub interlaced: bool,
+}
+
+impl DisplayMode {
+    /// Creates a progressive, non-preferred mode
+    ///
+    /// # Arguments
+    /// * `width` - Width in pixels
+    /// * `height` - Height in pixels
+    /// * `refresh_mhz` - Refresh rate in mHz
+    pub fn new(width: u32, height: u32, refresh_mhz: u32) -> Self {
+        Self {
+            width,
+            height,
+            refresh_mhz,
+            preferred: false,
+            interlaced: false,
+        }
+    }
+
+    /// Returns the refresh rate rounded to whole hertz
+    pub fn refresh_rate(&self) -> u32 {
+        (self.refresh_mhz + 500) / 1000
+    }
+
+    /// Returns whether two modes drive the display the same way
+    ///
+    /// The preferred flag is ignored: it marks an entry of the mode list and is not
+    /// reported for the mode programmed on a CRTC.
+    pub fn same_timing(&self, other: &DisplayMode) -> bool {
+        self.width == other.width
+            && self.height == other.height
+            && self.refresh_mhz == other.refresh_mhz
+            && self.interlaced == other.interlaced
+    }
+}
+
+impl fmt::Display for DisplayMode {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        write!(
+            f,
+            "{}x{}@{}Hz",
+            self.width,
+            self.height,
+            self.refresh_rate()
+        )
+    }
+}
+
+/// Serializes the name lazily, straight into the output
+struct ModeName<'a>(&'a DisplayMode);
+
+impl Serialize for ModeName<'_> {
+    fn serialize<S: Serializer>(&self, serializer: S) -> std::result::Result<S::Ok, S::Error> {
+        serializer.collect_str(self.0)
+    }
+}
+
+/// Keeps the JSON layout clients already parse (`refresh_rate` in Hz and `name`) and
+/// adds the exact rate and the flags that are set
+impl Serialize for DisplayMode {
+    fn serialize<S: Serializer>(&self, serializer: S) -> std::result::Result<S::Ok, S::Error> {
+        let mut state = serializer.serialize_struct("DisplayMode", 7)?;
+        state.serialize_field("width", &self.width)?;
+        state.serialize_field("height", &self.height)?;
+        state.serialize_field("refresh_rate", &self.refresh_rate())?;
+        state.serialize_field("refresh_mhz", &self.refresh_mhz)?;
+        state.serialize_field("name", &ModeName(self))?;
+        if self.preferred {
+            state.serialize_field("preferred", &true)?;
+        }
+        if self.interlaced {
+            state.serialize_field("interlaced", &true)?;
+        }
+        state.end()
+    }
+}
+
+/// Serialized form of a mode; recordings from before `refresh_mhz` only carry the
+/// rounded `refresh_rate`, and `name` is derived so it is ignored
+#[derive(Deserialize)]
+struct ModeRecord {
+    width: u32,
+    height: u32,
+    #[serde(default)]
+    refresh_rate: u32,
+    refresh_mhz: Option<u32>,
+    #[serde(default)]
+    preferred: bool,
+    #[serde(default)]
+    interlaced: bool,
+}
+
+impl From<ModeRecord> for DisplayMode {
+    fn from(record: ModeRecord) -> Self {
+        Self {
+            width: record.width,
+            height: record.height,
+            refresh_mhz: record
+                .refresh_mhz
+                .unwrap_or(record.refresh_rate.saturating_mul(1000)),
+            preferred: record.preferred,
+            interlaced: record.interlaced,
+        }
+    }
 }
 
 /// Structure that represents output/device display information
+///
+/// The name is shared with the backend snapshot it was read from, so copies of the
+/// output list do not allocate a string per output.
 #[derive(Debug, Clone, Serialize, Deserialize)]
 pub struct DisplayOutput {
-    pub name: String,
+    pub name: Arc<str>,
     pub modes: Vec<DisplayMode>,
     pub current_mode: Option<DisplayMode>,
     pub is_connected: bool,
     pub rotation: u32,
+    /// Position in the compositor layout, for backends that have one
+    #[serde(default, skip_serializing_if = "Option::is_none")]
+    pub position: Option<(i32, i32)>,
 }
 
 /// Parameters to define a new display mode
@@ -39,6 +164,33 @@ pub struct RotationParams {
     pub rotation: u32,
 }
 
+/// Change of one output requested by a display profile
+///
+/// Only the settings that differ from the current state are set.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct OutputChange {
+    pub output: Arc<str>,
+    /// A mode the output offers, to be matched exactly
+    pub mode: Option<DisplayMode>,
+    pub rotation: Option<u32>,
+    pub position: Option<(i32, i32)>,
+}
+
+/// Validated changes of a display profile, applied together
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct ProfileChanges {
+    pub outputs: Vec<OutputChange>,
+    /// Output the touchscreen is mapped to
+    pub touchscreen: Option<Arc<str>>,
+}
+
+impl ProfileChanges {
+    /// Returns whether applying the changes would do nothing
+    pub fn is_empty(&self) -> bool {
+        self.outputs.is_empty() && self.touchscreen.is_none()
+    }
+}
+
 /// Central trait for display operations
 pub trait DisplayBackend: Send + Sync {
     /// Lists all available display outputs/devices
@@ -72,12 +224,180 @@ pub trait DisplayBackend: Send + Sync {
         max_resolution: Option<&str>,
     ) -> Result<()>;
 
-    /// Takes a screenshot
-    fn take_screenshot(&self, screenshot_dir: &str) -> Result<String>;
+    /// Captures the current content of the active output
+    ///
+    /// Encoding and saving the frame is left to the caller, so it can reply before
+    /// the (slow) compression finishes.
+    fn capture_frame(&self) -> Result<Frame>;
 
     /// Maps a touchscreen to a specific output
     fn map_touchscreen(&self) -> Result<()>;
 
+    /// Applies the changes of a display profile
+    ///
+    /// Backends able to reconfigure several outputs at once override this to do it in
+    /// one operation; the default goes through the setters, output by output.
+    fn apply_profile(&self, changes: &ProfileChanges) -> Result<()> {
+        for change in &changes.outputs {
+            if change.position.is_some() {
+                return Err(RegmsgError::BackendError {
+                    backend: self.backend_name().to_string(),
+                    message: "Output positions not supported".to_string(),
+                });
+            }
+            if let Some(mode) = change.mode {
+                let params = ModeParams {
+                    width: mode.width,
+                    height: mode.height,
+                    refresh_rate: mode.refresh_rate(),
+                };
+                self.set_mode(Some(&change.output), &params)?;
+            }
+            if let Some(rotation) = change.rotation {
+                self.set_rotation(Some(&change.output), &RotationParams { rotation })?;
+            }
+        }
+        if changes.touchscreen.is_some() {
+            self.map_touchscreen()?;
+        }
+        Ok(())
+    }
+
+    /// Gets the mode applications started later will pick for each output, for
+    /// backends publishing it apart from the current mode
+    ///
+    /// KMS/DRM publishes the preference to drmhook, and the display only switches once
+    /// the application owning it picks the preference up. Other backends keep the
+    /// default: their current mode is all there is.
+    ///
+    /// # Returns
+    /// `None` if the backend publishes no preference, otherwise the published mode by
+    /// output name; outputs without a known preference are left out
+    fn published_modes(&self) -> Result<Option<HashMap<Arc<str>, DisplayMode>>> {
+        Ok(None)
+    }
+
     /// Gets the backend name
     fn backend_name(&self) -> &'static str;
+
+    /// Starts delivering change notifications (hotplug, mode changes) to a cache
+    ///
+    /// Backends without a change notification source keep the default, which leaves
+    /// the cache disabled so that every query reaches the backend.
+    fn watch_changes(&self, _cache: Arc<OutputCache>) -> Result<()> {
+        Err(RegmsgError::BackendError {
+            backend: self.backend_name().to_string(),
+            message: "Change notifications not supported".to_string(),
+        })
+    }
+}
+
+/// Parses the maximum resolution argument of `min_to_max_resolution`
+///
+/// # Arguments
+/// * `max_resolution` - A resolution in the format "WxH", 1920x1080 when `None`
+///
+/// # Returns
+/// A `Result` containing the maximum width and height, or an error if the format is invalid
+pub fn parse_max_resolution(max_resolution: Option<&str>) -> Result<(u32, u32)> {
+    let Some(res) = max_resolution else {
+        return Ok((1920, 1080));
+    };
+
+    let parts: Vec<&str> = res.split('x').collect();
+    if parts.len() != 2 {
+        return Err(RegmsgError::InvalidArguments(format!(
+            "Invalid resolution format: '{}'. Expected 'WxH'",
+            res
+        )));
+    }
+    let width = parts[0]
+        .parse::<u32>()
+        .map_err(|e| RegmsgError::ParseError(format!("Failed to parse width: {}", e)))?;
+    let height = parts[1]
+        .parse::<u32>()
+        .map_err(|e| RegmsgError::ParseError(format!("Failed to parse height: {}", e)))?;
+    if width == 0 || height == 0 {
+        return Err(RegmsgError::InvalidArguments(format!(
+            "Resolution dimensions must be positive: {}x{}",
+            width, height
+        )));
+    }
+    Ok((width, height))
+}
+
+/// Backend wrapper recording the latency and outcome of every call
+///
+/// The daemon wraps the detected backend in it so the `stats` command can report
+/// backend time separately from command dispatch.
+pub struct MeteredBackend<B>(pub B);
+
+impl<B: DisplayBackend> DisplayBackend for MeteredBackend<B> {
+    fn list_outputs(&self) -> Result<Vec<DisplayOutput>> {
+        stats::BACKEND.time("list_outputs", || self.0.list_outputs())
+    }
+
+    fn list_modes(&self, screen: Option<&str>) -> Result<Vec<DisplayMode>> {
+        stats::BACKEND.time("list_modes", || self.0.list_modes(screen))
+    }
+
+    fn current_mode(&self, screen: Option<&str>) -> Result<DisplayMode> {
+        stats::BACKEND.time("current_mode", || self.0.current_mode(screen))
+    }
+
+    fn current_resolution(&self, screen: Option<&str>) -> Result<(u32, u32)> {
+        stats::BACKEND.time("current_resolution", || self.0.current_resolution(screen))
+    }
+
+    fn current_refresh_rate(&self, screen: Option<&str>) -> Result<u32> {
+        stats::BACKEND.time("current_refresh_rate", || {
+            self.0.current_refresh_rate(screen)
+        })
+    }
+
+    fn current_rotation(&self, screen: Option<&str>) -> Result<u32> {
+        stats::BACKEND.time("current_rotation", || self.0.current_rotation(screen))
+    }
+
+    fn set_mode(&self, screen: Option<&str>, mode: &ModeParams) -> Result<()> {
+        stats::BACKEND.time("set_mode", || self.0.set_mode(screen, mode))
+    }
+
+    fn set_rotation(&self, screen: Option<&str>, rotation: &RotationParams) -> Result<()> {
+        stats::BACKEND.time("set_rotation", || self.0.set_rotation(screen, rotation))
+    }
+
+    fn min_to_max_resolution(
+        &self,
+        screen: Option<&str>,
+        max_resolution: Option<&str>,
+    ) -> Result<()> {
+        stats::BACKEND.time("min_to_max_resolution", || {
+            self.0.min_to_max_resolution(screen, max_resolution)
+        })
+    }
+
+    fn capture_frame(&self) -> Result<Frame> {
+        stats::BACKEND.time("capture_frame", || self.0.capture_frame())
+    }
+
+    fn map_touchscreen(&self) -> Result<()> {
+        stats::BACKEND.time("map_touchscreen", || self.0.map_touchscreen())
+    }
+
+    fn apply_profile(&self, changes: &ProfileChanges) -> Result<()> {
+        stats::BACKEND.time("apply_profile", || self.0.apply_profile(changes))
+    }
+
+    fn published_modes(&self) -> Result<Option<HashMap<Arc<str>, DisplayMode>>> {
+        stats::BACKEND.time("published_modes", || self.0.published_modes())
+    }
+
+    fn backend_name(&self) -> &'static str {
+        self.0.backend_name()
+    }
+
+    fn watch_changes(&self, cache: Arc<OutputCache>) -> Result<()> {
+        self.0.watch_changes(cache)
+    }
 }
@@ -0,0 +1,147 @@
+//! Display State Cache
+//!
+//! This module keeps an in-memory snapshot of the outputs reported by a backend so that
+//! query commands can be answered without kernel or compositor traffic. Every snapshot
+//! is tagged with a generation number; backends bump the generation when they observe a
+//! change (DRM uevents, sway output events) and the daemon bumps it after its own setters.
+//!
+//! The cache is generic over the snapshot type so backends can also keep their native
+//! output state (e.g., the sway output list) behind the same invalidation scheme.
+//!
+//! Other parts of the daemon can watch a cache to learn about invalidations, e.g. to
+//! publish display change events.
+
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::mpsc::{self, Receiver, Sender};
+use std::sync::{Arc, Mutex, RwLock};
+
+use crate::screen::backend::DisplayOutput;
+use crate::utils::error::Result;
+use crate::utils::stats::{self, CacheCounter};
+
+use tracing::debug;
+
+/// Outputs captured at a given generation
+struct Snapshot<T> {
+    generation: u64,
+    outputs: Arc<T>,
+}
+
+/// Generation-counted cache of the outputs reported by one backend
+///
+/// The cache only serves snapshots while it is live, i.e. while the backend has a
+/// working change notification source. Without one every read goes to the backend.
+pub struct OutputCache<T = Vec<DisplayOutput>> {
+    /// Incremented on every invalidation
+    generation: AtomicU64,
+    /// Whether change notifications are currently being delivered
+    live: AtomicBool,
+    /// Last snapshot read from the backend
+    snapshot: RwLock<Option<Snapshot<T>>>,
+    /// Receive the new generation number on every invalidation
+    watchers: Mutex<Vec<Sender<u64>>>,
+    /// Hit and miss counters reported by the `stats` command
+    counter: Option<Arc<CacheCounter>>,
+}
+
+impl<T> OutputCache<T> {
+    /// Creates an empty cache that is not live yet
+    pub fn new() -> Self {
+        Self {
+            generation: AtomicU64::new(0),
+            live: AtomicBool::new(false),
+            snapshot: RwLock::new(None),
+            watchers: Mutex::new(Vec::new()),
+            counter: None,
+        }
+    }
+
+    /// Creates an empty cache whose hit rate is reported by `stats` under `name`
+    pub fn with_stats(name: &str) -> Self {
+        Self {
+            counter: Some(stats::cache(name)),
+            ..Self::new()
+        }
+    }
+
+    /// Returns the current generation number
+    pub fn generation(&self) -> u64 {
+        self.generation.load(Ordering::Acquire)
+    }
+
+    /// Returns whether snapshots are served from memory
+    pub fn is_live(&self) -> bool {
+        self.live.load(Ordering::Acquire)
+    }
+
+    /// Marks the cached snapshot as stale
+    pub fn invalidate(&self) {
+        let generation = self.generation.fetch_add(1, Ordering::AcqRel) + 1;
+        debug!("Display cache invalidated (generation {})", generation);
+
+        let mut watchers = self.watchers.lock().unwrap_or_else(|e| e.into_inner());
+        watchers.retain(|watcher| watcher.send(generation).is_ok());
+    }
+
+    /// Returns a channel receiving the new generation number on every invalidation
+    ///
+    /// The watcher is dropped once its receiver is.
+    pub fn watch(&self) -> Receiver<u64> {
+        let (tx, rx) = mpsc::channel();
+        self.watchers
+            .lock()
+            .unwrap_or_else(|e| e.into_inner())
+            .push(tx);
+        rx
+    }
+
+    /// Enables or disables serving from memory, invalidating the snapshot either way
+    ///
+    /// Backends call this with `false` when they lose their change notification source
+    /// (e.g., the compositor restarted) and with `true` once it is back.
+    pub fn set_live(&self, live: bool) {
+        self.live.store(live, Ordering::Release);
+        self.invalidate();
+    }
+
+    /// Returns the cached outputs, calling `fetch` when the snapshot is stale.
+    ///
+    /// # Arguments
+    /// * `fetch` - Reads the outputs from the backend
+    ///
+    /// # Returns
+    /// A `Result` containing the outputs, or the error returned by `fetch`
+    pub fn outputs<F>(&self, fetch: F) -> Result<Arc<T>>
+    where
+        F: FnOnce() -> Result<T>,
+    {
+        // Read the generation before fetching so that a change racing with the fetch
+        // leaves the stored snapshot stale instead of hiding the change.
+        let generation = self.generation();
+        let live = self.is_live();
+
+        if live {
+            let snapshot = self.snapshot.read().unwrap_or_else(|e| e.into_inner());
+            if let Some(snapshot) = snapshot.as_ref() {
+                if snapshot.generation == generation {
+                    if let Some(counter) = &self.counter {
+                        counter.hit();
+                    }
+                    return Ok(Arc::clone(&snapshot.outputs));
+                }
+            }
+        }
+
+        if let Some(counter) = &self.counter {
+            counter.miss();
+        }
+        let outputs = Arc::new(fetch()?);
+        if live {
+            *self.snapshot.write().unwrap_or_else(|e| e.into_inner()) = Some(Snapshot {
+                generation,
+                outputs: Arc::clone(&outputs),
+            });
+        }
+        Ok(outputs)
+    }
+}
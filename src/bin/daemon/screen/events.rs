@@ -0,0 +1,186 @@
+//! Display Change Events
+//!
+//! This module turns changes of the display state into compact events for clients that
+//! would otherwise poll `currentMode`/`listOutputs`. Events are derived by comparing the
+//! outputs before and after a cache invalidation, so they cover hotplug and mode changes
+//! observed by the backends as well as the daemon's own setters. The screenshot encoder
+//! reports finished captures on the same stream, and the backend selection reports
+//! switches between KMS/DRM and Wayland as sway starts and exits.
+//!
+//! Every event is encoded as one text frame starting with its topic, e.g.
+//! `modeChanged HDMI-A-1 1920x1080@60`, so ZeroMQ subscribers can filter by prefix.
+
+use std::fmt;
+use std::sync::OnceLock;
+
+use async_std::channel::{Sender, TrySendError};
+
+use crate::screen::backend::DisplayOutput;
+
+use tracing::{debug, warn};
+
+/// A change of the display state
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum DisplayEvent {
+    /// An output was plugged in or enabled
+    OutputConnected { output: String },
+    /// An output was unplugged or disabled
+    OutputDisconnected { output: String },
+    /// The active mode of a connected output changed, `None` when it has no mode
+    ModeChanged {
+        output: String,
+        mode: Option<(u32, u32, u32)>,
+    },
+    /// The rotation of an output changed
+    RotationChanged { output: String, rotation: u32 },
+    /// A screenshot finished encoding and was written to `path`
+    ScreenshotSaved { path: String },
+    /// A screenshot could not be encoded or written to `path`
+    ScreenshotFailed { path: String },
+    /// The display backend changed, e.g. to Wayland after sway started
+    BackendChanged { backend: String },
+}
+
+impl DisplayEvent {
+    /// Returns the topic subscribers filter on
+    pub fn topic(&self) -> &'static str {
+        match self {
+            DisplayEvent::OutputConnected { .. } => "outputConnected",
+            DisplayEvent::OutputDisconnected { .. } => "outputDisconnected",
+            DisplayEvent::ModeChanged { .. } => "modeChanged",
+            DisplayEvent::RotationChanged { .. } => "rotationChanged",
+            DisplayEvent::ScreenshotSaved { .. } => "screenshotSaved",
+            DisplayEvent::ScreenshotFailed { .. } => "screenshotFailed",
+            DisplayEvent::BackendChanged { .. } => "backendChanged",
+        }
+    }
+}
+
+impl fmt::Display for DisplayEvent {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            DisplayEvent::OutputConnected { output }
+            | DisplayEvent::OutputDisconnected { output } => {
+                write!(f, "{} {}", self.topic(), output)
+            }
+            DisplayEvent::ModeChanged {
+                output,
+                mode: Some((width, height, refresh)),
+            } => write!(
+                f,
+                "{} {} {}x{}@{}",
+                self.topic(),
+                output,
+                width,
+                height,
+                refresh
+            ),
+            DisplayEvent::ModeChanged { output, mode: None } => {
+                write!(f, "{} {} off", self.topic(), output)
+            }
+            DisplayEvent::RotationChanged { output, rotation } => {
+                write!(f, "{} {} {}", self.topic(), output, rotation)
+            }
+            DisplayEvent::ScreenshotSaved { path } | DisplayEvent::ScreenshotFailed { path } => {
+                write!(f, "{} {}", self.topic(), path)
+            }
+            DisplayEvent::BackendChanged { backend } => write!(f, "{} {}", self.topic(), backend),
+        }
+    }
+}
+
+/// Returns the `(width, height, refresh)` of the active mode of an output
+fn active_mode(output: &DisplayOutput) -> Option<(u32, u32, u32)> {
+    output
+        .current_mode
+        .as_ref()
+        .map(|mode| (mode.width, mode.height, mode.refresh_rate()))
+}
+
+/// Computes the events leading from one set of outputs to another
+///
+/// # Arguments
+/// * `old` - The outputs before the change
+/// * `new` - The outputs after the change
+///
+/// # Returns
+/// The events, in the order of `new` followed by outputs that disappeared
+pub fn diff_outputs(old: &[DisplayOutput], new: &[DisplayOutput]) -> Vec<DisplayEvent> {
+    let find = |outputs: &'_ [DisplayOutput], name: &str| -> Option<usize> {
+        outputs.iter().position(|output| *output.name == *name)
+    };
+
+    let mut events = Vec::new();
+    for output in new {
+        let previous = find(old, &output.name).map(|index| &old[index]);
+        let was_connected = previous.is_some_and(|previous| previous.is_connected);
+
+        match (was_connected, output.is_connected) {
+            (false, true) => events.push(DisplayEvent::OutputConnected {
+                output: output.name.to_string(),
+            }),
+            (true, false) => events.push(DisplayEvent::OutputDisconnected {
+                output: output.name.to_string(),
+            }),
+            _ => {}
+        }
+        if !output.is_connected {
+            continue;
+        }
+
+        let mode = active_mode(output);
+        if previous.map_or(mode.is_some(), |previous| active_mode(previous) != mode) {
+            events.push(DisplayEvent::ModeChanged {
+                output: output.name.to_string(),
+                mode,
+            });
+        }
+        if previous.map_or(output.rotation != 0, |previous| {
+            previous.rotation != output.rotation
+        }) {
+            events.push(DisplayEvent::RotationChanged {
+                output: output.name.to_string(),
+                rotation: output.rotation,
+            });
+        }
+    }
+
+    for output in old {
+        if output.is_connected && find(new, &output.name).is_none() {
+            events.push(DisplayEvent::OutputDisconnected {
+                output: output.name.to_string(),
+            });
+        }
+    }
+    events
+}
+
+/// Destination of all events, installed by the event publisher
+static SINK: OnceLock<Sender<DisplayEvent>> = OnceLock::new();
+
+/// Installs the channel receiving every emitted event
+///
+/// # Arguments
+/// * `sink` - The sending half read by the publisher
+///
+/// # Returns
+/// `false` if a sink was already installed
+pub fn set_sink(sink: Sender<DisplayEvent>) -> bool {
+    SINK.set(sink).is_ok()
+}
+
+/// Hands an event to the publisher without blocking
+///
+/// Events are dropped when no publisher is installed or its queue is full; subscribers
+/// can always resynchronize with a query command.
+pub fn emit(event: DisplayEvent) {
+    let Some(sink) = SINK.get() else {
+        return;
+    };
+    debug!("Display event: {}", event);
+    match sink.try_send(event) {
+        Ok(()) => {}
+        Err(TrySendError::Full(event)) => warn!("Event queue full, dropping '{}'", event),
+        Err(TrySendError::Closed(_)) => {}
+    }
+}
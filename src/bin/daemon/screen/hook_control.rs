@@ -0,0 +1,409 @@
+//! drmhook Control Channel
+//!
+//! This module owns the shared-memory control region read by the `libdrmhook.so`
+//! preload library. regmsgd is the only writer; the hook maps the region read-only
+//! and picks up new mode preferences on its next connector query, without opening or
+//! parsing any file.
+//!
+//! Updates are published with a sequence lock: the sequence number is odd while a
+//! write is in progress, and readers retry until they observe the same even value
+//! before and after reading the payload.
+//!
+//! Preferences are kept per connector id and carry the exact mode timings, so the
+//! hook can tell apart modes that share a resolution and integer refresh rate
+//! (e.g., 60 Hz and 59.94 Hz).
+//!
+//! The layout must stay in sync with `struct drmhook_control` in `lib/drmhook.c`.
+
+use std::fs::{self, File, OpenOptions};
+use std::os::fd::AsRawFd;
+use std::os::unix::fs::{MetadataExt, OpenOptionsExt};
+use std::path::Path;
+use std::ptr::NonNull;
+use std::sync::Mutex;
+use std::sync::atomic::{AtomicU32, Ordering, fence};
+
+use crate::utils::error::{RegmsgError, Result};
+
+use tracing::{debug, info, warn};
+
+/// Location of the control region, shared with `lib/drmhook.c`; a root-owned tmpfs
+/// directory, so other users cannot plant a file there
+pub const HOOK_CONTROL_PATH: &str = "/var/run/regmsgd-drmhook";
+
+/// Identifies a regmsgd control region ("RGDM")
+const CONTROL_MAGIC: u32 = 0x5247_444d;
+
+/// Layout version, bumped whenever `ControlRegion` changes
+const CONTROL_VERSION: u32 = 2;
+
+/// Number of per-connector slots, a power of two so the hook can mask the id
+pub const CONTROL_SLOTS: usize = 16;
+
+/// Set in the header `flags` once a preference has been published; until then
+/// the hook keeps using the mode file
+const FLAG_TABLE_VALID: u32 = 1 << 0;
+
+/// Exact timings identifying one mode of a connector, as in `drmModeModeInfo`
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct HookMode {
+    /// Pixel clock in kHz
+    pub clock: u32,
+    pub hdisplay: u16,
+    pub hsync_start: u16,
+    pub hsync_end: u16,
+    pub htotal: u16,
+    pub hskew: u16,
+    pub vdisplay: u16,
+    pub vsync_start: u16,
+    pub vsync_end: u16,
+    pub vtotal: u16,
+    pub vscan: u16,
+    /// `DRM_MODE_FLAG_*` bits
+    pub flags: u32,
+}
+
+impl HookMode {
+    /// Returns the exact refresh rate in millihertz (e.g., 59940 for 59.94 Hz)
+    pub fn refresh_mhz(&self) -> u32 {
+        let total = self.htotal as u64 * self.vtotal as u64;
+        if total == 0 {
+            return 0;
+        }
+        ((self.clock as u64 * 1_000_000 + total / 2) / total) as u32
+    }
+}
+
+/// Header of the shared control region (64 bytes)
+#[repr(C)]
+struct ControlHeader {
+    magic: AtomicU32,
+    version: AtomicU32,
+    /// Sequence lock, odd while an update is in progress
+    seq: AtomicU32,
+    flags: AtomicU32,
+    reserved: [AtomicU32; 12],
+}
+
+/// Preference of one connector (64 bytes), `connector_id` 0 marks a free slot
+#[repr(C)]
+struct ControlEntry {
+    connector_id: AtomicU32,
+    clock: AtomicU32,
+    hdisplay: AtomicU32,
+    hsync_start: AtomicU32,
+    hsync_end: AtomicU32,
+    htotal: AtomicU32,
+    hskew: AtomicU32,
+    vdisplay: AtomicU32,
+    vsync_start: AtomicU32,
+    vsync_end: AtomicU32,
+    vtotal: AtomicU32,
+    vscan: AtomicU32,
+    flags: AtomicU32,
+    reserved: [AtomicU32; 3],
+}
+
+impl ControlEntry {
+    fn store(&self, connector_id: u32, mode: &HookMode) {
+        self.clock.store(mode.clock, Ordering::Relaxed);
+        self.hdisplay.store(mode.hdisplay as u32, Ordering::Relaxed);
+        self.hsync_start
+            .store(mode.hsync_start as u32, Ordering::Relaxed);
+        self.hsync_end
+            .store(mode.hsync_end as u32, Ordering::Relaxed);
+        self.htotal.store(mode.htotal as u32, Ordering::Relaxed);
+        self.hskew.store(mode.hskew as u32, Ordering::Relaxed);
+        self.vdisplay.store(mode.vdisplay as u32, Ordering::Relaxed);
+        self.vsync_start
+            .store(mode.vsync_start as u32, Ordering::Relaxed);
+        self.vsync_end
+            .store(mode.vsync_end as u32, Ordering::Relaxed);
+        self.vtotal.store(mode.vtotal as u32, Ordering::Relaxed);
+        self.vscan.store(mode.vscan as u32, Ordering::Relaxed);
+        self.flags.store(mode.flags, Ordering::Relaxed);
+        self.connector_id.store(connector_id, Ordering::Relaxed);
+    }
+
+    fn load(&self) -> HookMode {
+        let short = |value: &AtomicU32| value.load(Ordering::Relaxed) as u16;
+        HookMode {
+            clock: self.clock.load(Ordering::Relaxed),
+            hdisplay: short(&self.hdisplay),
+            hsync_start: short(&self.hsync_start),
+            hsync_end: short(&self.hsync_end),
+            htotal: short(&self.htotal),
+            hskew: short(&self.hskew),
+            vdisplay: short(&self.vdisplay),
+            vsync_start: short(&self.vsync_start),
+            vsync_end: short(&self.vsync_end),
+            vtotal: short(&self.vtotal),
+            vscan: short(&self.vscan),
+            flags: self.flags.load(Ordering::Relaxed),
+        }
+    }
+}
+
+/// Shared control region layout: a header followed by an open-addressed table
+/// indexed by `connector_id % CONTROL_SLOTS` with linear probing
+#[repr(C)]
+struct ControlRegion {
+    header: ControlHeader,
+    entries: [ControlEntry; CONTROL_SLOTS],
+}
+
+/// Returns the slot holding `connector_id`, or the free slot where it belongs
+fn find_slot(entries: &[ControlEntry], connector_id: u32) -> Option<usize> {
+    (0..CONTROL_SLOTS)
+        .map(|probe| connector_id.wrapping_add(probe as u32) as usize % CONTROL_SLOTS)
+        .find(|&slot| {
+            let id = entries[slot].connector_id.load(Ordering::Relaxed);
+            id == connector_id || id == 0
+        })
+}
+
+/// Writer side of the drmhook control region
+pub struct HookControl {
+    region: NonNull<ControlRegion>,
+    /// Serializes writers inside the daemon
+    write_lock: Mutex<()>,
+}
+
+// The region is only accessed through atomics, and writers are serialized by `write_lock`.
+unsafe impl Send for HookControl {}
+unsafe impl Sync for HookControl {}
+
+impl HookControl {
+    /// Creates (or reopens) the control region at `HOOK_CONTROL_PATH`.
+    ///
+    /// An existing region is reused rather than recreated, so hooks that already
+    /// mapped it keep seeing updates across daemon restarts.
+    pub fn open() -> Result<Self> {
+        Self::open_at(Path::new(HOOK_CONTROL_PATH))
+    }
+
+    /// Creates (or reopens) a control region at `path`.
+    ///
+    /// Symbolic links are never followed, and an existing file is only reused when it
+    /// is a regular file owned by the daemon's user that nobody else can write to.
+    /// Anything else is unlinked and replaced by a newly created file.
+    ///
+    /// # Arguments
+    /// * `path` - The backing file, normally on a tmpfs such as `/var/run`
+    pub fn open_at(path: &Path) -> Result<Self> {
+        let size = std::mem::size_of::<ControlRegion>();
+        let open_error = |e: std::io::Error| {
+            RegmsgError::SystemError(format!(
+                "Failed to open hook control region {}: {}",
+                path.display(),
+                e
+            ))
+        };
+
+        let file = match Self::open_existing(path) {
+            Ok(Some(file)) => file,
+            Ok(None) => Self::create(path).map_err(open_error)?,
+            Err(e) => {
+                warn!("Replacing hook control region {}: {}", path.display(), e);
+                fs::remove_file(path).map_err(open_error)?;
+                Self::create(path).map_err(open_error)?
+            }
+        };
+        file.set_len(size as u64)?;
+
+        let ptr = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                size,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_SHARED,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(RegmsgError::SystemError(format!(
+                "Failed to map hook control region: {}",
+                std::io::Error::last_os_error()
+            )));
+        }
+
+        let control = HookControl {
+            region: NonNull::new(ptr as *mut ControlRegion).ok_or_else(|| {
+                RegmsgError::SystemError("Hook control region mapped at null".to_string())
+            })?,
+            write_lock: Mutex::new(()),
+        };
+        control.initialize();
+        info!("Hook control region ready at {}", path.display());
+        Ok(control)
+    }
+
+    /// Opens an existing control region file without following symbolic links
+    ///
+    /// # Returns
+    /// The file, `None` if it does not exist, or an error if it cannot be trusted
+    fn open_existing(path: &Path) -> std::io::Result<Option<File>> {
+        let file = match OpenOptions::new()
+            .read(true)
+            .write(true)
+            .custom_flags(libc::O_NOFOLLOW | libc::O_CLOEXEC)
+            .open(path)
+        {
+            Ok(file) => file,
+            Err(e) if e.kind() == std::io::ErrorKind::NotFound => return Ok(None),
+            Err(e) => return Err(e),
+        };
+
+        let metadata = file.metadata()?;
+        let trusted = metadata.file_type().is_file()
+            && metadata.uid() == unsafe { libc::geteuid() }
+            && metadata.mode() & 0o022 == 0;
+        if !trusted {
+            return Err(std::io::Error::other(format!(
+                "not a private regular file (uid {}, mode {:o})",
+                metadata.uid(),
+                metadata.mode()
+            )));
+        }
+        Ok(Some(file))
+    }
+
+    /// Creates a new control region file, failing if the path exists
+    fn create(path: &Path) -> std::io::Result<File> {
+        OpenOptions::new()
+            .read(true)
+            .write(true)
+            .create_new(true)
+            .mode(0o644)
+            .custom_flags(libc::O_NOFOLLOW | libc::O_CLOEXEC)
+            .open(path)
+    }
+
+    fn region(&self) -> &ControlRegion {
+        unsafe { self.region.as_ref() }
+    }
+
+    /// Stamps the header, discarding a region left by an incompatible daemon version
+    /// and recovering a sequence number left odd by an interrupted writer.
+    fn initialize(&self) {
+        let _guard = self.write_lock.lock().unwrap_or_else(|e| e.into_inner());
+        let region = self.region();
+        let header = &region.header;
+
+        let seq = header.seq.load(Ordering::Acquire);
+        if seq & 1 == 1 {
+            header.seq.store(seq.wrapping_add(1), Ordering::Release);
+        }
+
+        let compatible = header.magic.load(Ordering::Acquire) == CONTROL_MAGIC
+            && header.version.load(Ordering::Acquire) == CONTROL_VERSION;
+        if !compatible {
+            debug!("Initializing hook control region");
+            self.update(|| {
+                header.flags.store(0, Ordering::Relaxed);
+                for entry in &region.entries {
+                    entry.connector_id.store(0, Ordering::Relaxed);
+                }
+            });
+            header.version.store(CONTROL_VERSION, Ordering::Relaxed);
+            header.magic.store(CONTROL_MAGIC, Ordering::Release);
+        }
+    }
+
+    /// Runs `write` inside the sequence lock. Callers must hold `write_lock`.
+    fn update<F: FnOnce()>(&self, write: F) -> u32 {
+        let seq = &self.region().header.seq;
+        let start = seq.load(Ordering::Relaxed);
+        seq.store(start.wrapping_add(1), Ordering::Relaxed);
+        fence(Ordering::Release);
+
+        write();
+
+        seq.store(start.wrapping_add(2), Ordering::Release);
+        start.wrapping_add(2)
+    }
+
+    /// Publishes the preferred mode of one connector to every process running the hook.
+    ///
+    /// # Arguments
+    /// * `connector_id` - DRM object id of the connector
+    /// * `mode` - Exact timings of the preferred mode
+    ///
+    /// # Returns
+    /// A `Result` indicating success, or an error when the table is full
+    pub fn publish_connector_mode(&self, connector_id: u32, mode: &HookMode) -> Result<()> {
+        if connector_id == 0 {
+            return Err(RegmsgError::InvalidArguments(
+                "Connector id 0 is reserved".to_string(),
+            ));
+        }
+
+        let _guard = self.write_lock.lock().unwrap_or_else(|e| e.into_inner());
+        let region = self.region();
+        let slot = find_slot(&region.entries, connector_id).ok_or_else(|| {
+            RegmsgError::SystemError(format!(
+                "Hook control table is full ({} connectors)",
+                CONTROL_SLOTS
+            ))
+        })?;
+
+        let seq = self.update(|| {
+            region.entries[slot].store(connector_id, mode);
+            region
+                .header
+                .flags
+                .store(FLAG_TABLE_VALID, Ordering::Relaxed);
+        });
+        debug!(
+            "Published hook mode {}x{}@{}.{:03} for connector {} (slot {}, seq {})",
+            mode.hdisplay,
+            mode.vdisplay,
+            mode.refresh_mhz() / 1000,
+            mode.refresh_mhz() % 1000,
+            connector_id,
+            slot,
+            seq
+        );
+        Ok(())
+    }
+
+    /// Returns whether a preference has been published, after which the hook ignores
+    /// the mode file
+    pub fn table_valid(&self) -> bool {
+        self.region().header.flags.load(Ordering::Acquire) & FLAG_TABLE_VALID != 0
+    }
+
+    /// Reads the published mode of a connector the way the hook does, returning
+    /// `None` when no preference has been published for it.
+    pub fn read_connector_mode(&self, connector_id: u32) -> Option<HookMode> {
+        let region = self.region();
+        loop {
+            let before = region.header.seq.load(Ordering::Acquire);
+            if before & 1 == 1 {
+                std::hint::spin_loop();
+                continue;
+            }
+            let mode = find_slot(&region.entries, connector_id)
+                .filter(|&slot| {
+                    region.entries[slot].connector_id.load(Ordering::Relaxed) == connector_id
+                })
+                .map(|slot| region.entries[slot].load());
+            fence(Ordering::Acquire);
+            if region.header.seq.load(Ordering::Relaxed) == before {
+                return mode;
+            }
+        }
+    }
+}
+
+impl Drop for HookControl {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(
+                self.region.as_ptr() as *mut libc::c_void,
+                std::mem::size_of::<ControlRegion>(),
+            );
+        }
+    }
+}
@@ -1,14 +1,29 @@
+use std::collections::HashMap;
 use std::fs::OpenOptions;
-use std::os::unix::io::{AsFd, BorrowedFd};
+use std::os::unix::io::{AsFd, AsRawFd, BorrowedFd};
 use std::path::Path;
-
-use drm::Device;
-use drm::control::{Device as ControlDevice, connector};
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, Mutex, OnceLock};
+
+use drm::buffer::{self, DrmFourcc, DrmModifier};
+use drm::control::atomic::AtomicModeReq;
+use drm::control::{
+    AtomicCommitFlags, Device as ControlDevice, Mode, ModeFlags, ModeTypeFlags, connector, crtc,
+    encoder, framebuffer, property,
+};
+use drm::{ClientCapability, Device};
 
 use crate::screen::backend::{
-    DisplayBackend, DisplayMode, DisplayOutput, ModeParams, RotationParams,
+    DisplayBackend, DisplayMode, DisplayOutput, ModeParams, ProfileChanges, RotationParams,
+    parse_max_resolution,
 };
+use crate::screen::cache::OutputCache;
+use crate::screen::hook_control::{HookControl, HookMode};
+use crate::screen::mode_index::ModeIndex;
+use crate::screen::screenshot::Frame;
+use crate::screen::uevent::{self, UeventNotice};
 use crate::utils::error::{RegmsgError, Result};
+use crate::utils::stats;
 
 use tracing::{debug, error, info, warn};
 
@@ -98,46 +113,496 @@ impl DrmCard {
     }
 }
 
+/// Connector state with its encoder → CRTC chain already resolved
+#[derive(Debug, Clone)]
+struct ConnectorState {
+    /// Connector handle; its raw id also keys drmhook preferences
+    handle: connector::Handle,
+    /// Connector name as exposed to clients (e.g., "HDMIA"), shared by every output
+    /// list built from this snapshot
+    name: Arc<str>,
+    /// Whether a display is attached to the connector
+    connected: bool,
+    /// Modes advertised by the connector
+    modes: Vec<Mode>,
+    /// Index over `modes` for mode selection
+    index: ModeIndex,
+    /// CRTC currently driving the connector
+    crtc: Option<crtc::Handle>,
+    /// Mode programmed on that CRTC
+    current_mode: Option<Mode>,
+}
+
+/// Display topology of a card resolved in a single pass
+///
+/// Resource handles, encoders, CRTCs and connectors are each queried exactly once,
+/// so every query method works on the same consistent view of the device.
+#[derive(Debug, Clone)]
+struct Topology {
+    connectors: Vec<ConnectorState>,
+}
+
+impl Topology {
+    /// Iterates over connectors matching an optional screen name
+    fn matching<'a>(&'a self, screen: Option<&'a str>) -> impl Iterator<Item = &'a ConnectorState> {
+        self.connectors.iter().filter(move |state| {
+            screen.map_or(true, |screen_name| {
+                let matches = *state.name == *screen_name;
+                if !matches {
+                    debug!(
+                        "Skipping connector {} - doesn't match screen {}",
+                        state.name, screen_name
+                    );
+                }
+                matches
+            })
+        })
+    }
+
+    /// Iterates over connected connectors matching an optional screen name
+    fn connected<'a>(
+        &'a self,
+        screen: Option<&'a str>,
+    ) -> impl Iterator<Item = &'a ConnectorState> {
+        self.matching(screen).filter(|state| state.connected)
+    }
+
+    /// Returns the current mode of the first connected connector matching the screen
+    fn current_mode<'a>(&'a self, screen: Option<&'a str>) -> Option<&'a Mode> {
+        self.connected(screen)
+            .find_map(|state| state.current_mode.as_ref())
+    }
+}
+
+/// Reads the `WxH@R` preference of the mode file, as the hook does without the
+/// control region
+fn read_mode_file() -> Option<(u16, u16, u32)> {
+    let content = std::fs::read_to_string(DRM_MODE_PATH).ok()?;
+    let (size, refresh) = content.trim().split_once('@')?;
+    let (width, height) = size.split_once('x')?;
+    Some((
+        width.parse().ok()?,
+        height.parse().ok()?,
+        refresh.parse().ok()?,
+    ))
+}
+
+/// Captures the exact timings of a DRM mode for the drmhook control region
+fn to_hook_mode(mode: &Mode) -> HookMode {
+    let (hdisplay, vdisplay) = mode.size();
+    let (hsync_start, hsync_end, htotal) = mode.hsync();
+    let (vsync_start, vsync_end, vtotal) = mode.vsync();
+    HookMode {
+        clock: mode.clock(),
+        hdisplay,
+        hsync_start,
+        hsync_end,
+        htotal,
+        hskew: mode.hskew(),
+        vdisplay,
+        vsync_start,
+        vsync_end,
+        vtotal,
+        vscan: mode.vscan(),
+        flags: mode.flags().bits(),
+    }
+}
+
+/// Wraps a DRM ioctl error into a backend error
+fn drm_error(context: &str, e: std::io::Error) -> RegmsgError {
+    RegmsgError::BackendError {
+        backend: "DRM".to_string(),
+        message: format!("{}: {}", context, e),
+    }
+}
+
+/// `struct drm_mode_map_dumb` from `drm_mode.h`
+#[repr(C)]
+struct DrmModeMapDumb {
+    handle: u32,
+    pad: u32,
+    offset: u64,
+}
+
+/// `DRM_IOWR(0xB3, struct drm_mode_map_dumb)`
+const DRM_IOCTL_MODE_MAP_DUMB: libc::c_ulong = 0xC010_64B3;
+
+/// Read-only CPU mapping of a GEM buffer, unmapped on drop
+struct BufferMapping {
+    ptr: *mut libc::c_void,
+    len: usize,
+}
+
+impl BufferMapping {
+    /// Maps `len` bytes of a buffer through the card's fake mmap offset
+    fn map(card: &DrmCard, buffer: buffer::Handle, len: usize) -> Result<Self> {
+        let fd = card.as_fd().as_raw_fd();
+        let mut request = DrmModeMapDumb {
+            handle: buffer.into(),
+            pad: 0,
+            offset: 0,
+        };
+        if unsafe { libc::ioctl(fd, DRM_IOCTL_MODE_MAP_DUMB as _, &mut request) } != 0 {
+            return Err(drm_error(
+                "Failed to map framebuffer",
+                std::io::Error::last_os_error(),
+            ));
+        }
+
+        let ptr = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                len,
+                libc::PROT_READ,
+                libc::MAP_SHARED,
+                fd,
+                request.offset as libc::off_t,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(drm_error(
+                "Failed to mmap framebuffer",
+                std::io::Error::last_os_error(),
+            ));
+        }
+        Ok(BufferMapping { ptr, len })
+    }
+
+    fn as_slice(&self) -> &[u8] {
+        unsafe { std::slice::from_raw_parts(self.ptr as *const u8, self.len) }
+    }
+}
+
+impl Drop for BufferMapping {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.ptr, self.len);
+        }
+    }
+}
+
+/// Looks up the handle of a named KMS property
+fn find_property(props: &HashMap<String, property::Info>, name: &str) -> Result<property::Handle> {
+    props
+        .get(name)
+        .map(|info| info.handle())
+        .ok_or_else(|| RegmsgError::BackendError {
+            backend: "DRM".to_string(),
+            message: format!("Missing KMS property {}", name),
+        })
+}
+
+/// Returns the exact refresh rate of a DRM mode in mHz, e.g. 59940 for NTSC timings
+///
+/// `vrefresh` is rounded to whole hertz, so the rate is derived from the pixel clock
+/// and the total frame size instead.
+fn refresh_mhz(mode: &Mode) -> u32 {
+    let (_, _, htotal) = mode.hsync();
+    let (_, _, vtotal) = mode.vsync();
+    let mut pixels = htotal as u64 * vtotal as u64;
+    if pixels == 0 {
+        return mode.vrefresh() * 1000;
+    }
+
+    let flags = mode.flags();
+    if flags.contains(ModeFlags::DBLSCAN) {
+        pixels *= 2;
+    }
+    let mut refresh = (mode.clock() as u64 * 1_000_000 + pixels / 2) / pixels;
+    if flags.contains(ModeFlags::INTERLACE) {
+        refresh *= 2;
+    }
+    refresh as u32
+}
+
+/// Converts a DRM mode into our DisplayMode
+fn to_display_mode(mode: &Mode) -> DisplayMode {
+    let (width, height) = mode.size();
+    DisplayMode {
+        width: width as u32,
+        height: height as u32,
+        refresh_mhz: refresh_mhz(mode),
+        preferred: mode.mode_type().contains(ModeTypeFlags::PREFERRED),
+        interlaced: mode.flags().contains(ModeFlags::INTERLACE),
+    }
+}
+
 /// Backend implementation for DRM/KMS
-pub struct DrmBackend;
+///
+/// The selected card is opened once and its file descriptor kept for the lifetime
+/// of the backend. It is only probed again when a uevent reports that a card node
+/// was added or removed, or when an ioctl on the cached card fails.
+pub struct DrmBackend {
+    /// Card chosen by the last probe of `/dev/dri/`
+    card: Mutex<Option<Arc<DrmCard>>>,
+    /// Set by the uevent monitor when the set of card nodes changes
+    devices_changed: Arc<AtomicBool>,
+    /// Set when connectors must be force-probed (first use, hotplug, new card)
+    needs_probe: Arc<AtomicBool>,
+    /// Caches invalidated on hotplug and device changes
+    listeners: Arc<Mutex<Vec<Arc<OutputCache>>>>,
+    /// Whether the uevent monitor started, set on first use
+    monitor: OnceLock<bool>,
+    /// Cleared when the uevent monitor stopped after starting
+    monitor_running: Arc<AtomicBool>,
+    /// Shared-memory channel to the drmhook library, opened on first mode change
+    hook: OnceLock<Option<HookControl>>,
+}
 
 impl DrmBackend {
     pub fn new() -> Self {
-        Self
+        Self {
+            card: Mutex::new(None),
+            devices_changed: Arc::new(AtomicBool::new(false)),
+            needs_probe: Arc::new(AtomicBool::new(true)),
+            listeners: Arc::new(Mutex::new(Vec::new())),
+            monitor: OnceLock::new(),
+            monitor_running: Arc::new(AtomicBool::new(true)),
+            hook: OnceLock::new(),
+        }
     }
 
-    /// Helper to iterate over connectors
-    fn for_each_connector<F>(&self, screen: Option<&str>, mut f: F) -> Result<()>
-    where
-        F: FnMut(&connector::Info) -> Result<()>,
-    {
+    /// Starts the uevent monitor on first use and returns whether it is running
+    ///
+    /// Dropped uevents are handled like a device change and a hotplug on every
+    /// connector. When the monitor stops, the cards and connectors are probed once more
+    /// and the registered caches stop serving snapshots, so every query reads the device.
+    fn start_monitor(&self) -> bool {
+        let started = *self.monitor.get_or_init(|| {
+            let devices_changed = Arc::clone(&self.devices_changed);
+            let needs_probe = Arc::clone(&self.needs_probe);
+            let listeners = Arc::clone(&self.listeners);
+            let running = Arc::clone(&self.monitor_running);
+            let started = uevent::watch_drm(move |notice| {
+                let (device_change, hotplug) = match notice {
+                    UeventNotice::Event(event) => (
+                        event.is_device_change(),
+                        event.hotplug || event.is_device_change(),
+                    ),
+                    UeventNotice::Lost => (true, true),
+                    UeventNotice::Stopped => {
+                        let listeners = listeners.lock().unwrap_or_else(|e| e.into_inner());
+                        running.store(false, Ordering::Release);
+                        devices_changed.store(true, Ordering::Release);
+                        needs_probe.store(true, Ordering::Release);
+                        listeners.iter().for_each(|cache| cache.set_live(false));
+                        return;
+                    }
+                };
+                if device_change {
+                    devices_changed.store(true, Ordering::Release);
+                }
+                if hotplug {
+                    needs_probe.store(true, Ordering::Release);
+                    for cache in listeners.lock().unwrap_or_else(|e| e.into_inner()).iter() {
+                        cache.invalidate();
+                    }
+                }
+            });
+            match started {
+                Ok(()) => true,
+                Err(e) => {
+                    warn!(
+                        "DRM uevent monitor unavailable, card changes won't be detected: {}",
+                        e
+                    );
+                    false
+                }
+            }
+        });
+        started && self.monitor_running.load(Ordering::Acquire)
+    }
+
+    /// Returns the cached DRM card, probing `/dev/dri/` on first use or after
+    /// the device set changed.
+    fn card(&self) -> Result<Arc<DrmCard>> {
+        self.start_monitor();
+
+        let mut cached = self.card.lock().unwrap_or_else(|e| e.into_inner());
+        if self.devices_changed.swap(false, Ordering::AcqRel) && cached.is_some() {
+            info!("DRM device set changed, probing cards again");
+            *cached = None;
+        }
+
+        if let Some(card) = cached.as_ref() {
+            return Ok(Arc::clone(card));
+        }
+
+        let card = Arc::new(DrmCard::open_available_card()?);
+        // Opening a primary node makes us DRM master when nobody else holds it; give it
+        // back so compositors and emulators started later can still take it.
+        if card.release_master_lock().is_ok() {
+            debug!("Dropped implicit DRM master");
+        }
+        *cached = Some(Arc::clone(&card));
+        self.needs_probe.store(true, Ordering::Release);
+        Ok(card)
+    }
+
+    /// Drops the cached card so that the next call probes `/dev/dri/` again.
+    fn invalidate_card(&self) {
+        debug!("Invalidating cached DRM card");
+        *self.card.lock().unwrap_or_else(|e| e.into_inner()) = None;
+    }
+
+    /// Copies the framebuffer currently scanned out by a CRTC.
+    ///
+    /// Only linear 32-bit XRGB/ARGB and XBGR/ABGR framebuffers can be read this way; reading the
+    /// buffer handle requires root (CAP_SYS_ADMIN) on most kernels.
+    fn capture_crtc(&self, crtc: crtc::Handle) -> Result<Frame> {
+        let card = self.card()?;
+        let framebuffer = card
+            .get_crtc(crtc)
+            .map_err(|e| drm_error("Failed to read CRTC", e))?
+            .framebuffer()
+            .ok_or_else(|| RegmsgError::NotFound("CRTC has no framebuffer".to_string()))?;
+        let info = card
+            .get_planar_framebuffer(framebuffer)
+            .map_err(|e| drm_error("Failed to read framebuffer", e))?;
+
+        // GETFB2 opened a GEM handle per distinct buffer; release them even if mapping failed
+        let mut buffers: Vec<buffer::Handle> = Vec::new();
+        for buffer in info.buffers().into_iter().flatten() {
+            if !buffers.contains(&buffer) {
+                buffers.push(buffer);
+            }
+        }
+        let frame = Self::map_frame(&card, &info, &buffers);
+        for buffer in buffers {
+            if let Err(e) = card.close_buffer(buffer) {
+                warn!("Failed to close framebuffer handle: {}", e);
+            }
+        }
+        frame
+    }
+
+    /// Maps the first plane of a scanned-out framebuffer and converts it to RGB.
+    ///
+    /// Only linear single-plane 32 bpp RGB formats are read: tiled or compressed
+    /// buffers and other layouts would decode to garbage, so they are rejected.
+    fn map_frame(
+        card: &DrmCard,
+        info: &framebuffer::PlanarInfo,
+        buffers: &[buffer::Handle],
+    ) -> Result<Frame> {
+        let unsupported = |what: String| RegmsgError::BackendError {
+            backend: "DRM".to_string(),
+            message: format!("Unsupported framebuffer {}", what),
+        };
+
+        // No modifier means the driver's implicit layout, which is linear for scanout
+        // buffers created without modifiers
+        if let Some(modifier) = info.modifier() {
+            if modifier != DrmModifier::Linear {
+                return Err(unsupported(format!("modifier {:?}", modifier)));
+            }
+        }
+        let convert: fn(&[u8], u32, u32, usize) -> Result<Frame> = match info.pixel_format() {
+            DrmFourcc::Xrgb8888 | DrmFourcc::Argb8888 => Frame::from_xrgb8888,
+            DrmFourcc::Xbgr8888 | DrmFourcc::Abgr8888 => Frame::from_xbgr8888,
+            format => return Err(unsupported(format!("format {:?}", format))),
+        };
+        let buffer = *buffers.first().ok_or_else(|| RegmsgError::BackendError {
+            backend: "DRM".to_string(),
+            message: "Framebuffer buffer handle not available".to_string(),
+        })?;
+
+        let (width, height) = info.size();
+        let pitch = info.pitches()[0] as usize;
+        let offset = info.offsets()[0] as usize;
+        let mapping = stats::CALLS.time("drm.map_framebuffer", || {
+            BufferMapping::map(card, buffer, offset + pitch * height as usize)
+        })?;
+        convert(&mapping.as_slice()[offset..], width, height, pitch)
+    }
+
+    /// Resolves the connector → encoder → CRTC topology of the card in one pass.
+    ///
+    /// Connectors are only force-probed (slow on HDMI) on first use and after a
+    /// hotplug uevent; otherwise the kernel's current connector state is read.
+    fn topology(&self) -> Result<Topology> {
         debug!("Fetching resource handles for DRM device");
-        let card = DrmCard::open_available_card()?;
-        let resources = card
-            .resource_handles()
-            .map_err(|e| RegmsgError::BackendError {
-                backend: "DRM".to_string(),
-                message: e.to_string(),
+        let card = self.card()?;
+        let resources = stats::CALLS
+            .time("drm.resource_handles", || card.resource_handles())
+            .map_err(|e| {
+                // The device may have gone away; re-probe on the next call
+                self.invalidate_card();
+                RegmsgError::BackendError {
+                    backend: "DRM".to_string(),
+                    message: e.to_string(),
+                }
             })?;
 
+        let crtc_modes: HashMap<crtc::Handle, Option<Mode>> = resources
+            .crtcs()
+            .iter()
+            .filter_map(|&handle| {
+                match stats::CALLS.time("drm.get_crtc", || card.get_crtc(handle)) {
+                    Ok(info) => Some((handle, info.mode())),
+                    Err(e) => {
+                        warn!("Failed to get info for CRTC {:?}: {}", handle, e);
+                        None
+                    }
+                }
+            })
+            .collect();
+
+        let encoder_crtcs: HashMap<encoder::Handle, Option<crtc::Handle>> = resources
+            .encoders()
+            .iter()
+            .filter_map(|&handle| {
+                match stats::CALLS.time("drm.get_encoder", || card.get_encoder(handle)) {
+                    Ok(info) => Some((handle, info.crtc())),
+                    Err(e) => {
+                        warn!("Failed to get info for encoder {:?}: {}", handle, e);
+                        None
+                    }
+                }
+            })
+            .collect();
+
+        let force_probe = self.needs_probe.swap(false, Ordering::AcqRel);
         let connectors = resources.connectors();
-        debug!("Found {} connectors", connectors.len());
+        debug!(
+            "Found {} connectors, {} encoders, {} CRTCs (force probe: {})",
+            connectors.len(),
+            encoder_crtcs.len(),
+            crtc_modes.len(),
+            force_probe
+        );
 
+        let mut states = Vec::with_capacity(connectors.len());
+        let connector_call = if force_probe {
+            "drm.probe_connector"
+        } else {
+            "drm.get_connector"
+        };
         for &connector_handle in connectors {
-            match card.get_connector(connector_handle, true) {
-                Ok(connector_info) => {
-                    if let Some(screen_name) = screen {
-                        if format!("{:?}", connector_info.interface()) != screen_name {
-                            debug!(
-                                "Skipping connector {:?} - doesn't match screen {}",
-                                connector_info.interface(),
-                                screen_name
-                            );
-                            continue;
-                        }
-                    }
-
-                    f(&connector_info)?;
+            match stats::CALLS.time(connector_call, || {
+                card.get_connector(connector_handle, force_probe)
+            }) {
+                Ok(info) => {
+                    let crtc = info
+                        .current_encoder()
+                        .and_then(|encoder| encoder_crtcs.get(&encoder).copied().flatten());
+                    let current_mode =
+                        crtc.and_then(|crtc| crtc_modes.get(&crtc).copied().flatten());
+
+                    let modes = info.modes().to_vec();
+                    let index = ModeIndex::new(modes.iter().map(|mode| {
+                        let (width, height) = mode.size();
+                        (width as u32, height as u32, refresh_mhz(mode))
+                    }));
+                    states.push(ConnectorState {
+                        handle: connector_handle,
+                        name: Arc::from(format!("{:?}", info.interface())),
+                        connected: info.state() == connector::State::Connected,
+                        modes,
+                        index,
+                        crtc,
+                        current_mode,
+                    });
                 }
                 Err(e) => {
                     warn!(
@@ -149,120 +614,185 @@ impl DrmBackend {
             }
         }
 
-        debug!("Connector iteration completed successfully");
-        Ok(())
+        debug!("Topology snapshot completed successfully");
+        Ok(Topology { connectors: states })
     }
-}
 
-impl DisplayBackend for DrmBackend {
-    fn list_outputs(&self) -> Result<Vec<DisplayOutput>> {
-        let mut outputs = Vec::new();
-
-        self.for_each_connector(None, |connector_info| {
-            let name = format!("{:?}", connector_info.interface());
-            let modes = connector_info
-                .modes()
-                .iter()
-                .map(|mode| DisplayMode {
-                    width: mode.size().0 as u32,
-                    height: mode.size().1 as u32,
-                    refresh_rate: mode.vrefresh() as u32,
-                    name: format!("{}x{}@{}Hz", mode.size().0, mode.size().1, mode.vrefresh()),
+    /// Programs `mode` on the CRTC driving the connector with an atomic commit.
+    fn atomic_set_mode(&self, state: &ConnectorState, mode: &Mode) -> Result<()> {
+        self.atomic_set_modes(&[(state, mode)])
+    }
+
+    /// Programs a mode on the CRTC of every given connector in a single atomic commit.
+    ///
+    /// The request is validated with `TEST_ONLY` before being committed, so either all
+    /// connectors switch or none does. DRM master is only held for the duration of the
+    /// commit, and taking it fails while a compositor or emulator owns the display, in
+    /// which case the caller falls back to the hook.
+    fn atomic_set_modes(&self, targets: &[(&ConnectorState, &Mode)]) -> Result<()> {
+        let card = self.card()?;
+        card.set_client_capability(ClientCapability::Atomic, true)
+            .map_err(|e| drm_error("Atomic modesetting unsupported", e))?;
+
+        // Resolve every property before taking master
+        let mut resolved = Vec::with_capacity(targets.len());
+        for &(state, mode) in targets {
+            let crtc = state.crtc.ok_or_else(|| RegmsgError::BackendError {
+                backend: "DRM".to_string(),
+                message: format!("Connector {} is not driven by a CRTC", state.name),
+            })?;
+
+            let connector_props = card
+                .get_properties(state.handle)
+                .and_then(|props| props.as_hashmap(card.as_ref()))
+                .map_err(|e| drm_error("Failed to read connector properties", e))?;
+            let crtc_props = card
+                .get_properties(crtc)
+                .and_then(|props| props.as_hashmap(card.as_ref()))
+                .map_err(|e| drm_error("Failed to read CRTC properties", e))?;
+            let crtc_id = find_property(&connector_props, "CRTC_ID")?;
+            let mode_id = find_property(&crtc_props, "MODE_ID")?;
+            let active = find_property(&crtc_props, "ACTIVE")?;
+            resolved.push((state.handle, crtc, crtc_id, mode_id, active, mode));
+        }
+
+        card.acquire_master_lock()
+            .map_err(|e| drm_error("DRM master is held by another client", e))?;
+
+        let mut blobs = Vec::with_capacity(resolved.len());
+        let mut request = AtomicModeReq::new();
+        let mut result = Ok(());
+        for &(connector, crtc, crtc_id, mode_id, active, mode) in &resolved {
+            match card.create_property_blob(mode) {
+                Ok(blob) => {
+                    request.add_property(connector, crtc_id, property::Value::CRTC(Some(crtc)));
+                    request.add_property(crtc, mode_id, blob);
+                    request.add_property(crtc, active, property::Value::Boolean(true));
+                    blobs.push(blob);
+                }
+                Err(e) => {
+                    result = Err(drm_error("Failed to create mode blob", e));
+                    break;
+                }
+            }
+        }
+
+        let result = result.and_then(|_| {
+            stats::CALLS
+                .time("drm.atomic_test", || {
+                    card.atomic_commit(
+                        AtomicCommitFlags::TEST_ONLY | AtomicCommitFlags::ALLOW_MODESET,
+                        request.clone(),
+                    )
+                })
+                .map_err(|e| drm_error("Atomic modeset rejected", e))
+                .and_then(|_| {
+                    stats::CALLS
+                        .time("drm.atomic_commit", || {
+                            card.atomic_commit(AtomicCommitFlags::ALLOW_MODESET, request)
+                        })
+                        .map_err(|e| drm_error("Atomic modeset failed", e))
                 })
-                .collect();
+        });
 
-            outputs.push(DisplayOutput {
-                name,
-                modes,
-                current_mode: None, // We'll need to check the current mode separately
-                is_connected: connector_info.state() == connector::State::Connected,
-                rotation: 0, // Not available directly from connector
-            });
+        // The CRTCs hold their own reference to the blobs once committed
+        for blob in blobs {
+            if let property::Value::Blob(id) = blob {
+                if let Err(e) = card.destroy_property_blob(id) {
+                    warn!("Failed to destroy mode blob {}: {}", id, e);
+                }
+            }
+        }
 
-            Ok(())
-        })?;
+        if let Err(e) = card.release_master_lock() {
+            warn!("Failed to drop DRM master: {}", e);
+        }
+        result
+    }
 
-        // Update current modes for connected outputs
-        for output in &mut outputs {
-            if output.is_connected {
-                match self.current_mode(Some(&output.name)) {
-                    Ok(mode) => output.current_mode = Some(mode),
-                    Err(_) => {} // Leave as None if we can't determine current mode
+    /// Opens the drmhook control region on first use
+    fn hook(&self) -> Option<&HookControl> {
+        self.hook
+            .get_or_init(|| match HookControl::open() {
+                Ok(hook) => Some(hook),
+                Err(e) => {
+                    warn!(
+                        "drmhook control region unavailable, using {} only: {}",
+                        DRM_MODE_PATH, e
+                    );
+                    None
                 }
+            })
+            .as_ref()
+    }
+
+    /// Publishes the preferred mode of a connector to the drmhook preload library
+    ///
+    /// Running hooks read the exact timings from the shared-memory control region.
+    /// The mode file only holds a single `WxH@R` line for all connectors; it is still
+    /// written for hooks started without access to the region and for other tools
+    /// reading it.
+    fn write_mode_preference(&self, state: &ConnectorState, mode: &Mode) -> Result<()> {
+        if let Some(hook) = self.hook() {
+            if let Err(e) =
+                hook.publish_connector_mode(u32::from(state.handle), &to_hook_mode(mode))
+            {
+                warn!("Failed to publish hook mode for {}: {}", state.name, e);
             }
         }
 
+        let (width, height) = mode.size();
+        let mode_str = format!("{}x{}@{}", width, height, mode.vrefresh());
+        std::fs::write(DRM_MODE_PATH, &mode_str).map_err(|e| {
+            RegmsgError::SystemError(format!("Failed to write to DRM mode path: {}", e))
+        })?;
+        debug!("Writing mode string to {}: {}", DRM_MODE_PATH, mode_str);
+        Ok(())
+    }
+}
+
+impl DisplayBackend for DrmBackend {
+    fn list_outputs(&self) -> Result<Vec<DisplayOutput>> {
+        let topology = self.topology()?;
+
+        let outputs = topology
+            .connectors
+            .iter()
+            .map(|state| DisplayOutput {
+                name: state.name.clone(),
+                modes: state.modes.iter().map(to_display_mode).collect(),
+                current_mode: if state.connected {
+                    state.current_mode.as_ref().map(to_display_mode)
+                } else {
+                    None
+                },
+                is_connected: state.connected,
+                rotation: 0, // Not available directly from connector
+                position: None,
+            })
+            .collect();
+
         Ok(outputs)
     }
 
     fn list_modes(&self, screen: Option<&str>) -> Result<Vec<DisplayMode>> {
-        let mut all_modes = Vec::new();
-
-        self.for_each_connector(screen, |connector_info| {
-            let modes = connector_info
-                .modes()
-                .iter()
-                .map(|mode| DisplayMode {
-                    width: mode.size().0 as u32,
-                    height: mode.size().1 as u32,
-                    refresh_rate: mode.vrefresh() as u32,
-                    name: format!("{}x{}@{}Hz", mode.size().0, mode.size().1, mode.vrefresh()),
-                })
-                .collect::<Vec<_>>();
+        let topology = self.topology()?;
 
-            all_modes.extend(modes);
-            Ok(())
-        })?;
+        let all_modes = topology
+            .matching(screen)
+            .flat_map(|state| state.modes.iter().map(to_display_mode))
+            .collect();
 
         Ok(all_modes)
     }
 
     fn current_mode(&self, screen: Option<&str>) -> Result<DisplayMode> {
-        let mut current_mode = None;
+        let topology = self.topology()?;
 
-        self.for_each_connector(screen, |connector_info| {
-            if connector_info.state() == connector::State::Connected {
-                debug!(
-                    "Checking connected connector {:?}",
-                    connector_info.interface()
-                );
-                if let Some(encoder_id) = connector_info.current_encoder() {
-                    debug!("Fetching encoder info for ID {:?}", encoder_id);
-                    let card = DrmCard::open_available_card()?;
-                    let encoder_info =
-                        card.get_encoder(encoder_id)
-                            .map_err(|e| RegmsgError::BackendError {
-                                backend: "DRM".to_string(),
-                                message: e.to_string(),
-                            })?;
-                    if let Some(crtc_id) = encoder_info.crtc() {
-                        debug!("Fetching CRTC info for ID {:?}", crtc_id);
-                        let crtc_info =
-                            card.get_crtc(crtc_id)
-                                .map_err(|e| RegmsgError::BackendError {
-                                    backend: "DRM".to_string(),
-                                    message: e.to_string(),
-                                })?;
-                        if let Some(mode) = crtc_info.mode() {
-                            current_mode = Some(DisplayMode {
-                                width: mode.size().0 as u32,
-                                height: mode.size().1 as u32,
-                                refresh_rate: mode.vrefresh() as u32,
-                                name: format!(
-                                    "{}x{}@{}Hz",
-                                    mode.size().0,
-                                    mode.size().1,
-                                    mode.vrefresh()
-                                ),
-                            });
-                        }
-                    }
-                }
-            }
-            Ok(())
-        })?;
-
-        current_mode.ok_or_else(|| RegmsgError::NotFound("Current mode".to_string()))
+        topology
+            .current_mode(screen)
+            .map(to_display_mode)
+            .ok_or_else(|| RegmsgError::NotFound("Current mode".to_string()))
     }
 
     fn current_resolution(&self, screen: Option<&str>) -> Result<(u32, u32)> {
@@ -272,7 +802,7 @@ impl DisplayBackend for DrmBackend {
 
     fn current_refresh_rate(&self, screen: Option<&str>) -> Result<u32> {
         let mode = self.current_mode(screen)?;
-        Ok(mode.refresh_rate)
+        Ok(mode.refresh_rate())
     }
 
     fn current_rotation(&self, _screen: Option<&str>) -> Result<u32> {
@@ -283,50 +813,32 @@ impl DisplayBackend for DrmBackend {
     }
 
     fn set_mode(&self, screen: Option<&str>, mode_params: &ModeParams) -> Result<()> {
-        let _card = DrmCard::open_available_card()?;
-
         debug!("Iterating over connectors to set display mode");
+        let topology = self.topology()?;
 
-        // Find a matching connector and update it
-        self.for_each_connector(screen, |connector_info| {
-            // Skip disconnected outputs
-            if connector_info.state() != connector::State::Connected {
-                return Ok(());
-            }
+        // Find a matching connector and update it, skipping disconnected outputs
+        for state in topology.connected(screen) {
+            debug!("Processing connected connector: {}", state.name);
 
-            // Get the connector interface as a string (e.g., "HDMI-A-1")
-            let interface = format!("{:?}", connector_info.interface());
+            // Find the mode with the requested resolution and a refresh rate within 1 Hz
+            let target_mode = state
+                .index
+                .nearest(
+                    mode_params.width,
+                    mode_params.height,
+                    mode_params.refresh_rate,
+                )
+                .map(|position| &state.modes[position]);
 
-            // If a screen name filter is specified, skip non-matching connectors
-            if let Some(screen_name) = screen {
-                if !interface.contains(screen_name) {
-                    debug!(
-                        "Skipping connector {} - doesn't match screen filter '{}'",
-                        interface, screen_name
-                    );
-                    return Ok(());
+            if let Some(target_mode) = target_mode {
+                // Switch the display right away when nobody else drives it
+                match self.atomic_set_mode(state, target_mode) {
+                    Ok(()) => info!("Atomic modeset applied on {}", state.name),
+                    Err(e) => debug!("Atomic modeset skipped on {}: {}", state.name, e),
                 }
-            }
-
-            debug!("Processing connected connector: {}", interface);
 
-            // Search for a matching mode with the requested resolution and refresh rate
-            let target_mode = connector_info.modes().iter().find(|mode| {
-                mode.size().0 == mode_params.width as u16
-                    && mode.size().1 == mode_params.height as u16
-                    && mode.vrefresh() == mode_params.refresh_rate as u32
-            });
-
-            if let Some(target_mode) = target_mode {
-                // Write the mode string to a system state file (used by some services/tools)
-                let mode_str = format!(
-                    "{}x{}@{}",
-                    mode_params.width, mode_params.height, mode_params.refresh_rate
-                );
-                std::fs::write(DRM_MODE_PATH, &mode_str).map_err(|e| {
-                    RegmsgError::SystemError(format!("Failed to write to DRM mode path: {}", e))
-                })?;
-                debug!("Writing mode string to {}: {}", DRM_MODE_PATH, mode_str);
+                // Publish the preference so applications started later pick the same mode
+                self.write_mode_preference(state, target_mode)?;
 
                 info!(
                     "Setting mode '{}' ({}x{}@{}Hz) for screen: {:?}",
@@ -334,22 +846,55 @@ impl DisplayBackend for DrmBackend {
                     mode_params.width,
                     mode_params.height,
                     mode_params.refresh_rate,
-                    interface
+                    state.name
                 );
             } else {
                 warn!(
                     "Mode {}x{}@{} not found for output {}",
-                    mode_params.width, mode_params.height, mode_params.refresh_rate, interface
+                    mode_params.width, mode_params.height, mode_params.refresh_rate, state.name
                 );
             }
-
-            Ok(())
-        })?;
+        }
 
         info!("Mode setting completed successfully");
         Ok(())
     }
 
+    fn published_modes(&self) -> Result<Option<HashMap<Arc<str>, DisplayMode>>> {
+        let topology = self.topology()?;
+
+        // Resolved like the hook: the control region is authoritative once a preference
+        // was published to it, the mode file applies until then
+        let hook = self.hook().filter(|hook| hook.table_valid());
+        let file = if hook.is_none() {
+            read_mode_file()
+        } else {
+            None
+        };
+        let published = topology
+            .connected(None)
+            .filter_map(|state| {
+                let mode = match hook {
+                    Some(hook) => {
+                        let published = hook.read_connector_mode(u32::from(state.handle))?;
+                        state
+                            .modes
+                            .iter()
+                            .find(|mode| to_hook_mode(mode) == published)
+                    }
+                    None => {
+                        let (width, height, refresh) = file?;
+                        state.modes.iter().find(|mode| {
+                            mode.size() == (width, height) && mode.vrefresh() == refresh
+                        })
+                    }
+                }?;
+                Some((Arc::clone(&state.name), to_display_mode(mode)))
+            })
+            .collect();
+        Ok(Some(published))
+    }
+
     fn set_rotation(&self, _screen: Option<&str>, _rotation: &RotationParams) -> Result<()> {
         info!("TODO: Implement drm_set_rotation");
         // This is complex in DRM and typically done at compositor level
@@ -364,36 +909,15 @@ impl DisplayBackend for DrmBackend {
         screen: Option<&str>,
         max_resolution: Option<&str>,
     ) -> Result<()> {
-        let (max_width, max_height) = match max_resolution {
-            Some(res) => {
-                let parts: Vec<&str> = res.split('x').collect();
-                if parts.len() != 2 {
-                    return Err(RegmsgError::InvalidArguments(format!(
-                        "Invalid resolution format: '{}'. Expected 'WxH'",
-                        res
-                    )));
-                }
-                let width = parts[0].parse::<u32>().map_err(|e| {
-                    RegmsgError::ParseError(format!("Failed to parse width: {}", e))
-                })?;
-                let height = parts[1].parse::<u32>().map_err(|e| {
-                    RegmsgError::ParseError(format!("Failed to parse height: {}", e))
-                })?;
-                if width == 0 || height == 0 {
-                    return Err(RegmsgError::InvalidArguments(format!(
-                        "Resolution dimensions must be positive: {}x{}",
-                        width, height
-                    )));
-                }
-                (width, height)
-            }
-            None => (1920, 1080), // Default to 1920x1080 if no max resolution specified
-        };
+        let (max_width, max_height) = parse_max_resolution(max_resolution)?;
 
         let max_area = max_width * max_height;
 
+        // A single snapshot serves both the current mode check and the mode selection
+        let topology = self.topology()?;
+
         // First, check the current mode of the target screen(s) to see if it exceeds the limit
-        let current_mode = self.current_mode(screen).ok(); // Use ok() to convert Result to Option
+        let current_mode = topology.current_mode(screen).map(to_display_mode);
         let should_proceed = if let Some(current_mode) = current_mode {
             let current_area = current_mode.width * current_mode.height;
             debug!(
@@ -429,50 +953,33 @@ impl DisplayBackend for DrmBackend {
             screen
         );
 
-        // Find the highest available resolution that doesn't exceed the max resolution
-        let mut best_mode = None;
-        let mut best_area = 0;
-
-        self.for_each_connector(screen, |connector_info| {
-            if connector_info.state() != connector::State::Connected {
-                return Ok(());
-            }
-
-            // If a screen filter is provided, only process matching connector
-            if let Some(screen_name) = screen {
-                if format!("{:?}", connector_info.interface()) != screen_name {
-                    return Ok(());
+        // Find the highest available resolution that doesn't exceed the max resolution;
+        // across connectors the first one offering the largest area wins
+        let area = |mode: &Mode| mode.size().0 as u32 * mode.size().1 as u32;
+        let best_mode = topology
+            .connected(screen)
+            .filter_map(|state| {
+                let position = state.index.best_within(max_width, max_height)?;
+                Some((state, &state.modes[position]))
+            })
+            .reduce(|best, candidate| {
+                if area(candidate.1) > area(best.1) {
+                    candidate
+                } else {
+                    best
                 }
-            }
-
-            for mode in connector_info.modes() {
-                let mode_width = mode.size().0 as u32;
-                let mode_height = mode.size().1 as u32;
-
-                // Only consider modes that fit within the max resolution
-                if mode_width <= max_width && mode_height <= max_height {
-                    let area = mode_width * mode_height;
-
-                    // Choose the mode with the largest area (highest resolution within limits)
-                    if area > best_area {
-                        best_area = area;
-                        best_mode = Some((mode_width, mode_height, mode.vrefresh() as u32));
-                    }
-                }
-            }
-            Ok(())
-        })?;
+            });
 
-        if let Some((width, height, refresh_rate)) = best_mode {
-            // Write the best mode to the DRM mode path to be used by the hook
-            let mode_str = format!("{}x{}@{}", width, height, refresh_rate);
-            std::fs::write(DRM_MODE_PATH, &mode_str).map_err(|e| {
-                RegmsgError::SystemError(format!("Failed to write to DRM mode path: {}", e))
-            })?;
+        if let Some((state, mode)) = best_mode {
+            // Publish the best mode to the hook for the connector that offers it
+            self.write_mode_preference(state, mode)?;
 
             info!(
                 "Maximum resolution set to {}x{}@{}Hz for screen: {:?}",
-                width, height, refresh_rate, screen
+                mode.size().0,
+                mode.size().1,
+                mode.vrefresh(),
+                state.name
             );
             Ok(())
         } else {
@@ -487,13 +994,18 @@ impl DisplayBackend for DrmBackend {
         }
     }
 
-    fn take_screenshot(&self, _screenshot_dir: &str) -> Result<String> {
-        info!("TODO: Implement drm_get_screenshot");
-        // DRM doesn't provide screenshot functionality directly
-        Err(RegmsgError::BackendError {
-            backend: "DRM".to_string(),
-            message: "Screenshot not supported at DRM level directly".to_string(),
-        })
+    fn capture_frame(&self) -> Result<Frame> {
+        info!("Capturing screenshot.");
+
+        let topology = self.topology()?;
+        let (name, crtc) = topology
+            .connected(None)
+            .filter(|state| state.current_mode.is_some())
+            .find_map(|state| state.crtc.map(|crtc| (&state.name, crtc)))
+            .ok_or_else(|| RegmsgError::NotFound("No active output found".to_string()))?;
+
+        debug!("Reading scanout buffer of {}", name);
+        self.capture_crtc(crtc)
     }
 
     fn map_touchscreen(&self) -> Result<()> {
@@ -501,7 +1013,80 @@ impl DisplayBackend for DrmBackend {
         Ok(())
     }
 
+    fn apply_profile(&self, changes: &ProfileChanges) -> Result<()> {
+        let topology = self.topology()?;
+
+        let mut targets = Vec::with_capacity(changes.outputs.len());
+        for change in &changes.outputs {
+            if change.rotation.is_some() || change.position.is_some() {
+                return Err(RegmsgError::BackendError {
+                    backend: "DRM".to_string(),
+                    message: format!(
+                        "Only modes can be set at DRM level, not the rotation or position of {}",
+                        change.output
+                    ),
+                });
+            }
+            let Some(mode) = change.mode else {
+                continue;
+            };
+
+            let state = topology
+                .connected(Some(&change.output))
+                .next()
+                .ok_or_else(|| {
+                    RegmsgError::NotFound(format!("Screen '{}' not found", change.output))
+                })?;
+            let target = state
+                .index
+                .exact(mode.width, mode.height, mode.refresh_mhz)
+                .map(|position| &state.modes[position])
+                .ok_or_else(|| {
+                    RegmsgError::NotFound(format!(
+                        "Mode {} not available for output '{}'",
+                        mode, change.output
+                    ))
+                })?;
+            targets.push((state, target));
+        }
+
+        // All connectors switch in one commit when nobody else drives the display
+        if !targets.is_empty() {
+            match self.atomic_set_modes(&targets) {
+                Ok(()) => info!("Atomic modeset applied on {} connectors", targets.len()),
+                Err(e) => debug!("Atomic modeset skipped: {}", e),
+            }
+        }
+        for &(state, mode) in &targets {
+            self.write_mode_preference(state, mode)?;
+        }
+
+        if changes.touchscreen.is_some() {
+            self.map_touchscreen()?;
+        }
+        Ok(())
+    }
+
     fn backend_name(&self) -> &'static str {
         "KMS/DRM"
     }
+
+    fn watch_changes(&self, cache: Arc<OutputCache>) -> Result<()> {
+        if !self.start_monitor() {
+            return Err(RegmsgError::BackendError {
+                backend: "DRM".to_string(),
+                message: "Uevent monitor unavailable".to_string(),
+            });
+        }
+
+        // The outputs carry the mode programmed on each CRTC, which other DRM clients
+        // (e.g., an emulator applying the hook preference) change without a uevent, so
+        // snapshots are never served from memory; every query reads the CRTCs again,
+        // without probing the connectors. Uevents only wake the cache's watchers.
+        let mut listeners = self.listeners.lock().unwrap_or_else(|e| e.into_inner());
+        cache.set_live(false);
+        listeners.push(cache);
+        info!("DRM outputs read on every query, uevents wake display events");
+        Ok(())
+    }
 }
@@ -1,17 +1,41 @@
 // Import our new architecture modules
 use crate::config;
-use crate::screen::backend::{DisplayBackend, ModeParams};
+use crate::screen::backend::{
+    DisplayBackend, DisplayMode, DisplayOutput, MeteredBackend, ModeParams, parse_max_resolution,
+};
+use crate::screen::cache::OutputCache;
+use crate::screen::mode_index::ModeIndex;
+use crate::screen::replay::ReplayBackend;
+use crate::screen::screenshot::EncodeOptions;
+use crate::screen::socket_watch::WatchNotice;
 use crate::utils::error::{RegmsgError, Result};
+use std::collections::HashMap;
+use std::fmt::Write;
+use std::fs;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::mpsc::Receiver;
+use std::sync::{Arc, Mutex, MutexGuard, Once, OnceLock};
+use std::time::Duration;
 
 // Modules for backend-specific implementations
 pub mod backend;
+pub mod cache;
+pub mod events;
+pub mod hook_control;
 pub mod kmsdrm;
+pub mod mode_index;
+pub mod profile;
+pub mod replay;
+pub mod screenshot;
+pub mod socket_watch;
+pub mod uevent;
 pub mod wayland;
 
 #[cfg(test)]
 mod screen_tests;
 
-use tracing::{debug, error, info};
+use tracing::{debug, error, info, warn};
 
 /// Represents display mode information including width, height, and refresh rate.
 ///
@@ -24,6 +48,10 @@ pub struct ModeInfo {
     vrefresh: i32, // Refresh rate in Hertz (Hz)
 }
 
+/// Time given to a burst of change notifications (e.g., one uevent per connector) to
+/// settle before the outputs are compared
+const EVENT_SETTLE_DELAY: Duration = Duration::from_millis(50);
+
 /// Service structure that handles all screen operations using the new architecture
 pub struct ScreenService {}
 
@@ -93,29 +121,45 @@ pub fn parse_mode(mode: &str) -> Result<ModeInfo> {
 /// # Returns
 /// A `Result` containing a string with the list of modes, or an error message if the query fails.
 pub fn list_modes(screen: Option<&str>) -> Result<String> {
-    let backend = ScreenService::default_backend()?;
-    let modes = backend.list_modes(screen)?;
+    let modes = display_modes(screen)?;
 
-    let modes_str = modes
-        .iter()
-        .map(|mode| {
-            format!(
-                "{}x{}@{}:{} {}x{}@{}Hz",
-                mode.width,
-                mode.height,
-                mode.refresh_rate,
-                mode.name,
-                mode.width,
-                mode.height,
-                mode.refresh_rate
-            )
-        })
-        .collect::<Vec<_>>()
-        .join("\n");
+    // Format every line straight into one buffer instead of one string per mode
+    let mut modes_str = String::with_capacity(modes.len() * 40);
+    for (index, mode) in modes.iter().enumerate() {
+        if index > 0 {
+            modes_str.push('\n');
+        }
+        let _ = write!(
+            modes_str,
+            "{}x{}@{}:{} {}",
+            mode.width,
+            mode.height,
+            mode.refresh_rate(),
+            mode,
+            mode
+        );
+    }
 
     Ok(modes_str)
 }
 
+/// Returns the available display modes for the specified screen.
+///
+/// # Arguments
+/// * `screen` - An optional string specifying the screen to query (e.g., "HDMI-1").
+///
+/// # Returns
+/// A `Result` containing the modes reported by the backend.
+pub fn display_modes(screen: Option<&str>) -> Result<Vec<DisplayMode>> {
+    let backend = ScreenService::default_backend()?;
+    match ScreenService::cached_outputs(backend)? {
+        Some(outputs) => Ok(matching_outputs(&outputs, screen)
+            .flat_map(|output| output.modes.iter().copied())
+            .collect()),
+        None => backend.list_modes(screen),
+    }
+}
+
 /// Lists available outputs (e.g., HDMI, VGA).
 ///
 /// This function retrieves a list of connected display outputs based on the detected graphics backend.
@@ -124,18 +168,26 @@ pub fn list_modes(screen: Option<&str>) -> Result<String> {
 /// # Returns
 /// A `Result` containing a string with the list of outputs, or an error message if the query fails.
 pub fn list_outputs() -> Result<String> {
-    let backend = ScreenService::default_backend()?;
-    let outputs = backend.list_outputs()?;
+    let outputs = display_outputs()?;
 
     let outputs_str = outputs
         .iter()
-        .map(|output| output.name.clone())
+        .map(|output| &*output.name)
         .collect::<Vec<_>>()
         .join("\n");
 
     Ok(outputs_str)
 }
 
+/// Returns all display outputs with their modes, current mode and rotation.
+///
+/// # Returns
+/// A `Result` containing the outputs reported by the backend.
+pub fn display_outputs() -> Result<Arc<Vec<DisplayOutput>>> {
+    let backend = ScreenService::default_backend()?;
+    ScreenService::outputs(backend)
+}
+
 /// Displays the current display mode for the specified screen.
 ///
 /// This function retrieves the active display mode (resolution and refresh rate) for the given screen.
@@ -147,15 +199,31 @@ pub fn list_outputs() -> Result<String> {
 /// # Returns
 /// A `Result` containing a string with the current mode, or an error message if the query fails.
 pub fn current_mode(screen: Option<&str>) -> Result<String> {
-    let backend = ScreenService::default_backend()?;
-    let mode = backend.current_mode(screen)?;
+    let mode = current_display_mode(screen)?;
 
     Ok(format!(
         "{}x{}@{}",
-        mode.width, mode.height, mode.refresh_rate
+        mode.width,
+        mode.height,
+        mode.refresh_rate()
     ))
 }
 
+/// Returns the current display mode for the specified screen.
+///
+/// # Arguments
+/// * `screen` - An optional string specifying the screen to query.
+///
+/// # Returns
+/// A `Result` containing the active mode, or an error if no output is active.
+pub fn current_display_mode(screen: Option<&str>) -> Result<DisplayMode> {
+    let backend = ScreenService::default_backend()?;
+    match ScreenService::cached_outputs(backend)? {
+        Some(outputs) => Ok(*active_mode(&outputs, screen)?),
+        None => backend.current_mode(screen),
+    }
+}
+
 /// Displays the current output (e.g., HDMI, VGA).
 ///
 /// This function identifies the currently active output based on the graphics backend.
@@ -164,18 +232,26 @@ pub fn current_mode(screen: Option<&str>) -> Result<String> {
 /// # Returns
 /// A `Result` containing a string with the current output, or an error message if the query fails.
 pub fn current_output() -> Result<String> {
-    let backend = ScreenService::default_backend()?;
-    let outputs = backend.list_outputs()?;
-
-    let active_output = outputs
-        .iter()
-        .find(|output| output.is_connected && output.current_mode.is_some())
-        .map(|output| output.name.clone())
+    let active_output = current_display_output()?
+        .map(|output| output.name.to_string())
         .unwrap_or_else(|| "No active output".to_string());
 
     Ok(active_output)
 }
 
+/// Returns the first connected output with an active mode.
+///
+/// # Returns
+/// A `Result` containing the active output, or `None` if no output is active.
+pub fn current_display_output() -> Result<Option<DisplayOutput>> {
+    let outputs = display_outputs()?;
+
+    Ok(outputs
+        .iter()
+        .find(|output| output.is_connected && output.current_mode.is_some())
+        .cloned())
+}
+
 /// Displays the current resolution for the specified screen.
 ///
 /// This function retrieves the current resolution (width x height) for the given screen.
@@ -187,12 +263,29 @@ pub fn current_output() -> Result<String> {
 /// # Returns
 /// A `Result` containing a string with the current resolution, or an error message if the query fails.
 pub fn current_resolution(screen: Option<&str>) -> Result<String> {
-    let backend = ScreenService::default_backend()?;
-    let (width, height) = backend.current_resolution(screen)?;
+    let (width, height) = current_display_resolution(screen)?;
 
     Ok(format!("{}x{}", width, height))
 }
 
+/// Returns the current resolution (width, height) for the specified screen.
+///
+/// # Arguments
+/// * `screen` - An optional string specifying the screen to query.
+///
+/// # Returns
+/// A `Result` containing the width and height in pixels.
+pub fn current_display_resolution(screen: Option<&str>) -> Result<(u32, u32)> {
+    let backend = ScreenService::default_backend()?;
+    match ScreenService::cached_outputs(backend)? {
+        Some(outputs) => {
+            let mode = active_mode(&outputs, screen)?;
+            Ok((mode.width, mode.height))
+        }
+        None => backend.current_resolution(screen),
+    }
+}
+
 /// Displays the current refresh rate for the specified screen.
 ///
 /// This function retrieves the current refresh rate (in Hz) for the given screen.
@@ -204,10 +297,22 @@ pub fn current_resolution(screen: Option<&str>) -> Result<String> {
 /// # Returns
 /// A `Result` containing a string with the current refresh rate, or an error message if the query fails.
 pub fn current_refresh(screen: Option<&str>) -> Result<String> {
-    let backend = ScreenService::default_backend()?;
-    let refresh_rate = backend.current_refresh_rate(screen)?;
+    Ok(format!("{}Hz", current_refresh_rate(screen)?))
+}
 
-    Ok(format!("{}Hz", refresh_rate))
+/// Returns the current refresh rate in Hz for the specified screen.
+///
+/// # Arguments
+/// * `screen` - An optional string specifying the screen to query.
+///
+/// # Returns
+/// A `Result` containing the refresh rate.
+pub fn current_refresh_rate(screen: Option<&str>) -> Result<u32> {
+    let backend = ScreenService::default_backend()?;
+    match ScreenService::cached_outputs(backend)? {
+        Some(outputs) => Ok(active_mode(&outputs, screen)?.refresh_rate()),
+        None => backend.current_refresh_rate(screen),
+    }
 }
 
 /// Displays the current rotation for the specified screen.
@@ -221,16 +326,31 @@ pub fn current_refresh(screen: Option<&str>) -> Result<String> {
 /// # Returns
 /// A `Result` containing a string with the current rotation, or an error message if the query fails.
 pub fn current_rotation(screen: Option<&str>) -> Result<String> {
-    let backend = ScreenService::default_backend()?;
-    let rotation = backend.current_rotation(screen)?;
+    Ok(current_rotation_degrees(screen)?.to_string())
+}
 
-    Ok(rotation.to_string())
+/// Returns the current rotation in degrees for the specified screen.
+///
+/// # Arguments
+/// * `screen` - An optional string specifying the screen to query.
+///
+/// # Returns
+/// A `Result` containing the rotation (0, 90, 180 or 270).
+pub fn current_rotation_degrees(screen: Option<&str>) -> Result<u32> {
+    let backend = ScreenService::default_backend()?;
+    match ScreenService::cached_outputs(backend)? {
+        Some(outputs) => Ok(matching_outputs(&outputs, screen)
+            .next()
+            .map_or(0, |output| output.rotation)),
+        None => backend.current_rotation(screen),
+    }
 }
 
 /// Sets the display mode for the specified screen.
 ///
 /// This function allows setting a specific display mode (resolution and refresh rate) or a maximum resolution
 /// indicated by the "max-" prefix. It parses the mode string and delegates to the appropriate backend.
+/// A mode that is already set is not applied again.
 ///
 /// # Arguments
 /// * `screen` - An optional string specifying the screen to configure.
@@ -241,9 +361,9 @@ pub fn current_rotation(screen: Option<&str>) -> Result<String> {
 pub fn set_mode(screen: Option<&str>, mode: &str) -> Result<()> {
     let backend = ScreenService::default_backend()?;
 
-    if mode.starts_with("max-") {
-        let max_resolution = mode.trim_start_matches("max-");
-        backend.min_to_max_resolution(screen, Some(max_resolution))?;
+    if let Some(max_resolution) = mode.strip_prefix("max-") {
+        let limit = parse_max_resolution(Some(max_resolution))?;
+        ScreenService::apply_max_resolution(backend, screen, max_resolution, limit)
     } else {
         let mode_info = parse_mode(mode)?;
         let mode_params = ModeParams {
@@ -251,9 +371,8 @@ pub fn set_mode(screen: Option<&str>, mode: &str) -> Result<()> {
             height: mode_info.height as u32,
             refresh_rate: mode_info.vrefresh as u32,
         };
-        backend.set_mode(screen, &mode_params)?;
+        ScreenService::apply_mode(backend, screen, &mode_params)
     }
-    Ok(())
 }
 
 /// Sets the output resolution and refresh rate (e.g., "1920x1080@60").
@@ -275,8 +394,7 @@ pub fn set_output(output: &str) -> Result<()> {
     };
 
     // Apply to all connected outputs without specifying a screen
-    backend.set_mode(None, &mode_params)?;
-    Ok(())
+    ScreenService::apply_mode(backend, None, &mode_params)
 }
 
 /// Sets the screen rotation for the specified screen.
@@ -300,35 +418,93 @@ pub fn set_rotation(screen: Option<&str>, rotation: &str) -> Result<()> {
             rotation
         ))
     })?;
+    check_rotation(rotation_value)?;
 
-    if ![0, 90, 180, 270].contains(&rotation_value) {
+    use crate::screen::backend::RotationParams;
+    let rotation_params = RotationParams {
+        rotation: rotation_value,
+    };
+
+    let result = backend.set_rotation(screen, &rotation_params);
+    ScreenService::invalidate(backend);
+    result
+}
+
+/// Checks that a rotation is one of 0, 90, 180 or 270 degrees.
+pub fn check_rotation(rotation: u32) -> Result<()> {
+    if ![0, 90, 180, 270].contains(&rotation) {
         return Err(RegmsgError::InvalidArguments(
             "Rotation must be one of: 0, 90, 180, 270".to_string(),
         ));
     }
+    Ok(())
+}
 
-    use crate::screen::backend::RotationParams;
-    let rotation_params = RotationParams {
-        rotation: rotation_value,
+/// Applies a display profile to all its outputs at once.
+///
+/// The profile is validated against the current outputs first, and only the settings
+/// that differ are handed to the backend, which applies them in a single operation
+/// where it can (one sway command list, one atomic KMS commit).
+///
+/// # Arguments
+/// * `args` - A profile name, or inline output specs (see the `profile` module)
+///
+/// # Returns
+/// A `Result` with a summary of the applied changes, or an error if the profile is
+/// invalid for the connected outputs or the backend rejected it.
+pub fn apply_profile(args: &[&str]) -> Result<String> {
+    let profile = match args {
+        [name] if !name.contains(':') => profile::store().load(name)?,
+        _ => Arc::new(profile::DisplayProfile::from_args(args)?),
     };
 
-    backend.set_rotation(screen, &rotation_params)?;
-    Ok(())
+    let backend = ScreenService::default_backend()?;
+    let changes = profile.plan(&ScreenService::outputs(backend)?)?;
+    if changes.is_empty() {
+        return Ok("Profile already applied".to_string());
+    }
+
+    let result = backend.apply_profile(&changes);
+    ScreenService::invalidate(backend);
+    result?;
+
+    let outputs = changes
+        .outputs
+        .iter()
+        .map(|change| &*change.output)
+        .collect::<Vec<_>>();
+    info!("Display profile applied to: {:?}", outputs);
+    Ok(format!(
+        "Profile applied: {} outputs changed",
+        outputs.len()
+    ))
 }
 
 /// Takes a screenshot of the current screen.
 ///
-/// This function captures the current screen content and saves it. The implementation
-/// depends on the detected backend (Wayland or KMS/DRM).
+/// The frame is captured synchronously and handed to the background encoder, so this
+/// returns before the image is compressed. A `screenshotSaved` (or `screenshotFailed`)
+/// event reports when the file is complete.
+///
+/// # Arguments
+/// * `format` - Optional image format ("png", "qoi" or "ppm"), PNG by default
+/// * `quality` - Optional PNG compression level (0-9)
 ///
 /// # Returns
-/// A `Result` indicating success or an error message if the operation fails.
-pub fn get_screenshot() -> Result<()> {
+/// A `Result` with the path the screenshot is written to, or an error if the capture fails.
+pub fn get_screenshot(format: Option<&str>, quality: Option<&str>) -> Result<String> {
+    let options = EncodeOptions::parse(format, quality)?;
     let backend = ScreenService::default_backend()?;
 
-    let filepath = backend.take_screenshot(config::DEFAULT_SCREENSHOT_DIR)?;
-    info!("Screenshot saved to: {}", filepath);
-    Ok(())
+    // Ensure screenshot directory exists before replying with a path inside it
+    fs::create_dir_all(config::DEFAULT_SCREENSHOT_DIR)?;
+    let frame = backend.capture_frame()?;
+
+    let filepath =
+        screenshot::screenshot_path(config::DEFAULT_SCREENSHOT_DIR, options.format.extension());
+    screenshot::save_in_background(frame, options, PathBuf::from(&filepath))?;
+    info!("Screenshot captured, saving to: {}", filepath);
+    Ok(filepath)
 }
 
 /// Maps the touchscreen to the correct display.
@@ -357,8 +533,75 @@ pub fn map_touch_screen() -> Result<()> {
 pub fn min_to_max_resolution(screen: Option<&str>) -> Result<()> {
     let backend = ScreenService::default_backend()?;
     // Default maximum resolution
-    backend.min_to_max_resolution(screen, Some(config::DEFAULT_MAX_RESOLUTION))?;
-    Ok(())
+    let limit = parse_max_resolution(Some(config::DEFAULT_MAX_RESOLUTION))?;
+    ScreenService::apply_max_resolution(backend, screen, config::DEFAULT_MAX_RESOLUTION, limit)
+}
+
+/// Set once display events are wanted, so the first backend use starts the monitor
+static EVENTS_REQUESTED: AtomicBool = AtomicBool::new(false);
+
+/// Emits display change events for the active backend from now on.
+///
+/// Detecting the backend probes the display hardware, so the monitor is started on a
+/// background thread and the daemon keeps starting meanwhile; subscribers that never
+/// send a command still get every change. If detection fails, the next command tries
+/// again. The monitor thread re-reads the outputs after every invalidation of the
+/// backend's cache, i.e. after change notifications and the daemon's own setters, and
+/// emits the differences through `events::emit`.
+pub fn watch_display_events() {
+    EVENTS_REQUESTED.store(true, Ordering::Release);
+
+    let spawned = std::thread::Builder::new()
+        .name("display-detect".to_string())
+        .spawn(|| {
+            if let Err(e) = ScreenService::default_backend() {
+                warn!("Display events deferred to the first command: {}", e);
+            }
+        });
+    if let Err(e) = spawned {
+        warn!("Display events deferred to the first command: {}", e);
+    }
+}
+
+/// Filters cached outputs based on an optional screen name.
+fn matching_outputs<'a>(
+    outputs: &'a [DisplayOutput],
+    screen: Option<&'a str>,
+) -> impl Iterator<Item = &'a DisplayOutput> {
+    outputs
+        .iter()
+        .filter(move |output| screen.map_or(true, |screen_name| *output.name == *screen_name))
+}
+
+/// Returns whether an output is known to be in a state accepted by `check`
+///
+/// Both its current mode and the mode published for it must pass: on KMS/DRM the
+/// published preference can differ from the mode on the CRTC until the application
+/// owning the display picks it up, and an unknown preference never passes.
+///
+/// # Arguments
+/// * `current` - The current mode of the output
+/// * `published` - The published mode of the output, `None` if the backend publishes
+///   no preference
+/// * `check` - The state the setter would produce
+fn mode_settled(
+    current: Option<DisplayMode>,
+    published: Option<Option<DisplayMode>>,
+    check: impl Fn(&DisplayMode) -> bool,
+) -> bool {
+    current.is_some_and(|mode| check(&mode))
+        && published.is_none_or(|published| published.is_some_and(|mode| check(&mode)))
+}
+
+/// Returns the current mode of the first connected output matching the screen.
+fn active_mode<'a>(
+    outputs: &'a [DisplayOutput],
+    screen: Option<&'a str>,
+) -> Result<&'a DisplayMode> {
+    matching_outputs(outputs, screen)
+        .filter(|output| output.is_connected)
+        .find_map(|output| output.current_mode.as_ref())
+        .ok_or_else(|| RegmsgError::NotFound("Current mode".to_string()))
 }
 
 /// Retrieves the currently detected graphics backend.
@@ -373,36 +616,382 @@ pub fn current_backend() -> Result<String> {
     Ok(backend.backend_name().to_string())
 }
 
+/// Whether the sway socket exists, maintained by the socket watch
+static SWAY_PRESENT: AtomicBool = AtomicBool::new(false);
+
+/// Whether the socket watch runs, so that `SWAY_PRESENT` is current; cleared when the
+/// watch stops
+static SWAY_WATCHED: AtomicBool = AtomicBool::new(false);
+
+/// Orders the checks of the sway socket with the updates of `SWAY_PRESENT`
+static SWAY_STATE_LOCK: Mutex<()> = Mutex::new(());
+
+/// Backend installed with `use_backend`, replacing detection
+static BACKEND_OVERRIDE: OnceLock<&'static dyn DisplayBackend> = OnceLock::new();
+
+/// Serves every screen function from `backend` instead of the detected one.
+///
+/// Used to run the command layer against an in-memory backend, e.g. in benchmarks.
+///
+/// # Arguments
+/// * `backend` - The backend to use for the rest of the process
+///
+/// # Returns
+/// `false` if a backend was already installed
+#[cfg(test)]
+pub fn use_backend(backend: &'static dyn DisplayBackend) -> bool {
+    BACKEND_OVERRIDE.set(backend).is_ok()
+}
+
 impl ScreenService {
-    /// Gets a reference to the active backend (helper for current functions)
-    fn default_backend() -> Result<&'static dyn DisplayBackend> {
-        use std::path::Path;
-
-        // Direct check: if Wayland socket exists, use Wayland backend; otherwise use KMS/DRM
-        if Path::new(config::DEFAULT_SWAYSOCK_PATH).exists() {
-            // Set SWAYSOCK environment variable if it doesn't exist
-            if std::env::var("SWAYSOCK").is_err() {
-                unsafe {
-                    std::env::set_var("SWAYSOCK", config::DEFAULT_SWAYSOCK_PATH);
+    /// Starts the display event monitor for a backend, once per process
+    fn start_event_monitor(backend: &'static dyn DisplayBackend) {
+        static MONITOR: Once = Once::new();
+
+        MONITOR.call_once(|| {
+            let changes = Self::cache_for(backend).watch();
+            let initial = Self::outputs(backend).ok();
+
+            let spawned = std::thread::Builder::new()
+                .name("display-events".to_string())
+                .spawn(move || Self::run_event_monitor(backend, changes, initial));
+            match spawned {
+                Ok(_) => info!("Watching {} display changes", backend.backend_name()),
+                Err(e) => warn!("Display events disabled: {}", e),
+            }
+        });
+    }
+
+    /// Gets the display caches of every backend used so far, by backend name
+    fn caches() -> MutexGuard<'static, HashMap<&'static str, Arc<OutputCache>>> {
+        static CACHES: OnceLock<Mutex<HashMap<&'static str, Arc<OutputCache>>>> = OnceLock::new();
+
+        CACHES
+            .get_or_init(|| Mutex::new(HashMap::new()))
+            .lock()
+            .unwrap_or_else(|e| e.into_inner())
+    }
+
+    /// Gets the display cache of a backend, starting its change watcher on first use
+    fn cache_for(backend: &'static dyn DisplayBackend) -> Arc<OutputCache> {
+        let mut caches = Self::caches();
+        let cache = caches.entry(backend.backend_name()).or_insert_with(|| {
+            let cache = Arc::new(OutputCache::with_stats("outputs"));
+            if let Err(e) = backend.watch_changes(Arc::clone(&cache)) {
+                info!(
+                    "Display cache disabled for {} backend: {}",
+                    backend.backend_name(),
+                    e
+                );
+            }
+            cache
+        });
+        Arc::clone(cache)
+    }
+
+    /// Reads the outputs of a backend, served from memory when its cache is live
+    fn outputs(backend: &'static dyn DisplayBackend) -> Result<Arc<Vec<DisplayOutput>>> {
+        Self::cache_for(backend).outputs(|| backend.list_outputs())
+    }
+
+    /// Returns the cached outputs of a backend, or `None` when its cache is not live
+    /// and queries should go to the backend directly
+    fn cached_outputs(
+        backend: &'static dyn DisplayBackend,
+    ) -> Result<Option<Arc<Vec<DisplayOutput>>>> {
+        let cache = Self::cache_for(backend);
+        if !cache.is_live() {
+            return Ok(None);
+        }
+        cache.outputs(|| backend.list_outputs()).map(Some)
+    }
+
+    /// Invalidates the cached outputs of a backend after the daemon changed its state
+    fn invalidate(backend: &'static dyn DisplayBackend) {
+        Self::cache_for(backend).invalidate();
+    }
+
+    /// Gets the modes a backend publishes apart from the current ones, see
+    /// `DisplayBackend::published_modes`
+    ///
+    /// A preference that cannot be read counts as unknown, so no setter is skipped.
+    fn published_modes(
+        backend: &'static dyn DisplayBackend,
+    ) -> Option<HashMap<Arc<str>, DisplayMode>> {
+        backend.published_modes().unwrap_or_else(|e| {
+            debug!("Published modes unknown: {}", e);
+            Some(HashMap::new())
+        })
+    }
+
+    /// Sets a mode unless every targeted output already has it
+    ///
+    /// The targets are the connected outputs offering the mode, resolved like the
+    /// backends do; outputs without it are left to the backend to report.
+    fn apply_mode(
+        backend: &'static dyn DisplayBackend,
+        screen: Option<&str>,
+        params: &ModeParams,
+    ) -> Result<()> {
+        let targets: Vec<(Arc<str>, DisplayMode, Option<DisplayMode>)> =
+            match Self::outputs(backend) {
+                Ok(outputs) => matching_outputs(&outputs, screen)
+                    .filter(|output| output.is_connected)
+                    .filter_map(|output| {
+                        let index = ModeIndex::new(
+                            output
+                                .modes
+                                .iter()
+                                .map(|mode| (mode.width, mode.height, mode.refresh_mhz)),
+                        );
+                        let position =
+                            index.nearest(params.width, params.height, params.refresh_rate)?;
+                        Some((
+                            Arc::clone(&output.name),
+                            output.modes[position],
+                            output.current_mode,
+                        ))
+                    })
+                    .collect(),
+                Err(e) => {
+                    debug!("Applying mode without checking the current one: {}", e);
+                    Vec::new()
                 }
+            };
+
+        let unchanged = !targets.is_empty() && {
+            let published = Self::published_modes(backend);
+            targets.iter().all(|(name, target, current)| {
+                let published = published.as_ref().map(|modes| modes.get(name).copied());
+                mode_settled(*current, published, |mode| mode.same_timing(target))
+            })
+        };
+        if unchanged {
+            info!(
+                "Mode {}x{}@{} already set, nothing to apply",
+                params.width, params.height, params.refresh_rate
+            );
+            return Ok(());
+        }
+
+        let result = backend.set_mode(screen, params);
+        Self::invalidate(backend);
+        result
+    }
+
+    /// Limits the resolution unless every targeted output is already within the limit
+    fn apply_max_resolution(
+        backend: &'static dyn DisplayBackend,
+        screen: Option<&str>,
+        max_resolution: &str,
+        (max_width, max_height): (u32, u32),
+    ) -> Result<()> {
+        let max_area = max_width as u64 * max_height as u64;
+        let fits = |mode: &DisplayMode| mode.width as u64 * mode.height as u64 <= max_area;
+
+        if let Ok(outputs) = Self::outputs(backend) {
+            let mut targets = matching_outputs(&outputs, screen)
+                .filter(|output| output.is_connected)
+                .peekable();
+            let unchanged = targets.peek().is_some() && {
+                let published = Self::published_modes(backend);
+                targets.all(|output| {
+                    let published = published
+                        .as_ref()
+                        .map(|modes| modes.get(&output.name).copied());
+                    mode_settled(output.current_mode, published, fits)
+                })
+            };
+            if unchanged {
                 info!(
-                    "Set SWAYSOCK environment variable to: {}",
-                    config::DEFAULT_SWAYSOCK_PATH
+                    "Resolution already within {}x{}, nothing to apply",
+                    max_width, max_height
                 );
+                return Ok(());
+            }
+        }
+
+        let result = backend.min_to_max_resolution(screen, Some(max_resolution));
+        Self::invalidate(backend);
+        result
+    }
+
+    /// Emits the differences between successive output snapshots of the active backend
+    ///
+    /// A backend switch invalidates the caches, which wakes the monitor to follow the
+    /// new backend; its outputs are compared with the last ones of the previous backend.
+    fn run_event_monitor(
+        mut backend: &'static dyn DisplayBackend,
+        mut changes: Receiver<u64>,
+        mut last: Option<Arc<Vec<DisplayOutput>>>,
+    ) {
+        while changes.recv().is_ok() {
+            std::thread::sleep(EVENT_SETTLE_DELAY);
+            while changes.try_recv().is_ok() {}
+
+            if let Ok(active) = Self::detect_backend() {
+                if active.backend_name() != backend.backend_name() {
+                    backend = active;
+                    changes = Self::cache_for(backend).watch();
+                }
             }
 
-            // Return a static reference to a Wayland backend instance
-            static WAYLAND_BACKEND: std::sync::OnceLock<crate::screen::wayland::WaylandBackend> =
-                std::sync::OnceLock::new();
-            let backend =
-                WAYLAND_BACKEND.get_or_init(|| crate::screen::wayland::WaylandBackend::new());
-            Ok(backend)
+            match Self::outputs(backend) {
+                Ok(outputs) => {
+                    if let Some(previous) = &last {
+                        for event in events::diff_outputs(previous, &outputs) {
+                            events::emit(event);
+                        }
+                    }
+                    last = Some(outputs);
+                }
+                Err(e) => debug!("Failed to read outputs for display events: {}", e),
+            }
+        }
+    }
+
+    /// Gets the replay backend selected by the `REGMSGD_REPLAY` environment variable
+    ///
+    /// The recording is loaded once; when it cannot be loaded every call fails rather
+    /// than silently falling back to the hardware.
+    ///
+    /// # Returns
+    /// `None` when the variable is not set
+    fn replay_backend() -> Result<Option<&'static dyn DisplayBackend>> {
+        static REPLAY_BACKEND: OnceLock<
+            Option<std::result::Result<MeteredBackend<ReplayBackend>, String>>,
+        > = OnceLock::new();
+
+        let replay = REPLAY_BACKEND.get_or_init(|| {
+            let path = std::env::var_os(config::REPLAY_ENV)?;
+            Some(
+                ReplayBackend::load(Path::new(&path))
+                    .map(MeteredBackend)
+                    .map_err(|e| e.to_string()),
+            )
+        });
+        match replay {
+            None => Ok(None),
+            Some(Ok(backend)) => Ok(Some(backend)),
+            Some(Err(message)) => Err(RegmsgError::BackendError {
+                backend: "Replay".to_string(),
+                message: message.clone(),
+            }),
+        }
+    }
+
+    /// Gets a reference to the active backend (helper for current functions)
+    ///
+    /// The first call detects the backend and, if display events are wanted, starts
+    /// their monitor.
+    fn default_backend() -> Result<&'static dyn DisplayBackend> {
+        let backend = Self::detect_backend()?;
+        if EVENTS_REQUESTED.load(Ordering::Acquire) {
+            Self::start_event_monitor(backend);
+        }
+        Ok(backend)
+    }
+
+    /// Selects the backend: an installed override, a replay recording, Wayland while
+    /// the sway socket exists, and otherwise KMS/DRM
+    fn detect_backend() -> Result<&'static dyn DisplayBackend> {
+        if let Some(backend) = BACKEND_OVERRIDE.get() {
+            return Ok(*backend);
+        }
+        if let Some(backend) = Self::replay_backend()? {
+            return Ok(backend);
+        }
+
+        if Self::sway_running() {
+            Ok(Self::wayland_backend())
         } else {
-            // Return a static reference to a DRM backend instance
-            static DRM_BACKEND: std::sync::OnceLock<crate::screen::kmsdrm::DrmBackend> =
-                std::sync::OnceLock::new();
-            let backend = DRM_BACKEND.get_or_init(|| crate::screen::kmsdrm::DrmBackend::new());
-            Ok(backend)
+            Ok(Self::drm_backend())
+        }
+    }
+
+    /// Returns the static Wayland backend instance
+    fn wayland_backend() -> &'static dyn DisplayBackend {
+        static WAYLAND_BACKEND: OnceLock<MeteredBackend<wayland::WaylandBackend>> = OnceLock::new();
+        WAYLAND_BACKEND.get_or_init(|| MeteredBackend(wayland::WaylandBackend::new()))
+    }
+
+    /// Returns the static KMS/DRM backend instance
+    fn drm_backend() -> &'static dyn DisplayBackend {
+        static DRM_BACKEND: OnceLock<MeteredBackend<kmsdrm::DrmBackend>> = OnceLock::new();
+        DRM_BACKEND.get_or_init(|| MeteredBackend(kmsdrm::DrmBackend::new()))
+    }
+
+    /// Returns whether the sway socket exists
+    ///
+    /// The first call starts an inotify watch on the socket, after which the answer is
+    /// kept in memory and requests do not touch the filesystem. Without inotify, or once
+    /// the watch stopped, every call checks the socket.
+    fn sway_running() -> bool {
+        static WATCH: Once = Once::new();
+
+        WATCH.call_once(|| {
+            // Set before the watch starts, so that it stopping right away clears it
+            SWAY_WATCHED.store(true, Ordering::Release);
+            let watched = socket_watch::watch(wayland::sway_socket_path(), |notice| match notice {
+                WatchNotice::Changed => Self::sway_socket_changed(),
+                WatchNotice::Stopped => Self::sway_watch_stopped(),
+            });
+            if let Err(e) = watched {
+                SWAY_WATCHED.store(false, Ordering::Release);
+                warn!("Checking the sway socket on every request: {}", e);
+            }
+            // Checked after the watch is registered, so no change is missed
+            let _guard = SWAY_STATE_LOCK.lock().unwrap_or_else(|e| e.into_inner());
+            SWAY_PRESENT.store(wayland::sway_socket_path().exists(), Ordering::Release);
+        });
+
+        if SWAY_WATCHED.load(Ordering::Acquire) {
+            SWAY_PRESENT.load(Ordering::Acquire)
+        } else {
+            wayland::sway_socket_path().exists()
+        }
+    }
+
+    /// Falls back to checking the sway socket on every request after the watch stopped
+    ///
+    /// The socket is checked once more, so a change the watch missed still switches the
+    /// backend.
+    fn sway_watch_stopped() {
+        warn!("Sway socket watch stopped, checking the socket on every request");
+        SWAY_WATCHED.store(false, Ordering::Release);
+        Self::sway_socket_changed();
+    }
+
+    /// Switches the backend after the sway socket appeared or disappeared
+    ///
+    /// Every display cache is invalidated, which also wakes the event monitor, and a
+    /// `backendChanged` event is emitted.
+    fn sway_socket_changed() {
+        let present = {
+            let _guard = SWAY_STATE_LOCK.lock().unwrap_or_else(|e| e.into_inner());
+            let present = wayland::sway_socket_path().exists();
+            if SWAY_PRESENT.swap(present, Ordering::AcqRel) == present {
+                return;
+            }
+            present
+        };
+
+        let backend = if present {
+            Self::wayland_backend()
+        } else {
+            Self::drm_backend()
+        };
+        info!(
+            "Sway socket {}, switching to {} backend",
+            if present { "appeared" } else { "removed" },
+            backend.backend_name()
+        );
+
+        for cache in Self::caches().values() {
+            cache.invalidate();
         }
+        events::emit(events::DisplayEvent::BackendChanged {
+            backend: backend.backend_name().to_string(),
+        });
     }
 }
@@ -0,0 +1,162 @@
+//! Display Mode Index
+//!
+//! This module indexes the modes of one output so that mode selection does not rescan
+//! the whole mode list, recomputing areas, on every request. Backends build one index per
+//! output whenever they take a topology snapshot and use it for:
+//! - exact `WxH@R` lookups, through a hash map
+//! - nearest-refresh lookups, so that `1920x1080@59` selects the 59.94 Hz mode
+//! - the largest mode within a resolution limit, as used by `min_to_max_resolution`
+//!
+//! The index stores positions into the backend's own mode list, so DRM modes, sway modes
+//! and recorded modes are all served by the same code.
+
+use std::collections::HashMap;
+
+/// How far, in mHz, the rate found by `ModeIndex::nearest` may be from the request
+const REFRESH_TOLERANCE_MHZ: u32 = 1000;
+
+/// An indexed mode; entries sort by area, then size, then refresh rate
+#[derive(Debug, Clone, Copy)]
+struct Entry {
+    area: u64,
+    width: u32,
+    height: u32,
+    refresh_mhz: u32,
+    /// Position of the mode in the backend's list
+    position: usize,
+}
+
+impl Entry {
+    /// Sort key; of identical modes the one listed first sorts last, so that
+    /// `best_within`, scanning from the top, meets it first
+    fn key(&self) -> (u64, u32, u32, u32, std::cmp::Reverse<usize>) {
+        (
+            self.area,
+            self.width,
+            self.height,
+            self.refresh_mhz,
+            std::cmp::Reverse(self.position),
+        )
+    }
+}
+
+/// Sorted index of the modes of one output
+#[derive(Debug, Clone)]
+pub struct ModeIndex {
+    entries: Vec<Entry>,
+    exact: HashMap<(u32, u32, u32), usize>,
+}
+
+impl ModeIndex {
+    /// Indexes a list of modes
+    ///
+    /// # Arguments
+    /// * `modes` - The `(width, height, refresh in mHz)` of every mode, in the backend's order
+    pub fn new<I>(modes: I) -> Self
+    where
+        I: IntoIterator<Item = (u32, u32, u32)>,
+    {
+        let mut entries: Vec<Entry> = modes
+            .into_iter()
+            .enumerate()
+            .map(|(position, (width, height, refresh_mhz))| Entry {
+                area: width as u64 * height as u64,
+                width,
+                height,
+                refresh_mhz,
+                position,
+            })
+            .collect();
+
+        let mut exact = HashMap::with_capacity(entries.len());
+        for entry in &entries {
+            exact
+                .entry((entry.width, entry.height, entry.refresh_mhz))
+                .or_insert(entry.position);
+        }
+        entries.sort_unstable_by_key(Entry::key);
+
+        Self { entries, exact }
+    }
+
+    /// Looks up a mode with exactly the given size and refresh rate
+    ///
+    /// # Returns
+    /// The position of the first such mode in the backend's list
+    pub fn exact(&self, width: u32, height: u32, refresh_mhz: u32) -> Option<usize> {
+        self.exact.get(&(width, height, refresh_mhz)).copied()
+    }
+
+    /// Looks up the mode of the given size whose refresh rate is closest to `refresh_hz`
+    ///
+    /// Requests carry whole hertz, so an exact match is tried first and otherwise the
+    /// nearest rate less than 1 Hz away wins, e.g. 59.94 Hz for 59 Hz. Of two equally
+    /// close rates the higher one is chosen. Rates further away are never substituted,
+    /// so a 144 Hz request on a 60 Hz panel finds nothing.
+    ///
+    /// # Arguments
+    /// * `width` - Requested width in pixels
+    /// * `height` - Requested height in pixels
+    /// * `refresh_hz` - Requested refresh rate in Hz
+    ///
+    /// # Returns
+    /// The position of the mode in the backend's list, or `None` if no mode of this size
+    /// is within 1 Hz of the request
+    pub fn nearest(&self, width: u32, height: u32, refresh_hz: u32) -> Option<usize> {
+        let target = refresh_hz.saturating_mul(1000);
+        if let Some(position) = self.exact(width, height, target) {
+            return Some(position);
+        }
+
+        // Modes of one size are contiguous in the index, sorted by refresh rate
+        let area = width as u64 * height as u64;
+        let size = (area, width, height);
+        let start = self
+            .entries
+            .partition_point(|entry| (entry.area, entry.width, entry.height) < size);
+        let end = start
+            + self.entries[start..]
+                .partition_point(|entry| (entry.area, entry.width, entry.height) == size);
+        let same_size = &self.entries[start..end];
+
+        // The first rate at or above the target and the one below it are the candidates
+        let above = same_size.partition_point(|entry| entry.refresh_mhz < target);
+        let refresh_mhz = match (
+            above.checked_sub(1).map(|i| &same_size[i]),
+            same_size.get(above),
+        ) {
+            (Some(lower), Some(higher)) => {
+                if target - lower.refresh_mhz < higher.refresh_mhz - target {
+                    lower.refresh_mhz
+                } else {
+                    higher.refresh_mhz
+                }
+            }
+            (Some(entry), None) | (None, Some(entry)) => entry.refresh_mhz,
+            (None, None) => return None,
+        };
+        if refresh_mhz.abs_diff(target) >= REFRESH_TOLERANCE_MHZ {
+            return None;
+        }
+        // Of several modes with this rate, the hash map holds the one listed first
+        self.exact(width, height, refresh_mhz)
+    }
+
+    /// Looks up the largest mode fitting within `max_width`x`max_height`
+    ///
+    /// Of modes with the same size the higher refresh rate wins, then the mode listed
+    /// first. The scan starts at the largest mode not above the limit area and only
+    /// walks past modes that are too wide or too tall for the limit.
+    ///
+    /// # Returns
+    /// The position of the mode in the backend's list, or `None` if no mode fits
+    pub fn best_within(&self, max_width: u32, max_height: u32) -> Option<usize> {
+        let max_area = max_width as u64 * max_height as u64;
+        let end = self.entries.partition_point(|entry| entry.area <= max_area);
+        self.entries[..end]
+            .iter()
+            .rev()
+            .find(|entry| entry.width <= max_width && entry.height <= max_height)
+            .map(|entry| entry.position)
+    }
+}
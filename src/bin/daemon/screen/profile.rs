@@ -0,0 +1,312 @@
+//! Display Profiles
+//!
+//! A profile is a complete display layout: the mode, rotation and position of each
+//! output and the output the touchscreen is mapped to. It is applied by `applyProfile`
+//! in one backend operation instead of one setter per output and setting.
+//!
+//! Profiles are TOML files named `<name>.toml` in the profile directory, parsed once and
+//! kept in memory until the file changes:
+//!
+//! ```toml
+//! touchscreen = "DSI-1"
+//!
+//! [[output]]
+//! name = "DSI-1"
+//! mode = "1080x1920@60"
+//! rotation = 90
+//!
+//! [[output]]
+//! name = "HDMI-A-1"
+//! mode = "1920x1080"
+//! position = [1080, 0]
+//! ```
+//!
+//! The same layout can be given inline as `OUTPUT:MODE[:ROTATION[:X,Y]]` arguments,
+//! with `-` for a setting to leave alone, plus `touchscreen:OUTPUT`:
+//!
+//! ```text
+//! applyProfile DSI-1:1080x1920@60:90 HDMI-A-1:1920x1080:-:1080,0 touchscreen:DSI-1
+//! ```
+
+use crate::config;
+use crate::screen::backend::{DisplayOutput, OutputChange, ProfileChanges};
+use crate::screen::mode_index::ModeIndex;
+use crate::screen::{check_rotation, parse_mode};
+use crate::utils::error::{RegmsgError, Result};
+use serde::Deserialize;
+use std::collections::HashMap;
+use std::fs;
+use std::path::PathBuf;
+use std::sync::{Arc, Mutex, OnceLock};
+use std::time::SystemTime;
+
+use tracing::{debug, info};
+
+/// Inline argument naming the touchscreen output instead of an output
+const TOUCHSCREEN_KEY: &str = "touchscreen";
+
+/// Placeholder for a setting an inline output spec leaves alone
+const KEEP: &str = "-";
+
+/// Settings of one output within a profile; missing settings are left alone
+#[derive(Debug, Clone, PartialEq, Eq, Deserialize)]
+#[serde(deny_unknown_fields)]
+pub struct OutputProfile {
+    pub name: String,
+    /// Mode as `WxH@R` or `WxH`, matched like `setMode`
+    pub mode: Option<String>,
+    pub rotation: Option<u32>,
+    pub position: Option<(i32, i32)>,
+}
+
+/// A complete display layout, see the module documentation
+#[derive(Debug, Clone, Default, PartialEq, Eq, Deserialize)]
+#[serde(deny_unknown_fields)]
+pub struct DisplayProfile {
+    #[serde(default, rename = "output")]
+    pub outputs: Vec<OutputProfile>,
+    /// Output the touchscreen is mapped to
+    pub touchscreen: Option<String>,
+}
+
+/// Parses an optional inline field, `-` meaning none
+fn inline_field<T>(
+    field: Option<&str>,
+    parse: impl FnOnce(&str) -> Option<T>,
+) -> Result<Option<T>> {
+    match field {
+        None | Some(KEEP) => Ok(None),
+        Some(value) => parse(value).map(Some).ok_or_else(|| {
+            RegmsgError::InvalidArguments(format!("Invalid profile setting '{}'", value))
+        }),
+    }
+}
+
+impl DisplayProfile {
+    /// Parses and validates a profile file
+    ///
+    /// # Arguments
+    /// * `toml` - The profile, see the module documentation
+    ///
+    /// # Returns
+    /// A `Result` containing the profile, or a `ParseError` if it is invalid
+    pub fn parse(toml: &str) -> Result<Self> {
+        let profile: Self = toml::from_str(toml)
+            .map_err(|e| RegmsgError::ParseError(format!("Invalid display profile: {}", e)))?;
+        profile.validate()?;
+        Ok(profile)
+    }
+
+    /// Builds and validates a profile from inline arguments
+    ///
+    /// # Arguments
+    /// * `args` - `OUTPUT:MODE[:ROTATION[:X,Y]]` and `touchscreen:OUTPUT` specs
+    ///
+    /// # Returns
+    /// A `Result` containing the profile, or an `InvalidArguments` error
+    pub fn from_args(args: &[&str]) -> Result<Self> {
+        let mut profile = Self::default();
+        for arg in args {
+            let mut fields = arg.split(':');
+            let name = fields.next().unwrap_or_default();
+            if name == TOUCHSCREEN_KEY {
+                profile.touchscreen = inline_field(fields.next(), |s| Some(s.to_string()))?;
+                continue;
+            }
+
+            let mode = inline_field(fields.next(), |s| Some(s.to_string()))?;
+            let rotation = inline_field(fields.next(), |s| s.parse().ok())?;
+            let position = inline_field(fields.next(), |s| {
+                let (x, y) = s.split_once(',')?;
+                Some((x.parse().ok()?, y.parse().ok()?))
+            })?;
+            if fields.next().is_some() {
+                return Err(RegmsgError::InvalidArguments(format!(
+                    "Invalid output spec '{}'. Use OUTPUT:MODE[:ROTATION[:X,Y]]",
+                    arg
+                )));
+            }
+
+            profile.outputs.push(OutputProfile {
+                name: name.to_string(),
+                mode,
+                rotation,
+                position,
+            });
+        }
+        profile.validate()?;
+        Ok(profile)
+    }
+
+    /// Checks the settings that do not depend on the connected outputs
+    fn validate(&self) -> Result<()> {
+        if self.outputs.is_empty() && self.touchscreen.is_none() {
+            return Err(RegmsgError::InvalidArguments(
+                "Profile configures no output".to_string(),
+            ));
+        }
+        for (position, output) in self.outputs.iter().enumerate() {
+            if output.name.is_empty() {
+                return Err(RegmsgError::InvalidArguments(
+                    "Profile output without a name".to_string(),
+                ));
+            }
+            if self.outputs[..position]
+                .iter()
+                .any(|other| other.name == output.name)
+            {
+                return Err(RegmsgError::InvalidArguments(format!(
+                    "Output '{}' is configured twice",
+                    output.name
+                )));
+            }
+            if let Some(mode) = &output.mode {
+                parse_mode(mode)?;
+            }
+            if let Some(rotation) = output.rotation {
+                check_rotation(rotation)?;
+            }
+        }
+        Ok(())
+    }
+
+    /// Resolves the profile against the current outputs
+    ///
+    /// Every output is checked before anything is applied, and settings that already
+    /// match are dropped, so an applied profile yields no changes.
+    ///
+    /// # Arguments
+    /// * `outputs` - The outputs reported by the backend
+    ///
+    /// # Returns
+    /// A `Result` containing the changes, or an error if an output or mode does not exist
+    pub fn plan(&self, outputs: &[DisplayOutput]) -> Result<ProfileChanges> {
+        let connected = |name: &str| {
+            outputs
+                .iter()
+                .find(|output| output.is_connected && *output.name == *name)
+                .ok_or_else(|| RegmsgError::NotFound(format!("Screen '{}' not found", name)))
+        };
+
+        let mut changes = ProfileChanges::default();
+        for target in &self.outputs {
+            let output = connected(&target.name)?;
+
+            let mode = match &target.mode {
+                Some(mode) => {
+                    let info = parse_mode(mode)?;
+                    let found = ModeIndex::new(
+                        output
+                            .modes
+                            .iter()
+                            .map(|mode| (mode.width, mode.height, mode.refresh_mhz)),
+                    )
+                    .nearest(info.width as u32, info.height as u32, info.vrefresh as u32)
+                    .map(|position| output.modes[position])
+                    .ok_or_else(|| {
+                        RegmsgError::NotFound(format!(
+                            "Mode {} not available for output '{}'",
+                            mode, target.name
+                        ))
+                    })?;
+                    Some(found).filter(|found| {
+                        !output
+                            .current_mode
+                            .is_some_and(|current| current.same_timing(found))
+                    })
+                }
+                None => None,
+            };
+            let rotation = target
+                .rotation
+                .filter(|&rotation| output.rotation != rotation);
+            let position = target
+                .position
+                .filter(|&position| output.position != Some(position));
+
+            if mode.is_some() || rotation.is_some() || position.is_some() {
+                changes.outputs.push(OutputChange {
+                    output: Arc::clone(&output.name),
+                    mode,
+                    rotation,
+                    position,
+                });
+            } else {
+                debug!("Output '{}' already matches the profile", target.name);
+            }
+        }
+
+        // The touchscreen mapping cannot be queried, so it is always applied
+        if let Some(name) = &self.touchscreen {
+            changes.touchscreen = Some(Arc::clone(&connected(name)?.name));
+        }
+        Ok(changes)
+    }
+}
+
+/// Parsed profiles of the profile directory, reloaded when their file changes
+pub struct ProfileStore {
+    dir: PathBuf,
+    profiles: Mutex<HashMap<String, (Option<SystemTime>, Arc<DisplayProfile>)>>,
+}
+
+impl ProfileStore {
+    /// Creates a store reading profiles from `dir`
+    pub fn new(dir: impl Into<PathBuf>) -> Self {
+        Self {
+            dir: dir.into(),
+            profiles: Mutex::new(HashMap::new()),
+        }
+    }
+
+    /// Loads a profile by name, parsing its file only when it changed since last time
+    ///
+    /// # Arguments
+    /// * `name` - The profile name, i.e. the file name without `.toml`
+    ///
+    /// # Returns
+    /// A `Result` containing the profile, or an error if it does not exist or is invalid
+    pub fn load(&self, name: &str) -> Result<Arc<DisplayProfile>> {
+        let valid = !name.is_empty()
+            && !name.starts_with('.')
+            && name
+                .chars()
+                .all(|c| c.is_ascii_alphanumeric() || matches!(c, '-' | '_' | '.'));
+        if !valid {
+            return Err(RegmsgError::InvalidArguments(format!(
+                "Invalid profile name '{}'",
+                name
+            )));
+        }
+
+        let path = self.dir.join(format!("{}.toml", name));
+        let modified = match fs::metadata(&path) {
+            Ok(metadata) => metadata.modified().ok(),
+            Err(e) if e.kind() == std::io::ErrorKind::NotFound => {
+                return Err(RegmsgError::NotFound(format!(
+                    "Profile '{}' not found",
+                    name
+                )));
+            }
+            Err(e) => return Err(e.into()),
+        };
+
+        let mut profiles = self.profiles.lock().unwrap_or_else(|e| e.into_inner());
+        if let Some((cached, profile)) = profiles.get(name) {
+            if modified.is_some() && *cached == modified {
+                return Ok(Arc::clone(profile));
+            }
+        }
+
+        let profile = Arc::new(DisplayProfile::parse(&fs::read_to_string(&path)?)?);
+        info!("Loaded display profile '{}' from {}", name, path.display());
+        profiles.insert(name.to_string(), (modified, Arc::clone(&profile)));
+        Ok(profile)
+    }
+}
+
+/// Returns the store of the daemon's profile directory
+pub fn store() -> &'static ProfileStore {
+    static STORE: OnceLock<ProfileStore> = OnceLock::new();
+    STORE.get_or_init(|| ProfileStore::new(config::DEFAULT_PROFILE_DIR))
+}
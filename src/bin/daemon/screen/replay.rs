@@ -0,0 +1,344 @@
+//! Replay Display Backend
+//!
+//! This module serves the display state from a recording instead of the hardware, so the
+//! full daemon can be load-tested and profiled on machines without a GPU or a sway
+//! session. A recording is the output of `regmsg --format json listOutputs` taken on the
+//! target device, either as-is or wrapped together with per-call latencies:
+//!
+//! ```json
+//! { "outputs": [...], "latency_us": { "default": 1500, "set_mode": 50000 } }
+//! ```
+//!
+//! Every call sleeps for the latency recorded for its `DisplayBackend` method, falling
+//! back to the `default` entry and then to values typical of sway IPC on the supported
+//! boards. Setters update the in-memory state, so later queries and display events see
+//! their effect as they would on real hardware.
+
+use crate::screen::backend::{
+    DisplayBackend, DisplayMode, DisplayOutput, ModeParams, ProfileChanges, RotationParams,
+    parse_max_resolution,
+};
+use crate::screen::cache::OutputCache;
+use crate::screen::mode_index::ModeIndex;
+use crate::screen::screenshot::Frame;
+use crate::utils::error::{RegmsgError, Result};
+use serde::Deserialize;
+use std::collections::HashMap;
+use std::fs;
+use std::path::Path;
+use std::sync::{Arc, Mutex, MutexGuard};
+use std::time::Duration;
+
+use tracing::{debug, info};
+
+/// Name of the latency entry used for methods without their own
+const DEFAULT_LATENCY_KEY: &str = "default";
+
+/// A recording, as written by `listOutputs` or with latencies attached
+#[derive(Deserialize)]
+#[serde(untagged)]
+enum Recording {
+    Outputs(Vec<DisplayOutput>),
+    Session {
+        outputs: Vec<DisplayOutput>,
+        #[serde(default)]
+        latency_us: HashMap<String, u64>,
+    },
+}
+
+/// Display backend replaying a recorded display state
+pub struct ReplayBackend {
+    outputs: Mutex<Vec<DisplayOutput>>,
+    latency_us: HashMap<String, u64>,
+}
+
+/// Returns the built-in latency of a backend method in microseconds
+///
+/// Queries cost one `get_outputs` round trip, setters a mode set including the
+/// compositor's reconfiguration.
+fn builtin_latency_us(method: &str) -> u64 {
+    match method {
+        "set_mode" | "set_rotation" | "min_to_max_resolution" | "apply_profile" => 50_000,
+        "capture_frame" => 30_000,
+        "map_touchscreen" => 5_000,
+        _ => 1_500,
+    }
+}
+
+/// Indexes the modes of a recorded output
+///
+/// Only the setters select modes, so the index is built when they need it.
+fn mode_index(output: &DisplayOutput) -> ModeIndex {
+    ModeIndex::new(
+        output
+            .modes
+            .iter()
+            .map(|mode| (mode.width, mode.height, mode.refresh_mhz)),
+    )
+}
+
+impl ReplayBackend {
+    /// Creates a backend replaying the given outputs
+    ///
+    /// # Arguments
+    /// * `outputs` - The recorded outputs
+    /// * `latency_us` - Latencies by method name, see the module documentation
+    pub fn new(outputs: Vec<DisplayOutput>, latency_us: HashMap<String, u64>) -> Self {
+        Self {
+            outputs: Mutex::new(outputs),
+            latency_us,
+        }
+    }
+
+    /// Parses a recording
+    ///
+    /// # Arguments
+    /// * `json` - The recording, see the module documentation
+    ///
+    /// # Returns
+    /// A `Result` containing the backend, or a `ParseError` if the recording is invalid
+    pub fn parse(json: &str) -> Result<Self> {
+        let recording = serde_json::from_str(json)
+            .map_err(|e| RegmsgError::ParseError(format!("Invalid display recording: {}", e)))?;
+        Ok(match recording {
+            Recording::Outputs(outputs) => Self::new(outputs, HashMap::new()),
+            Recording::Session {
+                outputs,
+                latency_us,
+            } => Self::new(outputs, latency_us),
+        })
+    }
+
+    /// Loads a recording from a file
+    ///
+    /// # Arguments
+    /// * `path` - The recording file
+    ///
+    /// # Returns
+    /// A `Result` containing the backend, or an error if the file cannot be read or parsed
+    pub fn load(path: &Path) -> Result<Self> {
+        let backend = Self::parse(&fs::read_to_string(path)?)?;
+        info!(
+            "Replaying {} recorded outputs from {}",
+            backend.state().len(),
+            path.display()
+        );
+        Ok(backend)
+    }
+
+    /// Returns the simulated latency of a backend method
+    fn latency(&self, method: &str) -> Duration {
+        let us = self
+            .latency_us
+            .get(method)
+            .or_else(|| self.latency_us.get(DEFAULT_LATENCY_KEY))
+            .copied()
+            .unwrap_or_else(|| builtin_latency_us(method));
+        Duration::from_micros(us)
+    }
+
+    /// Waits for the latency of `method`, outside the state lock so that concurrent
+    /// calls overlap like requests to a real compositor
+    fn simulate(&self, method: &str) {
+        let latency = self.latency(method);
+        if !latency.is_zero() {
+            std::thread::sleep(latency);
+        }
+    }
+
+    fn state(&self) -> MutexGuard<'_, Vec<DisplayOutput>> {
+        self.outputs.lock().unwrap_or_else(|e| e.into_inner())
+    }
+
+    /// Returns the connected outputs matching the screen, or an error if a named screen
+    /// does not exist
+    fn targets<'a>(
+        outputs: &'a mut [DisplayOutput],
+        screen: Option<&str>,
+    ) -> Result<Vec<&'a mut DisplayOutput>> {
+        let targets: Vec<_> = outputs
+            .iter_mut()
+            .filter(|output| output.is_connected)
+            .filter(|output| screen.is_none_or(|name| *output.name == *name))
+            .collect();
+        match screen {
+            Some(name) if targets.is_empty() => Err(RegmsgError::NotFound(format!(
+                "Screen '{}' not found",
+                name
+            ))),
+            _ => Ok(targets),
+        }
+    }
+
+    /// Returns the current mode of the first connected output matching the screen
+    fn active_mode(&self, screen: Option<&str>) -> Result<DisplayMode> {
+        let mut outputs = self.state();
+        Self::targets(&mut outputs, screen)?
+            .into_iter()
+            .find_map(|output| output.current_mode)
+            .ok_or_else(|| RegmsgError::NotFound("Current mode".to_string()))
+    }
+}
+
+impl DisplayBackend for ReplayBackend {
+    fn list_outputs(&self) -> Result<Vec<DisplayOutput>> {
+        self.simulate("list_outputs");
+        Ok(self.state().clone())
+    }
+
+    fn list_modes(&self, screen: Option<&str>) -> Result<Vec<DisplayMode>> {
+        self.simulate("list_modes");
+        let mut outputs = self.state();
+        Ok(Self::targets(&mut outputs, screen)?
+            .into_iter()
+            .flat_map(|output| output.modes.iter().copied())
+            .collect())
+    }
+
+    fn current_mode(&self, screen: Option<&str>) -> Result<DisplayMode> {
+        self.simulate("current_mode");
+        self.active_mode(screen)
+    }
+
+    fn current_resolution(&self, screen: Option<&str>) -> Result<(u32, u32)> {
+        self.simulate("current_resolution");
+        self.active_mode(screen)
+            .map(|mode| (mode.width, mode.height))
+    }
+
+    fn current_refresh_rate(&self, screen: Option<&str>) -> Result<u32> {
+        self.simulate("current_refresh_rate");
+        self.active_mode(screen).map(|mode| mode.refresh_rate())
+    }
+
+    fn current_rotation(&self, screen: Option<&str>) -> Result<u32> {
+        self.simulate("current_rotation");
+        let mut outputs = self.state();
+        Ok(Self::targets(&mut outputs, screen)?
+            .first()
+            .map_or(0, |output| output.rotation))
+    }
+
+    fn set_mode(&self, screen: Option<&str>, mode: &ModeParams) -> Result<()> {
+        self.simulate("set_mode");
+        let mut outputs = self.state();
+        let mut applied = 0;
+        for output in Self::targets(&mut outputs, screen)? {
+            // Like the real backends, snap to a refresh rate of the size within 1 Hz
+            let found = mode_index(output)
+                .nearest(mode.width, mode.height, mode.refresh_rate)
+                .map(|position| output.modes[position]);
+            match found {
+                Some(found) => {
+                    debug!("Replay: {} set to {}", output.name, found);
+                    output.current_mode = Some(found);
+                    applied += 1;
+                }
+                None => debug!(
+                    "Replay: mode {}x{}@{} not available for {}",
+                    mode.width, mode.height, mode.refresh_rate, output.name
+                ),
+            }
+        }
+
+        if applied == 0 {
+            return Err(RegmsgError::NotFound(format!(
+                "Mode {}x{}@{} not available",
+                mode.width, mode.height, mode.refresh_rate
+            )));
+        }
+        Ok(())
+    }
+
+    fn set_rotation(&self, screen: Option<&str>, rotation: &RotationParams) -> Result<()> {
+        self.simulate("set_rotation");
+        let mut outputs = self.state();
+        for output in Self::targets(&mut outputs, screen)? {
+            output.rotation = rotation.rotation;
+        }
+        Ok(())
+    }
+
+    fn min_to_max_resolution(
+        &self,
+        screen: Option<&str>,
+        max_resolution: Option<&str>,
+    ) -> Result<()> {
+        let (max_width, max_height) = parse_max_resolution(max_resolution)?;
+        self.simulate("min_to_max_resolution");
+
+        let mut outputs = self.state();
+        for output in Self::targets(&mut outputs, screen)? {
+            // Like the real backends, only outputs above the maximum area are changed
+            let fits = output.current_mode.as_ref().is_some_and(|mode| {
+                mode.width as u64 * mode.height as u64 <= max_width as u64 * max_height as u64
+            });
+            if fits {
+                continue;
+            }
+            if let Some(position) = mode_index(output).best_within(max_width, max_height) {
+                output.current_mode = Some(output.modes[position]);
+            }
+        }
+        Ok(())
+    }
+
+    fn capture_frame(&self) -> Result<Frame> {
+        let (width, height) = self
+            .active_mode(None)
+            .map(|mode| (mode.width, mode.height))?;
+        self.simulate("capture_frame");
+        Ok(Frame {
+            width,
+            height,
+            pixels: vec![0x40; width as usize * height as usize * 3],
+        })
+    }
+
+    fn map_touchscreen(&self) -> Result<()> {
+        self.simulate("map_touchscreen");
+        Ok(())
+    }
+
+    fn apply_profile(&self, changes: &ProfileChanges) -> Result<()> {
+        self.simulate("apply_profile");
+        let mut outputs = self.state();
+
+        // Like an atomic commit, every output is checked before any is changed
+        let mut targets = Vec::with_capacity(changes.outputs.len());
+        for change in &changes.outputs {
+            let position = outputs
+                .iter()
+                .position(|output| output.is_connected && output.name == change.output)
+                .ok_or_else(|| {
+                    RegmsgError::NotFound(format!("Screen '{}' not found", change.output))
+                })?;
+            targets.push((position, change));
+        }
+
+        for (position, change) in targets {
+            let output = &mut outputs[position];
+            if let Some(mode) = change.mode {
+                output.current_mode = Some(mode);
+            }
+            if let Some(rotation) = change.rotation {
+                output.rotation = rotation;
+            }
+            if change.position.is_some() {
+                output.position = change.position;
+            }
+            debug!("Replay: {} set from profile", output.name);
+        }
+        Ok(())
+    }
+
+    fn backend_name(&self) -> &'static str {
+        "Replay"
+    }
+
+    fn watch_changes(&self, cache: Arc<OutputCache>) -> Result<()> {
+        // The state only changes through the setters, which invalidate the cache
+        cache.set_live(true);
+        Ok(())
+    }
+}
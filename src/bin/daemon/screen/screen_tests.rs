@@ -4,8 +4,11 @@
 use crate::screen::backend::{
     DisplayBackend, DisplayMode, DisplayOutput, ModeParams, RotationParams,
 };
+use crate::screen::cache::OutputCache;
 use crate::screen::kmsdrm::DrmBackend;
 use crate::screen::parse_mode;
+use crate::screen::screenshot::Frame;
+use crate::screen::uevent::parse_uevent;
 use crate::screen::wayland::WaylandBackend;
 use crate::utils::error::RegmsgError;
 
@@ -13,19 +16,32 @@ use crate::utils::error::RegmsgError;
 #[test]
 fn test_display_mode_serialization() {
     let mode = DisplayMode {
-        width: 1920,
-        height: 1080,
-        refresh_rate: 60,
-        name: "1920x1080@60".to_string(),
+        preferred: true,
+        ..DisplayMode::new(1920, 1080, 59_940)
     };
 
     let serialized = serde_json::to_string(&mode).unwrap();
     let deserialized: DisplayMode = serde_json::from_str(&serialized).unwrap();
+    assert_eq!(mode, deserialized);
+
+    // The JSON keeps the rounded rate and the name clients already parse
+    let value: serde_json::Value = serde_json::from_str(&serialized).unwrap();
+    assert_eq!(value["refresh_rate"], 60);
+    assert_eq!(value["refresh_mhz"], 59_940);
+    assert_eq!(value["name"], "1920x1080@60Hz");
+    assert_eq!(value["preferred"], true);
+    assert!(value.get("interlaced").is_none());
+}
 
-    assert_eq!(mode.width, deserialized.width);
-    assert_eq!(mode.height, deserialized.height);
-    assert_eq!(mode.refresh_rate, deserialized.refresh_rate);
-    assert_eq!(mode.name, deserialized.name);
+// Recordings without refresh_mhz fall back to the rounded rate
+#[test]
+fn test_display_mode_deserialize_legacy() {
+    let mode: DisplayMode = serde_json::from_str(
+        r#"{ "width": 1280, "height": 720, "refresh_rate": 50, "name": "1280x720" }"#,
+    )
+    .unwrap();
+    assert_eq!(mode, DisplayMode::new(1280, 720, 50_000));
+    assert_eq!(mode.to_string(), "1280x720@50Hz");
 }
 
 // Test for DrmBackend (if possible to instantiate)
@@ -93,7 +109,7 @@ impl DisplayBackend for MockDrmBackend {
 
     fn current_refresh_rate(&self, _screen: Option<&str>) -> Result<u32, RegmsgError> {
         match self.current_mode(None) {
-            Ok(mode) => Ok(mode.refresh_rate),
+            Ok(mode) => Ok(mode.refresh_rate()),
             Err(e) => Err(e),
         }
     }
@@ -125,8 +141,12 @@ impl DisplayBackend for MockDrmBackend {
         Ok(())
     }
 
-    fn take_screenshot(&self, _screenshot_dir: &str) -> Result<String, RegmsgError> {
-        Ok("/tmp/mock_screenshot.png".to_string())
+    fn capture_frame(&self) -> Result<Frame, RegmsgError> {
+        Ok(Frame {
+            width: 1,
+            height: 1,
+            pixels: vec![0, 0, 0],
+        })
     }
 
     fn map_touchscreen(&self) -> Result<(), RegmsgError> {
@@ -187,7 +207,7 @@ impl DisplayBackend for MockWaylandBackend {
 
     fn current_refresh_rate(&self, _screen: Option<&str>) -> Result<u32, RegmsgError> {
         match self.current_mode(None) {
-            Ok(mode) => Ok(mode.refresh_rate),
+            Ok(mode) => Ok(mode.refresh_rate()),
             Err(e) => Err(e),
         }
     }
@@ -219,8 +239,12 @@ impl DisplayBackend for MockWaylandBackend {
         Ok(())
     }
 
-    fn take_screenshot(&self, _screenshot_dir: &str) -> Result<String, RegmsgError> {
-        Ok("/tmp/mock_screenshot.png".to_string())
+    fn capture_frame(&self) -> Result<Frame, RegmsgError> {
+        Ok(Frame {
+            width: 1,
+            height: 1,
+            pixels: vec![0, 0, 0],
+        })
     }
 
     fn map_touchscreen(&self) -> Result<(), RegmsgError> {
@@ -453,3 +477,1055 @@ mod parse_mode_tests {
         assert_eq!(mode_info.vrefresh, 144);
     }
 }
+
+// Tests for kernel uevent parsing used by the DRM backend
+#[cfg(test)]
+mod uevent_tests {
+    use super::*;
+
+    #[test]
+    fn test_parse_card_add_event() {
+        let msg = b"add@/devices/pci0000:00/0000:00:02.0/drm/card1\0ACTION=add\0DEVPATH=/devices/pci0000:00/0000:00:02.0/drm/card1\0SUBSYSTEM=drm\0DEVNAME=dri/card1\0";
+        let event = parse_uevent(msg).unwrap();
+        assert_eq!(event.action, "add");
+        assert_eq!(event.devname.as_deref(), Some("dri/card1"));
+        assert!(!event.hotplug);
+        assert!(event.is_device_change());
+    }
+
+    #[test]
+    fn test_parse_hotplug_event() {
+        let msg = b"change@/devices/platform/gpu/drm/card0\0ACTION=change\0SUBSYSTEM=drm\0DEVNAME=dri/card0\0HOTPLUG=1\0";
+        let event = parse_uevent(msg).unwrap();
+        assert_eq!(event.action, "change");
+        assert!(event.hotplug);
+        assert!(!event.is_device_change());
+    }
+
+    #[test]
+    fn test_render_node_is_not_device_change() {
+        let msg = b"add@/devices/platform/gpu/drm/renderD128\0ACTION=add\0SUBSYSTEM=drm\0DEVNAME=dri/renderD128\0";
+        let event = parse_uevent(msg).unwrap();
+        assert!(!event.is_device_change());
+    }
+
+    #[test]
+    fn test_parse_ignores_other_subsystems() {
+        let msg = b"add@/devices/virtual/input/input9\0ACTION=add\0SUBSYSTEM=input\0";
+        assert!(parse_uevent(msg).is_none());
+    }
+
+    #[test]
+    fn test_parse_ignores_udev_header() {
+        let msg = b"libudev\0\xfe\xed\xca\xfe";
+        assert!(parse_uevent(msg).is_none());
+    }
+}
+
+// Tests for the inotify watch on the compositor socket
+#[cfg(test)]
+mod socket_watch_tests {
+    use crate::screen::socket_watch::{WatchNotice, parse_events, watch};
+    use std::sync::mpsc;
+    use std::time::Duration;
+
+    /// Encodes one inotify event record with a NUL-padded name
+    fn record(mask: u32, name: &[u8]) -> Vec<u8> {
+        let len = (name.len() + 1).next_multiple_of(16);
+        let mut buf = Vec::new();
+        buf.extend_from_slice(&1i32.to_ne_bytes());
+        buf.extend_from_slice(&mask.to_ne_bytes());
+        buf.extend_from_slice(&0u32.to_ne_bytes());
+        buf.extend_from_slice(&(len as u32).to_ne_bytes());
+        buf.extend_from_slice(name);
+        buf.resize(buf.len() + len - name.len(), 0);
+        buf
+    }
+
+    #[test]
+    fn test_parse_events_matches_name() {
+        let mut buf = record(libc::IN_CREATE, b"other.sock");
+        assert_eq!(parse_events(&buf, b"sway-ipc.0.sock"), None);
+
+        buf.extend(record(libc::IN_DELETE, b"sway-ipc.0.sock"));
+        assert_eq!(
+            parse_events(&buf, b"sway-ipc.0.sock"),
+            Some(WatchNotice::Changed)
+        );
+
+        // A name sharing the prefix is another file
+        assert_eq!(
+            parse_events(
+                &record(libc::IN_CREATE, b"sway-ipc.0.sock.lock"),
+                b"sway-ipc.0.sock"
+            ),
+            None
+        );
+    }
+
+    #[test]
+    fn test_parse_events_overflow() {
+        assert_eq!(
+            parse_events(&record(libc::IN_Q_OVERFLOW, b""), b"sway-ipc.0.sock"),
+            Some(WatchNotice::Changed)
+        );
+    }
+
+    #[test]
+    fn test_parse_events_watch_removed() {
+        let mut buf = record(libc::IN_DELETE, b"sway-ipc.0.sock");
+        buf.extend(record(libc::IN_IGNORED, b""));
+        assert_eq!(
+            parse_events(&buf, b"sway-ipc.0.sock"),
+            Some(WatchNotice::Stopped)
+        );
+    }
+
+    #[test]
+    fn test_watch_reports_create_and_remove() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("sway-ipc.0.sock");
+        let (tx, rx) = mpsc::channel();
+        watch(&path, move |notice| {
+            let _ = tx.send(notice);
+        })
+        .unwrap();
+
+        let timeout = Duration::from_secs(5);
+        std::fs::write(dir.path().join("unrelated"), b"").unwrap();
+        std::fs::write(&path, b"").unwrap();
+        assert_eq!(rx.recv_timeout(timeout), Ok(WatchNotice::Changed));
+        std::fs::remove_file(&path).unwrap();
+        assert_eq!(rx.recv_timeout(timeout), Ok(WatchNotice::Changed));
+
+        // Removing the directory ends the watch
+        dir.close().unwrap();
+        assert_eq!(rx.recv_timeout(timeout), Ok(WatchNotice::Stopped));
+    }
+}
+
+// Tests for the generation-counted display cache
+#[cfg(test)]
+mod cache_tests {
+    use super::*;
+    use std::cell::Cell;
+
+    fn sample_outputs() -> Vec<DisplayOutput> {
+        vec![DisplayOutput {
+            name: "HDMI-A-1".into(),
+            modes: vec![],
+            current_mode: None,
+            is_connected: true,
+            rotation: 0,
+            position: None,
+        }]
+    }
+
+    #[test]
+    fn test_cache_passthrough_when_not_live() {
+        let cache = OutputCache::new();
+        let fetches = Cell::new(0);
+
+        for _ in 0..3 {
+            let outputs = cache
+                .outputs(|| {
+                    fetches.set(fetches.get() + 1);
+                    Ok(sample_outputs())
+                })
+                .unwrap();
+            assert_eq!(outputs.len(), 1);
+        }
+        assert_eq!(fetches.get(), 3);
+    }
+
+    #[test]
+    fn test_cache_serves_snapshot_when_live() {
+        let cache = OutputCache::new();
+        cache.set_live(true);
+        let fetches = Cell::new(0);
+
+        for _ in 0..3 {
+            cache
+                .outputs(|| {
+                    fetches.set(fetches.get() + 1);
+                    Ok(sample_outputs())
+                })
+                .unwrap();
+        }
+        assert_eq!(fetches.get(), 1);
+    }
+
+    #[test]
+    fn test_cache_refetches_after_invalidate() {
+        let cache = OutputCache::new();
+        cache.set_live(true);
+        let fetches = Cell::new(0);
+        let fetch = || {
+            fetches.set(fetches.get() + 1);
+            Ok(sample_outputs())
+        };
+
+        cache.outputs(fetch).unwrap();
+        let generation = cache.generation();
+        cache.invalidate();
+        assert_eq!(cache.generation(), generation + 1);
+
+        cache.outputs(fetch).unwrap();
+        cache.outputs(fetch).unwrap();
+        assert_eq!(fetches.get(), 2);
+    }
+
+    #[test]
+    fn test_cache_does_not_store_errors() {
+        let cache = OutputCache::new();
+        cache.set_live(true);
+
+        let result = cache.outputs(|| Err(RegmsgError::NotFound("outputs".to_string())));
+        assert!(result.is_err());
+
+        let outputs = cache.outputs(|| Ok(sample_outputs())).unwrap();
+        assert_eq!(&*outputs[0].name, "HDMI-A-1");
+    }
+
+    #[test]
+    fn test_cache_native_snapshot_type() {
+        // Backends keep their own output representation behind the same cache
+        let cache: OutputCache<Vec<&str>> = OutputCache::new();
+        cache.set_live(true);
+        let fetches = Cell::new(0);
+        let fetch = || {
+            fetches.set(fetches.get() + 1);
+            Ok(vec!["eDP-1", "HDMI-A-1"])
+        };
+
+        assert_eq!(cache.outputs(fetch).unwrap().len(), 2);
+        assert_eq!(cache.outputs(fetch).unwrap()[1], "HDMI-A-1");
+        assert_eq!(fetches.get(), 1);
+
+        cache.invalidate();
+        cache.outputs(fetch).unwrap();
+        assert_eq!(fetches.get(), 2);
+    }
+
+    #[test]
+    fn test_cache_watchers_receive_generations() {
+        let cache: OutputCache = OutputCache::new();
+        let changes = cache.watch();
+
+        cache.invalidate();
+        cache.set_live(true);
+        assert_eq!(changes.try_recv(), Ok(1));
+        assert_eq!(changes.try_recv(), Ok(2));
+        assert!(changes.try_recv().is_err());
+
+        // Dropped watchers are forgotten on the next invalidation
+        drop(changes);
+        cache.invalidate();
+        assert_eq!(cache.generation(), 3);
+    }
+}
+
+// Tests for the display change events
+#[cfg(test)]
+mod events_tests {
+    use super::*;
+    use crate::screen::events::{DisplayEvent, diff_outputs};
+
+    fn output(
+        name: &str,
+        connected: bool,
+        mode: Option<(u32, u32, u32)>,
+        rotation: u32,
+    ) -> DisplayOutput {
+        DisplayOutput {
+            name: name.into(),
+            modes: vec![],
+            current_mode: mode.map(|(width, height, refresh_rate)| {
+                DisplayMode::new(width, height, refresh_rate * 1000)
+            }),
+            is_connected: connected,
+            rotation,
+            position: None,
+        }
+    }
+
+    #[test]
+    fn test_no_events_without_changes() {
+        let outputs = vec![output("HDMI-A-1", true, Some((1920, 1080, 60)), 0)];
+        assert!(diff_outputs(&outputs, &outputs).is_empty());
+    }
+
+    #[test]
+    fn test_hotplug_events() {
+        let old = vec![
+            output("HDMI-A-1", false, None, 0),
+            output("DP-1", true, Some((1280, 720, 60)), 0),
+        ];
+        let new = vec![output("HDMI-A-1", true, Some((1920, 1080, 60)), 0)];
+
+        let events = diff_outputs(&old, &new);
+        assert_eq!(
+            events,
+            vec![
+                DisplayEvent::OutputConnected {
+                    output: "HDMI-A-1".to_string()
+                },
+                DisplayEvent::ModeChanged {
+                    output: "HDMI-A-1".to_string(),
+                    mode: Some((1920, 1080, 60))
+                },
+                DisplayEvent::OutputDisconnected {
+                    output: "DP-1".to_string()
+                },
+            ]
+        );
+    }
+
+    #[test]
+    fn test_mode_and_rotation_events() {
+        let old = vec![output("DSI-1", true, Some((1280, 720, 60)), 0)];
+        let new = vec![output("DSI-1", true, Some((720, 1280, 60)), 90)];
+
+        let events: Vec<String> = diff_outputs(&old, &new)
+            .iter()
+            .map(|e| e.to_string())
+            .collect();
+        assert_eq!(
+            events,
+            vec!["modeChanged DSI-1 720x1280@60", "rotationChanged DSI-1 90"]
+        );
+    }
+
+    #[test]
+    fn test_screenshot_events() {
+        let event = DisplayEvent::ScreenshotSaved {
+            path: "/userdata/screenshots/a.png".to_string(),
+        };
+        assert_eq!(event.topic(), "screenshotSaved");
+        assert_eq!(
+            event.to_string(),
+            "screenshotSaved /userdata/screenshots/a.png"
+        );
+    }
+
+    #[test]
+    fn test_backend_changed_event() {
+        let event = DisplayEvent::BackendChanged {
+            backend: "Wayland".to_string(),
+        };
+        assert_eq!(event.topic(), "backendChanged");
+        assert_eq!(event.to_string(), "backendChanged Wayland");
+    }
+}
+
+// Tests for the drmhook shared-memory control region
+#[cfg(test)]
+mod hook_control_tests {
+    use crate::screen::hook_control::{CONTROL_SLOTS, HookControl, HookMode};
+    use std::os::unix::fs::PermissionsExt;
+    use tempfile::NamedTempFile;
+
+    /// CEA 1920x1080 timings at 60 Hz (148.5 MHz) or 59.94 Hz (148.352 MHz)
+    fn mode_1080p(clock: u32) -> HookMode {
+        HookMode {
+            clock,
+            hdisplay: 1920,
+            hsync_start: 2008,
+            hsync_end: 2052,
+            htotal: 2200,
+            hskew: 0,
+            vdisplay: 1080,
+            vsync_start: 1084,
+            vsync_end: 1089,
+            vtotal: 1125,
+            vscan: 0,
+            flags: 0x5,
+        }
+    }
+
+    #[test]
+    fn test_hook_mode_fractional_refresh() {
+        assert_eq!(mode_1080p(148_500).refresh_mhz(), 60_000);
+        assert_eq!(mode_1080p(148_352).refresh_mhz(), 59_940);
+        assert_eq!(HookMode::default().refresh_mhz(), 0);
+    }
+
+    #[test]
+    fn test_hook_control_replaces_untrusted_files() {
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("regmsgd-drmhook");
+
+        // A planted symlink is replaced, its target left alone
+        let target = dir.path().join("target");
+        std::fs::write(&target, b"keep").unwrap();
+        std::os::unix::fs::symlink(&target, &path).unwrap();
+        HookControl::open_at(&path).unwrap();
+        assert!(!std::fs::symlink_metadata(&path).unwrap().is_symlink());
+        assert_eq!(std::fs::read(&target).unwrap(), b"keep");
+
+        // So is a file others can write to
+        std::fs::remove_file(&path).unwrap();
+        std::fs::write(&path, b"").unwrap();
+        std::fs::set_permissions(&path, std::fs::Permissions::from_mode(0o666)).unwrap();
+        HookControl::open_at(&path).unwrap();
+        let mode = std::fs::metadata(&path).unwrap().permissions().mode();
+        assert_eq!(mode & 0o022, 0);
+    }
+
+    #[test]
+    fn test_hook_control_starts_empty() {
+        let file = NamedTempFile::new().unwrap();
+        let control = HookControl::open_at(file.path()).unwrap();
+        assert_eq!(control.read_connector_mode(42), None);
+        // The hook keeps using the mode file until a preference is published
+        assert!(!control.table_valid());
+        control
+            .publish_connector_mode(42, &mode_1080p(148_500))
+            .unwrap();
+        assert!(control.table_valid());
+    }
+
+    #[test]
+    fn test_hook_control_per_connector() {
+        let file = NamedTempFile::new().unwrap();
+        let control = HookControl::open_at(file.path()).unwrap();
+
+        control
+            .publish_connector_mode(42, &mode_1080p(148_500))
+            .unwrap();
+        control
+            .publish_connector_mode(58, &mode_1080p(148_352))
+            .unwrap();
+        assert_eq!(control.read_connector_mode(42), Some(mode_1080p(148_500)));
+        assert_eq!(control.read_connector_mode(58), Some(mode_1080p(148_352)));
+
+        // Ids 42 and 58 share a slot; replacing one must not disturb the other
+        control
+            .publish_connector_mode(42, &mode_1080p(148_352))
+            .unwrap();
+        assert_eq!(control.read_connector_mode(42), Some(mode_1080p(148_352)));
+        assert_eq!(control.read_connector_mode(58), Some(mode_1080p(148_352)));
+        assert_eq!(control.read_connector_mode(74), None);
+    }
+
+    #[test]
+    fn test_hook_control_table_full() {
+        let file = NamedTempFile::new().unwrap();
+        let control = HookControl::open_at(file.path()).unwrap();
+
+        for id in 1..=CONTROL_SLOTS as u32 {
+            control
+                .publish_connector_mode(id, &mode_1080p(148_500))
+                .unwrap();
+        }
+        assert!(
+            control
+                .publish_connector_mode(100, &mode_1080p(148_500))
+                .is_err()
+        );
+        assert!(
+            control
+                .publish_connector_mode(0, &mode_1080p(148_500))
+                .is_err()
+        );
+    }
+
+    #[test]
+    fn test_hook_control_persists_across_reopen() {
+        let file = NamedTempFile::new().unwrap();
+        HookControl::open_at(file.path())
+            .unwrap()
+            .publish_connector_mode(7, &mode_1080p(148_500))
+            .unwrap();
+
+        let reopened = HookControl::open_at(file.path()).unwrap();
+        assert_eq!(reopened.read_connector_mode(7), Some(mode_1080p(148_500)));
+        assert_eq!(
+            std::fs::metadata(file.path()).unwrap().len(),
+            64 + 64 * CONTROL_SLOTS as u64,
+            "region layout is shared with lib/drmhook.c"
+        );
+    }
+}
+
+// Tests for the screenshot encoder
+#[cfg(test)]
+mod screenshot_tests {
+    use crate::screen::screenshot::{
+        EncodeOptions, Frame, ImageFormat, encode_png_bands, encode_ppm, encode_qoi,
+    };
+    use flate2::read::ZlibDecoder;
+    use std::io::Read;
+
+    /// Splits a PNG stream into `(kind, data)` chunks, checking every CRC
+    fn chunks(png: &[u8]) -> Vec<([u8; 4], Vec<u8>)> {
+        let mut chunks = Vec::new();
+        let mut rest = &png[8..];
+        while !rest.is_empty() {
+            let len = u32::from_be_bytes(rest[..4].try_into().unwrap()) as usize;
+            let kind: [u8; 4] = rest[4..8].try_into().unwrap();
+            let data = rest[8..8 + len].to_vec();
+            let crc = u32::from_be_bytes(rest[8 + len..12 + len].try_into().unwrap());
+            assert_eq!(crc, crc32fast::hash(&rest[4..8 + len]));
+            chunks.push((kind, data));
+            rest = &rest[12 + len..];
+        }
+        chunks
+    }
+
+    #[test]
+    fn test_frame_from_xrgb8888_skips_padding() {
+        // 2x2 frame with 4 bytes of row padding (pitch 12)
+        let buffer = [
+            0x01, 0x02, 0x03, 0xFF, 0x04, 0x05, 0x06, 0xFF, 0xEE, 0xEE, 0xEE, 0xEE, //
+            0x07, 0x08, 0x09, 0xFF, 0x0A, 0x0B, 0x0C, 0xFF, 0xEE, 0xEE, 0xEE, 0xEE,
+        ];
+        let frame = Frame::from_xrgb8888(&buffer, 2, 2, 12).unwrap();
+        assert_eq!(
+            frame.pixels,
+            vec![3, 2, 1, 6, 5, 4, 9, 8, 7, 12, 11, 10],
+            "BGRX bytes are reordered to RGB"
+        );
+
+        assert!(Frame::from_xrgb8888(&buffer, 2, 3, 12).is_err());
+        assert!(Frame::from_xrgb8888(&buffer, 4, 2, 12).is_err());
+    }
+
+    #[test]
+    fn test_frame_from_xbgr8888_keeps_order() {
+        let buffer = [0x01, 0x02, 0x03, 0xFF, 0x04, 0x05, 0x06, 0xFF];
+        let frame = Frame::from_xbgr8888(&buffer, 2, 1, 8).unwrap();
+        assert_eq!(
+            frame.pixels,
+            vec![1, 2, 3, 4, 5, 6],
+            "RGBX bytes keep their order"
+        );
+    }
+
+    #[test]
+    fn test_encode_png_layout() {
+        let frame = Frame {
+            width: 2,
+            height: 2,
+            pixels: vec![255, 0, 0, 0, 255, 0, 0, 0, 255, 255, 255, 255],
+        };
+        let mut png = Vec::new();
+        encode_png_bands(&frame, 1, 1, &mut png).unwrap();
+
+        assert_eq!(&png[..8], b"\x89PNG\r\n\x1a\n");
+        let chunks = chunks(&png);
+        let kinds: Vec<&[u8; 4]> = chunks.iter().map(|(kind, _)| kind).collect();
+        assert_eq!(kinds, vec![b"IHDR", b"IDAT", b"IEND"]);
+        assert_eq!(chunks[0].1, vec![0, 0, 0, 2, 0, 0, 0, 2, 8, 2, 0, 0, 0]);
+
+        let mut scanlines = Vec::new();
+        ZlibDecoder::new(&chunks[1].1[..])
+            .read_to_end(&mut scanlines)
+            .unwrap();
+        assert_eq!(
+            scanlines,
+            vec![0, 255, 0, 0, 0, 255, 0, 0, 0, 0, 255, 255, 255, 255]
+        );
+    }
+
+    #[test]
+    fn test_encode_png_bands_form_one_stream() {
+        let width = 37u32;
+        let height = 203u32;
+        let pixels: Vec<u8> = (0..width * height * 3).map(|i| (i % 251) as u8).collect();
+        let frame = Frame {
+            width,
+            height,
+            pixels,
+        };
+
+        let mut single = Vec::new();
+        encode_png_bands(&frame, 6, 1, &mut single).unwrap();
+        let mut banded = Vec::new();
+        encode_png_bands(&frame, 6, 4, &mut banded).unwrap();
+
+        // The decoder verifies the Adler-32 of the joined bands
+        let decode = |png: &[u8]| {
+            let mut scanlines = Vec::new();
+            ZlibDecoder::new(&chunks(png)[1].1[..])
+                .read_to_end(&mut scanlines)
+                .unwrap();
+            scanlines
+        };
+        let scanlines = decode(&banded);
+        assert_eq!(scanlines, decode(&single));
+        assert_eq!(scanlines.len(), (height * (width * 3 + 1)) as usize);
+    }
+
+    #[test]
+    fn test_encode_qoi_ops() {
+        // Two pixels equal to the initial black, one small diff, one full RGB, one index hit
+        let frame = Frame {
+            width: 5,
+            height: 1,
+            pixels: vec![0, 0, 0, 0, 0, 0, 1, 1, 1, 200, 10, 90, 1, 1, 1],
+        };
+        let mut qoi = Vec::new();
+        encode_qoi(&frame, &mut qoi).unwrap();
+
+        assert_eq!(&qoi[..4], b"qoif");
+        assert_eq!(&qoi[4..14], &[0, 0, 0, 5, 0, 0, 0, 1, 3, 0]);
+        let hash = ((3 + 5 + 7 + 255 * 11) % 64) as u8;
+        assert_eq!(
+            &qoi[14..],
+            &[0xC1, 0x7F, 0xFE, 200, 10, 90, hash, 0, 0, 0, 0, 0, 0, 0, 1]
+        );
+    }
+
+    #[test]
+    fn test_ppm_round_trip() {
+        let frame = Frame {
+            width: 2,
+            height: 1,
+            pixels: vec![1, 2, 3, 4, 5, 6],
+        };
+        let mut ppm = Vec::new();
+        encode_ppm(&frame, &mut ppm).unwrap();
+        assert_eq!(&ppm[..11], b"P6\n2 1\n255\n");
+        assert_eq!(Frame::from_ppm(&ppm).unwrap(), frame);
+
+        assert!(Frame::from_ppm(b"P6\n2 1\n65535\n").is_err());
+        assert!(Frame::from_ppm(&ppm[..ppm.len() - 1]).is_err());
+        assert!(Frame::from_ppm(b"P3\n1 1\n255\n0 0 0").is_err());
+    }
+
+    #[test]
+    fn test_encode_options_parse() {
+        let options = EncodeOptions::parse(None, None).unwrap();
+        assert_eq!(options.format, ImageFormat::Png);
+
+        let options = EncodeOptions::parse(Some("png"), Some("9")).unwrap();
+        assert_eq!((options.format, options.level), (ImageFormat::Png, 9));
+        assert_eq!(
+            EncodeOptions::parse(Some("QOI"), None).unwrap().format,
+            ImageFormat::Qoi
+        );
+
+        assert!(EncodeOptions::parse(Some("png"), Some("10")).is_err());
+        assert!(EncodeOptions::parse(Some("qoi"), Some("5")).is_err());
+        assert!(EncodeOptions::parse(Some("bmp"), None).is_err());
+    }
+}
+
+// Tests for the backend replaying recorded display states
+#[cfg(test)]
+mod replay_tests {
+    use super::*;
+    use crate::screen::replay::ReplayBackend;
+    use std::sync::Arc;
+
+    /// A recording with two connected outputs and no simulated latency
+    const RECORDING: &str = r#"{
+        "latency_us": { "default": 0 },
+        "outputs": [
+            {
+                "name": "HDMI-A-1",
+                "modes": [
+                    { "width": 3840, "height": 2160, "refresh_rate": 60, "name": "3840x2160" },
+                    { "width": 1920, "height": 1080, "refresh_rate": 50, "name": "1920x1080" },
+                    { "width": 1920, "height": 1080, "refresh_rate": 60, "name": "1920x1080" },
+                    { "width": 1280, "height": 720, "refresh_rate": 60, "name": "1280x720" }
+                ],
+                "current_mode":
+                    { "width": 3840, "height": 2160, "refresh_rate": 60, "name": "3840x2160" },
+                "is_connected": true,
+                "rotation": 0
+            },
+            {
+                "name": "DSI-1",
+                "modes": [
+                    { "width": 720, "height": 1280, "refresh_rate": 60, "name": "720x1280" }
+                ],
+                "current_mode":
+                    { "width": 720, "height": 1280, "refresh_rate": 60, "name": "720x1280" },
+                "is_connected": true,
+                "rotation": 90
+            }
+        ]
+    }"#;
+
+    #[test]
+    fn test_replay_parses_list_outputs_json() {
+        let outputs = vec![DisplayOutput {
+            name: "HDMI-A-1".into(),
+            modes: vec![],
+            current_mode: None,
+            is_connected: true,
+            rotation: 0,
+            position: None,
+        }];
+        let json = serde_json::to_string(&outputs).unwrap();
+
+        let backend = ReplayBackend::parse(&json).unwrap();
+        let replayed = backend.list_outputs().unwrap();
+        assert_eq!(replayed.len(), 1);
+        assert_eq!(&*replayed[0].name, "HDMI-A-1");
+
+        assert!(matches!(
+            ReplayBackend::parse("{ \"modes\": [] }"),
+            Err(RegmsgError::ParseError(_))
+        ));
+    }
+
+    #[test]
+    fn test_replay_queries() {
+        let backend = ReplayBackend::parse(RECORDING).unwrap();
+        assert_eq!(backend.backend_name(), "Replay");
+        assert_eq!(backend.list_outputs().unwrap().len(), 2);
+        assert_eq!(backend.list_modes(Some("HDMI-A-1")).unwrap().len(), 4);
+        assert_eq!(backend.list_modes(None).unwrap().len(), 5);
+        assert_eq!(backend.current_resolution(None).unwrap(), (3840, 2160));
+        assert_eq!(backend.current_refresh_rate(Some("DSI-1")).unwrap(), 60);
+        assert_eq!(backend.current_rotation(Some("DSI-1")).unwrap(), 90);
+        assert!(matches!(
+            backend.current_mode(Some("HDMI-A-2")),
+            Err(RegmsgError::NotFound(_))
+        ));
+    }
+
+    #[test]
+    fn test_replay_set_mode_updates_state() {
+        let backend = ReplayBackend::parse(RECORDING).unwrap();
+        let mode = ModeParams {
+            width: 1920,
+            height: 1080,
+            refresh_rate: 50,
+        };
+        backend.set_mode(Some("HDMI-A-1"), &mode).unwrap();
+        let current = backend.current_mode(Some("HDMI-A-1")).unwrap();
+        assert_eq!((current.width, current.refresh_rate()), (1920, 50));
+
+        // A rate more than 1 Hz away from every rate of the size is not substituted
+        let mode = ModeParams {
+            width: 1280,
+            height: 720,
+            refresh_rate: 75,
+        };
+        assert!(backend.set_mode(Some("HDMI-A-1"), &mode).is_err());
+        assert_eq!(backend.current_resolution(None).unwrap(), (1920, 1080));
+
+        let mode = ModeParams {
+            width: 800,
+            height: 600,
+            refresh_rate: 60,
+        };
+        assert!(backend.set_mode(None, &mode).is_err());
+    }
+
+    #[test]
+    fn test_replay_set_rotation_and_max_resolution() {
+        let backend = ReplayBackend::parse(RECORDING).unwrap();
+        backend
+            .set_rotation(Some("HDMI-A-1"), &RotationParams { rotation: 180 })
+            .unwrap();
+        assert_eq!(backend.current_rotation(Some("HDMI-A-1")).unwrap(), 180);
+        assert_eq!(backend.current_rotation(Some("DSI-1")).unwrap(), 90);
+
+        backend
+            .min_to_max_resolution(None, Some("1920x1080"))
+            .unwrap();
+        let current = backend.current_mode(Some("HDMI-A-1")).unwrap();
+        assert_eq!((current.width, current.height), (1920, 1080));
+        // Outputs already within the limit keep their mode
+        assert_eq!(
+            backend.current_resolution(Some("DSI-1")).unwrap(),
+            (720, 1280)
+        );
+
+        assert!(backend.min_to_max_resolution(None, Some("1920")).is_err());
+    }
+
+    #[test]
+    fn test_replay_capture_frame_matches_current_mode() {
+        let backend = ReplayBackend::parse(RECORDING).unwrap();
+        let mode = ModeParams {
+            width: 1280,
+            height: 720,
+            refresh_rate: 60,
+        };
+        backend.set_mode(Some("HDMI-A-1"), &mode).unwrap();
+
+        let frame = backend.capture_frame().unwrap();
+        assert_eq!((frame.width, frame.height), (1280, 720));
+        assert_eq!(frame.pixels.len(), 1280 * 720 * 3);
+    }
+
+    #[test]
+    fn test_replay_keeps_cache_live() {
+        let backend = ReplayBackend::parse(RECORDING).unwrap();
+        let cache = Arc::new(OutputCache::new());
+        backend.watch_changes(Arc::clone(&cache)).unwrap();
+        assert!(cache.is_live());
+    }
+}
+
+// Tests for the display profiles
+#[cfg(test)]
+mod profile_tests {
+    use super::*;
+    use crate::screen::profile::{DisplayProfile, ProfileStore};
+    use crate::screen::replay::ReplayBackend;
+    use std::collections::HashMap;
+    use std::fs;
+    use std::sync::Arc;
+
+    fn output(name: &str, modes: &[(u32, u32, u32)], rotation: u32) -> DisplayOutput {
+        let modes: Vec<DisplayMode> = modes
+            .iter()
+            .map(|&(width, height, hz)| DisplayMode::new(width, height, hz * 1000))
+            .collect();
+        DisplayOutput {
+            name: name.into(),
+            current_mode: modes.first().copied(),
+            modes,
+            is_connected: true,
+            rotation,
+            position: Some((0, 0)),
+        }
+    }
+
+    fn outputs() -> Vec<DisplayOutput> {
+        vec![
+            output("HDMI-A-1", &[(3840, 2160, 60), (1920, 1080, 60)], 0),
+            output("DSI-1", &[(720, 1280, 60)], 90),
+        ]
+    }
+
+    #[test]
+    fn test_parse_profile_file() {
+        let profile = DisplayProfile::parse(
+            r#"
+            touchscreen = "DSI-1"
+
+            [[output]]
+            name = "HDMI-A-1"
+            mode = "1920x1080@60"
+            position = [720, 0]
+
+            [[output]]
+            name = "DSI-1"
+            rotation = 90
+            "#,
+        )
+        .unwrap();
+        assert_eq!(profile.outputs.len(), 2);
+        assert_eq!(profile.outputs[0].position, Some((720, 0)));
+        assert_eq!(profile.outputs[1].mode, None);
+        assert_eq!(profile.touchscreen.as_deref(), Some("DSI-1"));
+
+        assert!(matches!(
+            DisplayProfile::parse("[[output]]\nname = \"DSI-1\"\nrotation = 45"),
+            Err(RegmsgError::InvalidArguments(_))
+        ));
+        assert!(matches!(
+            DisplayProfile::parse("[[output]]\nname = \"DSI-1\"\nscale = 2"),
+            Err(RegmsgError::ParseError(_))
+        ));
+    }
+
+    #[test]
+    fn test_parse_inline_profile() {
+        let profile = DisplayProfile::from_args(&[
+            "HDMI-A-1:1920x1080:-:720,0",
+            "DSI-1:-:90",
+            "touchscreen:DSI-1",
+        ])
+        .unwrap();
+        assert_eq!(profile.outputs[0].mode.as_deref(), Some("1920x1080"));
+        assert_eq!(profile.outputs[0].rotation, None);
+        assert_eq!(profile.outputs[0].position, Some((720, 0)));
+        assert_eq!(profile.outputs[1].rotation, Some(90));
+        assert_eq!(profile.touchscreen.as_deref(), Some("DSI-1"));
+
+        for args in [
+            &["DSI-1:-:90", "DSI-1:-:0"][..],
+            &["DSI-1:1920"],
+            &["DSI-1:-:-:0"],
+            &["DSI-1:-:-:-:extra"],
+        ] {
+            assert!(DisplayProfile::from_args(args).is_err(), "{:?}", args);
+        }
+    }
+
+    #[test]
+    fn test_plan_skips_matching_settings() {
+        let profile =
+            DisplayProfile::from_args(&["HDMI-A-1:1920x1080@60:0", "DSI-1:720x1280:90"]).unwrap();
+        let changes = profile.plan(&outputs()).unwrap();
+        assert_eq!(changes.outputs.len(), 1);
+        assert_eq!(&*changes.outputs[0].output, "HDMI-A-1");
+        assert_eq!(
+            changes.outputs[0].mode,
+            Some(DisplayMode::new(1920, 1080, 60_000))
+        );
+        assert_eq!(changes.outputs[0].rotation, None);
+
+        let applied = DisplayProfile::from_args(&["DSI-1:720x1280:90:0,0"]).unwrap();
+        assert!(applied.plan(&outputs()).unwrap().is_empty());
+    }
+
+    #[test]
+    fn test_plan_validates_every_output() {
+        for args in [
+            &["HDMI-A-1:1920x1080", "HDMI-A-2:1920x1080"][..],
+            &["HDMI-A-1:800x600"],
+            &["touchscreen:HDMI-A-2"],
+        ] {
+            let profile = DisplayProfile::from_args(args).unwrap();
+            assert!(
+                matches!(profile.plan(&outputs()), Err(RegmsgError::NotFound(_))),
+                "{:?}",
+                args
+            );
+        }
+    }
+
+    #[test]
+    fn test_replay_applies_profile_at_once() {
+        let backend = ReplayBackend::new(outputs(), HashMap::from([("default".to_string(), 0)]));
+        let profile =
+            DisplayProfile::from_args(&["HDMI-A-1:1920x1080:-:720,0", "DSI-1:-:0"]).unwrap();
+        let changes = profile.plan(&backend.list_outputs().unwrap()).unwrap();
+        backend.apply_profile(&changes).unwrap();
+
+        let outputs = backend.list_outputs().unwrap();
+        assert_eq!(
+            outputs[0].current_mode,
+            Some(DisplayMode::new(1920, 1080, 60_000))
+        );
+        assert_eq!(outputs[0].position, Some((720, 0)));
+        assert_eq!(outputs[1].rotation, 0);
+        assert!(profile.plan(&outputs).unwrap().is_empty());
+    }
+
+    #[test]
+    fn test_profile_store_reloads_changed_files() {
+        let dir = tempfile::tempdir().unwrap();
+        let store = ProfileStore::new(dir.path());
+        let path = dir.path().join("game.toml");
+
+        fs::write(&path, "[[output]]\nname = \"DSI-1\"\nrotation = 0\n").unwrap();
+        let first = store.load("game").unwrap();
+        assert!(Arc::ptr_eq(&first, &store.load("game").unwrap()));
+
+        fs::write(&path, "[[output]]\nname = \"DSI-1\"\nrotation = 270\n").unwrap();
+        let file = fs::File::options().write(true).open(&path).unwrap();
+        file.set_modified(std::time::SystemTime::now() + std::time::Duration::from_secs(1))
+            .unwrap();
+        assert_eq!(store.load("game").unwrap().outputs[0].rotation, Some(270));
+
+        assert!(matches!(
+            store.load("missing"),
+            Err(RegmsgError::NotFound(_))
+        ));
+        assert!(matches!(
+            store.load("../game"),
+            Err(RegmsgError::InvalidArguments(_))
+        ));
+    }
+}
+
+// Tests for the no-op detection of mode setters
+#[cfg(test)]
+mod setter_tests {
+    use super::*;
+    use crate::screen::mode_settled;
+
+    #[test]
+    fn test_same_timing_ignores_preferred_flag() {
+        let mut listed = DisplayMode::new(1920, 1080, 60_000);
+        listed.preferred = true;
+        assert!(listed.same_timing(&DisplayMode::new(1920, 1080, 60_000)));
+        assert!(!listed.same_timing(&DisplayMode::new(1920, 1080, 59_940)));
+    }
+
+    #[test]
+    fn test_mode_settled() {
+        let full_hd = DisplayMode::new(1920, 1080, 60_000);
+        let hd = DisplayMode::new(1280, 720, 60_000);
+        let is_full_hd = |mode: &DisplayMode| mode.same_timing(&full_hd);
+
+        assert!(mode_settled(Some(full_hd), None, is_full_hd));
+        assert!(mode_settled(Some(full_hd), Some(Some(full_hd)), is_full_hd));
+        assert!(!mode_settled(Some(hd), None, is_full_hd));
+        assert!(!mode_settled(None, None, is_full_hd));
+        // A preference published to the hook but not yet on the CRTC
+        assert!(!mode_settled(Some(full_hd), Some(Some(hd)), is_full_hd));
+        // No known preference, e.g. after a daemon restart without a mode file
+        assert!(!mode_settled(Some(full_hd), Some(None), is_full_hd));
+    }
+}
+
+// Tests for the shared mode index
+#[cfg(test)]
+mod mode_index_tests {
+    use crate::screen::mode_index::ModeIndex;
+
+    /// Modes of a typical HDMI TV, preferred mode first
+    fn tv_modes() -> ModeIndex {
+        ModeIndex::new([
+            (3840, 2160, 60_000),
+            (3840, 2160, 59_940),
+            (1920, 1080, 60_000),
+            (1920, 1080, 59_940),
+            (1920, 1080, 50_000),
+            (1920, 1080, 60_000),
+            (1280, 1024, 75_025),
+            (1280, 720, 60_000),
+            (720, 1280, 60_000),
+        ])
+    }
+
+    #[test]
+    fn test_exact_lookup() {
+        let index = tv_modes();
+        assert_eq!(index.exact(1920, 1080, 59_940), Some(3));
+        // Of duplicate modes the one listed first is returned
+        assert_eq!(index.exact(1920, 1080, 60_000), Some(2));
+        assert_eq!(index.exact(1920, 1080, 30_000), None);
+    }
+
+    #[test]
+    fn test_nearest_refresh() {
+        let index = tv_modes();
+        assert_eq!(index.nearest(1920, 1080, 60), Some(2));
+        assert_eq!(index.nearest(1920, 1080, 59), Some(3));
+        assert_eq!(index.nearest(1920, 1080, 50), Some(4));
+        assert_eq!(index.nearest(1920, 1080, 24), None);
+        assert_eq!(index.nearest(1280, 1024, 75), Some(6));
+        assert_eq!(index.nearest(1024, 768, 60), None);
+    }
+
+    #[test]
+    fn test_nearest_prefers_higher_rate_on_ties() {
+        let index = ModeIndex::new([(800, 600, 59_500), (800, 600, 60_500)]);
+        assert_eq!(index.nearest(800, 600, 60), Some(1));
+    }
+
+    #[test]
+    fn test_nearest_does_not_snap_to_distant_rates() {
+        let index = ModeIndex::new([(1920, 1080, 60_000), (1280, 720, 144_000)]);
+        assert_eq!(index.nearest(1920, 1080, 144), None);
+        assert_eq!(index.nearest(1920, 1080, 61), None);
+        assert_eq!(index.nearest(1280, 720, 143), None);
+        assert_eq!(index.nearest(1920, 1080, 60), Some(0));
+    }
+
+    #[test]
+    fn test_best_within() {
+        let index = tv_modes();
+        assert_eq!(index.best_within(3840, 2160), Some(0));
+        assert_eq!(index.best_within(1920, 1080), Some(2));
+        assert_eq!(index.best_within(1920, 1200), Some(2));
+        // A portrait mode does not fit a landscape limit of the same area
+        assert_eq!(index.best_within(1280, 800), Some(7));
+        assert_eq!(index.best_within(720, 1280), Some(8));
+        assert_eq!(index.best_within(640, 480), None);
+        assert_eq!(ModeIndex::new([]).best_within(1920, 1080), None);
+    }
+}
@@ -0,0 +1,577 @@
+//! Screenshot Encoding
+//!
+//! This module holds captured frames and writes them to disk. Backends only capture a
+//! `Frame`; encoding runs on a background worker so `getScreenshot` replies as soon as
+//! the frame is in memory, and completion is reported as a `screenshotSaved` event.
+//!
+//! Supported formats:
+//! - `png`: deflate-compressed, with the rows split into bands compressed on parallel
+//!   threads and joined into a single zlib stream (the default)
+//! - `qoi`: the "Quite OK Image" format, lossless and roughly as fast as a copy
+//! - `ppm`: raw binary PPM (P6), no encoding at all
+
+use std::fs::{self, File};
+use std::io::{self, BufWriter, Write};
+use std::num::NonZeroUsize;
+use std::path::{Path, PathBuf};
+use std::sync::OnceLock;
+use std::sync::mpsc::{self, SyncSender};
+use std::thread;
+
+use chrono::Local;
+use flate2::{Compress, Compression, FlushCompress, Status};
+
+use crate::screen::events::{self, DisplayEvent};
+use crate::utils::error::{RegmsgError, Result};
+
+use tracing::{debug, error, info};
+
+/// PNG file signature
+const PNG_SIGNATURE: &[u8] = b"\x89PNG\r\n\x1a\n";
+
+/// zlib stream header: deflate with a 32K window; the level bits are informational
+const ZLIB_HEADER: [u8; 2] = [0x78, 0x01];
+
+/// Default PNG compression level, favouring speed on slow CPUs
+const DEFAULT_PNG_LEVEL: u32 = 1;
+
+/// Upper bound on the threads compressing one PNG
+const MAX_ENCODER_THREADS: usize = 4;
+
+/// Minimum number of rows per band before splitting a frame across threads
+const MIN_BAND_ROWS: usize = 64;
+
+/// Frames waiting for the encoder before `getScreenshot` blocks
+const ENCODE_QUEUE_SIZE: usize = 2;
+
+/// A captured frame as tightly packed 8-bit RGB rows
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Frame {
+    pub width: u32,
+    pub height: u32,
+    /// `width * height * 3` bytes, top row first
+    pub pixels: Vec<u8>,
+}
+
+impl Frame {
+    /// Converts a little-endian XRGB8888/ARGB8888 buffer (B, G, R, X bytes), as used by
+    /// most scanout framebuffers, into a frame.
+    ///
+    /// # Arguments
+    /// * `buffer` - The mapped framebuffer, at least `pitch * height` bytes
+    /// * `width` - Width in pixels
+    /// * `height` - Height in pixels
+    /// * `pitch` - Bytes per row in `buffer`
+    ///
+    /// # Returns
+    /// The RGB frame, or an error if `buffer` is too small for the given geometry
+    pub fn from_xrgb8888(buffer: &[u8], width: u32, height: u32, pitch: usize) -> Result<Self> {
+        Self::from_32bpp(buffer, width, height, pitch, [2, 1, 0])
+    }
+
+    /// Converts a little-endian XBGR8888/ABGR8888 buffer (R, G, B, X bytes) into a frame,
+    /// see [`Frame::from_xrgb8888`]
+    pub fn from_xbgr8888(buffer: &[u8], width: u32, height: u32, pitch: usize) -> Result<Self> {
+        Self::from_32bpp(buffer, width, height, pitch, [0, 1, 2])
+    }
+
+    /// Converts a 32 bpp buffer whose red, green and blue bytes are at `rgb` in each pixel
+    fn from_32bpp(
+        buffer: &[u8],
+        width: u32,
+        height: u32,
+        pitch: usize,
+        rgb: [usize; 3],
+    ) -> Result<Self> {
+        let row_bytes = width as usize * 4;
+        if pitch < row_bytes || buffer.len() < pitch * height as usize {
+            return Err(RegmsgError::InvalidArguments(format!(
+                "Framebuffer too small for {}x{} (pitch {}, {} bytes)",
+                width,
+                height,
+                pitch,
+                buffer.len()
+            )));
+        }
+
+        // Scanout memory is usually uncached: copy each row once, then convert it
+        let mut row = vec![0u8; row_bytes];
+        let mut pixels = Vec::with_capacity(width as usize * height as usize * 3);
+        for line in buffer.chunks(pitch).take(height as usize) {
+            row.copy_from_slice(&line[..row_bytes]);
+            for pixel in row.chunks_exact(4) {
+                pixels.extend_from_slice(&[pixel[rgb[0]], pixel[rgb[1]], pixel[rgb[2]]]);
+            }
+        }
+
+        Ok(Self {
+            width,
+            height,
+            pixels,
+        })
+    }
+
+    /// Parses a binary PPM (P6) image with 8-bit samples, as written by `grim -t ppm`
+    ///
+    /// # Arguments
+    /// * `data` - The complete PPM file
+    ///
+    /// # Returns
+    /// The frame, or a parse error for other PPM variants or truncated data
+    pub fn from_ppm(data: &[u8]) -> Result<Self> {
+        let invalid = |reason: &str| RegmsgError::ParseError(format!("Invalid PPM: {}", reason));
+
+        // Header: magic, width, height and maxval separated by whitespace
+        let mut fields = [0u32; 3];
+        let mut rest = data
+            .strip_prefix(b"P6")
+            .ok_or_else(|| invalid("not a binary PPM"))?;
+        for field in fields.iter_mut() {
+            let start = rest
+                .iter()
+                .position(|byte| !byte.is_ascii_whitespace())
+                .ok_or_else(|| invalid("truncated header"))?;
+            let len = rest[start..]
+                .iter()
+                .position(|byte| !byte.is_ascii_digit())
+                .ok_or_else(|| invalid("truncated header"))?;
+            *field = std::str::from_utf8(&rest[start..start + len])
+                .ok()
+                .and_then(|digits| digits.parse().ok())
+                .ok_or_else(|| invalid("bad header field"))?;
+            rest = &rest[start + len..];
+        }
+        let [width, height, maxval] = fields;
+        if maxval != 255 {
+            return Err(invalid("only 8-bit samples are supported"));
+        }
+
+        // A single whitespace byte separates the header from the samples
+        let pixels = rest.get(1..).ok_or_else(|| invalid("truncated header"))?;
+        let len = width as usize * height as usize * 3;
+        if pixels.len() < len {
+            return Err(invalid("truncated pixel data"));
+        }
+
+        Ok(Self {
+            width,
+            height,
+            pixels: pixels[..len].to_vec(),
+        })
+    }
+}
+
+/// Image format of a saved screenshot
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum ImageFormat {
+    Png,
+    Qoi,
+    Ppm,
+}
+
+impl ImageFormat {
+    /// Parses a format name ("png", "qoi" or "ppm")
+    pub fn parse(name: &str) -> Result<Self> {
+        match name.to_ascii_lowercase().as_str() {
+            "png" => Ok(ImageFormat::Png),
+            "qoi" => Ok(ImageFormat::Qoi),
+            "ppm" | "raw" => Ok(ImageFormat::Ppm),
+            _ => Err(RegmsgError::InvalidArguments(format!(
+                "Invalid screenshot format: '{}'. Valid options are: png, qoi, ppm",
+                name
+            ))),
+        }
+    }
+
+    /// Returns the file extension, without the dot
+    pub fn extension(self) -> &'static str {
+        match self {
+            ImageFormat::Png => "png",
+            ImageFormat::Qoi => "qoi",
+            ImageFormat::Ppm => "ppm",
+        }
+    }
+}
+
+/// How a screenshot is encoded
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct EncodeOptions {
+    pub format: ImageFormat,
+    /// PNG compression level, from 0 (store) to 9 (smallest)
+    pub level: u32,
+}
+
+impl EncodeOptions {
+    /// Parses the optional `getScreenshot` arguments
+    ///
+    /// # Arguments
+    /// * `format` - The format name, PNG when omitted
+    /// * `quality` - The PNG compression level (0-9); other formats take no quality
+    ///
+    /// # Returns
+    /// The options, or an error for unknown formats or out-of-range levels
+    pub fn parse(format: Option<&str>, quality: Option<&str>) -> Result<Self> {
+        let format = format.map_or(Ok(ImageFormat::Png), ImageFormat::parse)?;
+        let level = match quality {
+            None => DEFAULT_PNG_LEVEL,
+            Some(_) if format != ImageFormat::Png => {
+                return Err(RegmsgError::InvalidArguments(format!(
+                    "Format {} takes no quality argument",
+                    format.extension()
+                )));
+            }
+            Some(quality) => match quality.parse::<u32>() {
+                Ok(level) if level <= 9 => level,
+                _ => {
+                    return Err(RegmsgError::InvalidArguments(format!(
+                        "Invalid PNG compression level: '{}'. Expected 0-9",
+                        quality
+                    )));
+                }
+            },
+        };
+        Ok(Self { format, level })
+    }
+}
+
+/// Returns a timestamped screenshot file name inside `dir`
+///
+/// # Arguments
+/// * `dir` - The screenshot directory
+/// * `extension` - The file extension, without the dot
+pub fn screenshot_path(dir: &str, extension: &str) -> String {
+    format!(
+        "{}/screenshot-{}.{}",
+        dir,
+        Local::now().format("%Y.%m.%d-%Hh%M.%S"),
+        extension
+    )
+}
+
+/// Writes one PNG chunk with its length and CRC
+fn write_chunk<W: Write>(out: &mut W, kind: &[u8; 4], data: &[u8]) -> io::Result<()> {
+    let mut crc = crc32fast::Hasher::new();
+    crc.update(kind);
+    crc.update(data);
+
+    out.write_all(&(data.len() as u32).to_be_bytes())?;
+    out.write_all(kind)?;
+    out.write_all(data)?;
+    out.write_all(&crc.finalize().to_be_bytes())
+}
+
+/// Feeds input to a raw deflate stream, growing `out` as needed
+fn deflate(
+    compress: &mut Compress,
+    out: &mut Vec<u8>,
+    mut input: &[u8],
+    flush: FlushCompress,
+) -> io::Result<()> {
+    let finish = matches!(flush, FlushCompress::Finish);
+    loop {
+        if out.len() == out.capacity() {
+            out.reserve(out.capacity().max(4096));
+        }
+        let before = compress.total_in();
+        let status = compress
+            .compress_vec(input, out, flush)
+            .map_err(io::Error::other)?;
+        input = &input[(compress.total_in() - before) as usize..];
+
+        // Done once everything is consumed and zlib stopped short of filling `out`
+        let done = if finish {
+            status == Status::StreamEnd
+        } else {
+            input.is_empty() && out.len() < out.capacity()
+        };
+        if done {
+            return Ok(());
+        }
+    }
+}
+
+/// Compresses a band of RGB rows, each prefixed with filter type 0 (none)
+///
+/// Every band but the last ends on a sync flush, so the raw deflate streams of
+/// consecutive bands concatenate into one valid stream.
+fn deflate_band(rows: &[u8], row_bytes: usize, level: u32, last: bool) -> io::Result<Vec<u8>> {
+    let mut compress = Compress::new(Compression::new(level), false);
+    let mut out = Vec::with_capacity(rows.len() / 2 + 64);
+    for row in rows.chunks(row_bytes) {
+        deflate(&mut compress, &mut out, &[0], FlushCompress::None)?;
+        deflate(&mut compress, &mut out, row, FlushCompress::None)?;
+    }
+    let flush = if last {
+        FlushCompress::Finish
+    } else {
+        FlushCompress::Sync
+    };
+    deflate(&mut compress, &mut out, &[], flush)?;
+    Ok(out)
+}
+
+/// Computes the zlib checksum of the filtered scanlines
+fn scanline_adler32(pixels: &[u8], row_bytes: usize) -> u32 {
+    let mut adler = adler2::Adler32::new();
+    for row in pixels.chunks(row_bytes) {
+        adler.write_slice(&[0]);
+        adler.write_slice(row);
+    }
+    adler.checksum()
+}
+
+/// Encodes a frame as PNG, compressing `bands` groups of rows in parallel
+pub(crate) fn encode_png_bands<W: Write>(
+    frame: &Frame,
+    level: u32,
+    bands: usize,
+    mut out: W,
+) -> io::Result<()> {
+    out.write_all(PNG_SIGNATURE)?;
+
+    let mut header = Vec::with_capacity(13);
+    header.extend_from_slice(&frame.width.to_be_bytes());
+    header.extend_from_slice(&frame.height.to_be_bytes());
+    // Bit depth 8, color type 2 (RGB), deflate, no filtering, no interlace
+    header.extend_from_slice(&[8, 2, 0, 0, 0]);
+    write_chunk(&mut out, b"IHDR", &header)?;
+
+    let row_bytes = (frame.width as usize * 3).max(1);
+    let rows = frame.pixels.len() / row_bytes;
+    let band_rows = rows.div_ceil(bands.max(1)).max(1);
+    let band_bytes = band_rows * row_bytes;
+    let band_count = frame.pixels.len().div_ceil(band_bytes).max(1);
+
+    let mut idat = ZLIB_HEADER.to_vec();
+    let adler = thread::scope(|scope| -> io::Result<u32> {
+        let workers: Vec<_> = frame
+            .pixels
+            .chunks(band_bytes)
+            .enumerate()
+            .map(|(index, band)| {
+                let last = index + 1 == band_count;
+                scope.spawn(move || deflate_band(band, row_bytes, level, last))
+            })
+            .collect();
+        if workers.is_empty() {
+            idat.extend(deflate_band(&[], row_bytes, level, true)?);
+        }
+
+        // The checksum runs on the calling thread while the bands compress
+        let adler = scanline_adler32(&frame.pixels, row_bytes);
+        for worker in workers {
+            let band = worker
+                .join()
+                .map_err(|_| io::Error::other("PNG encoder thread panicked"))??;
+            idat.extend_from_slice(&band);
+        }
+        Ok(adler)
+    })?;
+    idat.extend_from_slice(&adler.to_be_bytes());
+    write_chunk(&mut out, b"IDAT", &idat)?;
+
+    write_chunk(&mut out, b"IEND", &[])?;
+    out.flush()
+}
+
+/// Encodes a frame as PNG
+///
+/// # Arguments
+/// * `frame` - The frame to encode
+/// * `level` - The compression level, from 0 to 9
+/// * `out` - The destination
+///
+/// # Returns
+/// An `io::Result` indicating whether writing succeeded
+pub fn encode_png<W: Write>(frame: &Frame, level: u32, out: W) -> io::Result<()> {
+    let threads = thread::available_parallelism()
+        .map_or(1, NonZeroUsize::get)
+        .min(MAX_ENCODER_THREADS);
+    let bands = threads.min(frame.height as usize / MIN_BAND_ROWS).max(1);
+    encode_png_bands(frame, level, bands, out)
+}
+
+/// Index of an RGBA pixel in the QOI color cache
+fn qoi_hash([r, g, b, a]: [u8; 4]) -> usize {
+    (r as usize * 3 + g as usize * 5 + b as usize * 7 + a as usize * 11) % 64
+}
+
+/// Encodes a frame as QOI (3 channels, sRGB)
+///
+/// # Arguments
+/// * `frame` - The frame to encode
+/// * `out` - The destination
+///
+/// # Returns
+/// An `io::Result` indicating whether writing succeeded
+pub fn encode_qoi<W: Write>(frame: &Frame, mut out: W) -> io::Result<()> {
+    const OP_INDEX: u8 = 0x00;
+    const OP_DIFF: u8 = 0x40;
+    const OP_LUMA: u8 = 0x80;
+    const OP_RUN: u8 = 0xC0;
+    const OP_RGB: u8 = 0xFE;
+    const MAX_RUN: u8 = 62;
+
+    let mut data = Vec::with_capacity(frame.pixels.len() / 2 + 22);
+    data.extend_from_slice(b"qoif");
+    data.extend_from_slice(&frame.width.to_be_bytes());
+    data.extend_from_slice(&frame.height.to_be_bytes());
+    data.extend_from_slice(&[3, 0]);
+
+    // Decoders track RGBA: the cache starts transparent, the previous pixel opaque black
+    let mut index = [[0u8; 4]; 64];
+    let mut previous = [0, 0, 0, 255];
+    let mut run = 0u8;
+    let pixels = frame.pixels.chunks_exact(3);
+    let count = pixels.len();
+
+    for (position, pixel) in pixels.enumerate() {
+        let pixel = [pixel[0], pixel[1], pixel[2], 255];
+        if pixel == previous {
+            run += 1;
+            if run == MAX_RUN || position + 1 == count {
+                data.push(OP_RUN | (run - 1));
+                run = 0;
+            }
+            continue;
+        }
+        if run > 0 {
+            data.push(OP_RUN | (run - 1));
+            run = 0;
+        }
+
+        let hash = qoi_hash(pixel);
+        if index[hash] == pixel {
+            data.push(OP_INDEX | hash as u8);
+        } else {
+            index[hash] = pixel;
+            let dr = pixel[0].wrapping_sub(previous[0]) as i8;
+            let dg = pixel[1].wrapping_sub(previous[1]) as i8;
+            let db = pixel[2].wrapping_sub(previous[2]) as i8;
+            let dr_dg = dr.wrapping_sub(dg);
+            let db_dg = db.wrapping_sub(dg);
+
+            if (-2..=1).contains(&dr) && (-2..=1).contains(&dg) && (-2..=1).contains(&db) {
+                data.push(OP_DIFF | ((dr + 2) as u8) << 4 | ((dg + 2) as u8) << 2 | (db + 2) as u8);
+            } else if (-32..=31).contains(&dg)
+                && (-8..=7).contains(&dr_dg)
+                && (-8..=7).contains(&db_dg)
+            {
+                data.push(OP_LUMA | (dg + 32) as u8);
+                data.push(((dr_dg + 8) as u8) << 4 | (db_dg + 8) as u8);
+            } else {
+                data.extend_from_slice(&[OP_RGB, pixel[0], pixel[1], pixel[2]]);
+            }
+        }
+        previous = pixel;
+    }
+
+    data.extend_from_slice(&[0, 0, 0, 0, 0, 0, 0, 1]);
+    out.write_all(&data)?;
+    out.flush()
+}
+
+/// Writes a frame as binary PPM (P6)
+pub fn encode_ppm<W: Write>(frame: &Frame, mut out: W) -> io::Result<()> {
+    write!(out, "P6\n{} {}\n255\n", frame.width, frame.height)?;
+    out.write_all(&frame.pixels)?;
+    out.flush()
+}
+
+/// Encodes a frame into a file
+///
+/// The image is written next to `path` and renamed into place, so readers never see
+/// a partially written screenshot.
+///
+/// # Arguments
+/// * `frame` - The frame to save
+/// * `options` - The format and compression level
+/// * `path` - The destination file
+///
+/// # Returns
+/// A `Result` indicating success, or an error if the file could not be written
+pub fn save(frame: &Frame, options: EncodeOptions, path: &Path) -> Result<()> {
+    let mut partial = path.as_os_str().to_owned();
+    partial.push(".part");
+    let partial = PathBuf::from(partial);
+
+    let file = File::create(&partial).map_err(|e| {
+        RegmsgError::SystemError(format!("Failed to create {}: {}", partial.display(), e))
+    })?;
+    let out = BufWriter::new(file);
+    let written = match options.format {
+        ImageFormat::Png => encode_png(frame, options.level, out),
+        ImageFormat::Qoi => encode_qoi(frame, out),
+        ImageFormat::Ppm => encode_ppm(frame, out),
+    };
+    if let Err(e) = written.and_then(|_| fs::rename(&partial, path)) {
+        let _ = fs::remove_file(&partial);
+        return Err(e.into());
+    }
+    Ok(())
+}
+
+/// A captured frame waiting to be encoded
+struct EncodeJob {
+    frame: Frame,
+    options: EncodeOptions,
+    path: PathBuf,
+}
+
+/// Queue of the background encoder, started on first use
+static ENCODER: OnceLock<SyncSender<EncodeJob>> = OnceLock::new();
+
+/// Encodes queued frames one at a time and reports each result as an event
+fn run_encoder(jobs: mpsc::Receiver<EncodeJob>) {
+    for job in jobs {
+        let path = job.path.display().to_string();
+        debug!(
+            "Encoding {}x{} screenshot",
+            job.frame.width, job.frame.height
+        );
+        match save(&job.frame, job.options, &job.path) {
+            Ok(()) => {
+                info!("Screenshot saved in: {}", path);
+                events::emit(DisplayEvent::ScreenshotSaved { path });
+            }
+            Err(e) => {
+                error!("Failed to save screenshot {}: {}", path, e);
+                events::emit(DisplayEvent::ScreenshotFailed { path });
+            }
+        }
+    }
+}
+
+/// Queues a frame for encoding on the background worker
+///
+/// Blocks only while `ENCODE_QUEUE_SIZE` earlier screenshots are still waiting, which
+/// bounds the memory held by queued frames.
+///
+/// # Arguments
+/// * `frame` - The captured frame
+/// * `options` - The format and compression level
+/// * `path` - The destination file; its directory must exist
+///
+/// # Returns
+/// A `Result` indicating whether the frame was queued
+pub fn save_in_background(frame: Frame, options: EncodeOptions, path: PathBuf) -> Result<()> {
+    let encoder = match ENCODER.get() {
+        Some(encoder) => encoder,
+        None => {
+            let (tx, rx) = mpsc::sync_channel(ENCODE_QUEUE_SIZE);
+            thread::Builder::new()
+                .name("screenshot-encoder".to_string())
+                .spawn(move || run_encoder(rx))?;
+            // A concurrent first call may have won; its worker then serves both
+            ENCODER.get_or_init(|| tx)
+        }
+    };
+
+    encoder
+        .send(EncodeJob {
+            frame,
+            options,
+            path,
+        })
+        .map_err(|_| RegmsgError::SystemError("Screenshot encoder stopped".to_string()))
+}
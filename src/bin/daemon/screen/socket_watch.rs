@@ -0,0 +1,169 @@
+//! Compositor Socket Watch
+//!
+//! This module watches a socket path with inotify and reports when the file appears or
+//! disappears, e.g. the sway IPC socket created when sway starts and removed when it
+//! exits. The backend selection uses it to follow the compositor without checking the
+//! socket on every request.
+
+use std::ffi::CString;
+use std::mem;
+use std::os::fd::{AsRawFd, FromRawFd, OwnedFd};
+use std::os::unix::ffi::OsStrExt;
+use std::path::{Path, PathBuf};
+
+use crate::utils::error::{RegmsgError, Result};
+
+use tracing::{debug, error, info, warn};
+
+/// Directory events that can create or remove the watched file
+const WATCH_MASK: u32 = libc::IN_CREATE | libc::IN_DELETE | libc::IN_MOVED_FROM | libc::IN_MOVED_TO;
+
+/// Receive buffer size, room for many events with file names
+const EVENT_BUFFER_SIZE: usize = 4096;
+
+/// Size of the fixed part of an inotify event record
+const EVENT_HEADER_SIZE: usize = mem::size_of::<libc::inotify_event>();
+
+/// What a socket watch reports to its handler
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum WatchNotice {
+    /// The file may have been created or removed
+    Changed,
+    /// The watch ended, e.g. because its directory was removed; no further notices follow
+    Stopped,
+}
+
+/// Returns what a batch of inotify event records means for `name`
+///
+/// Records are a fixed `inotify_event` header followed by a NUL-padded file name of
+/// `len` bytes. A queue overflow also counts as a change, as events about `name` may
+/// have been lost. `IN_IGNORED` means the kernel dropped the watch, which stops it.
+///
+/// # Arguments
+/// * `buf` - The raw bytes read from the inotify descriptor
+/// * `name` - The file name within the watched directory
+///
+/// # Returns
+/// `Stopped` if the watch was removed, `Changed` if the file may have been created or
+/// removed, `None` otherwise
+pub fn parse_events(buf: &[u8], name: &[u8]) -> Option<WatchNotice> {
+    let mut offset = 0;
+    let mut relevant = None;
+    while offset + EVENT_HEADER_SIZE <= buf.len() {
+        let header = &buf[offset..offset + EVENT_HEADER_SIZE];
+        let mask = u32::from_ne_bytes(header[4..8].try_into().unwrap());
+        let len = u32::from_ne_bytes(header[12..16].try_into().unwrap()) as usize;
+
+        let start = offset + EVENT_HEADER_SIZE;
+        let end = (start + len).min(buf.len());
+        let event_name = buf[start..end].split(|&b| b == 0).next().unwrap_or(&[]);
+
+        if mask & libc::IN_IGNORED != 0 {
+            return Some(WatchNotice::Stopped);
+        }
+        if mask & libc::IN_Q_OVERFLOW != 0 || (mask & WATCH_MASK != 0 && event_name == name) {
+            relevant = Some(WatchNotice::Changed);
+        }
+        offset = start + len;
+    }
+    relevant
+}
+
+/// Opens an inotify descriptor watching the directory of `path`
+fn open_watch(path: &Path) -> Result<OwnedFd> {
+    let dir = match path.parent() {
+        Some(dir) if !dir.as_os_str().is_empty() => dir,
+        _ => Path::new("."),
+    };
+    let dir_name = CString::new(dir.as_os_str().as_bytes())
+        .map_err(|e| RegmsgError::InvalidArguments(format!("Invalid watch path: {}", e)))?;
+
+    let fd = unsafe { libc::inotify_init1(libc::IN_CLOEXEC) };
+    if fd < 0 {
+        return Err(RegmsgError::SystemError(format!(
+            "Failed to open inotify: {}",
+            std::io::Error::last_os_error()
+        )));
+    }
+    let inotify = unsafe { OwnedFd::from_raw_fd(fd) };
+
+    let wd = unsafe { libc::inotify_add_watch(inotify.as_raw_fd(), dir_name.as_ptr(), WATCH_MASK) };
+    if wd < 0 {
+        return Err(RegmsgError::SystemError(format!(
+            "Failed to watch {}: {}",
+            dir.display(),
+            std::io::Error::last_os_error()
+        )));
+    }
+
+    Ok(inotify)
+}
+
+/// Spawns a background thread that calls `handler` whenever `path` may have been
+/// created or removed.
+///
+/// The watch is registered before this function returns, so a caller checking the path
+/// afterwards cannot miss a change. The handler should check the path itself: events
+/// are coalesced and only say that it changed. If the directory is removed or reading
+/// fails, the handler gets `Stopped` and the thread exits.
+///
+/// # Arguments
+/// * `path` - The file to watch; its directory must exist
+/// * `handler` - Callback invoked after the file may have changed or the watch stopped
+///
+/// # Returns
+/// A `Result` indicating whether the watch could be started
+pub fn watch<F>(path: &Path, handler: F) -> Result<()>
+where
+    F: Fn(WatchNotice) + Send + 'static,
+{
+    let inotify = open_watch(path)?;
+    let path: PathBuf = path.to_path_buf();
+    let name = path
+        .file_name()
+        .map(|name| name.as_bytes().to_vec())
+        .ok_or_else(|| {
+            RegmsgError::InvalidArguments(format!("Invalid watch path: {}", path.display()))
+        })?;
+    info!("Watching {} with inotify", path.display());
+
+    std::thread::Builder::new()
+        .name("socket-watch".to_string())
+        .spawn(move || {
+            let mut buf = vec![0u8; EVENT_BUFFER_SIZE];
+            loop {
+                let len = unsafe {
+                    libc::read(
+                        inotify.as_raw_fd(),
+                        buf.as_mut_ptr() as *mut libc::c_void,
+                        buf.len(),
+                    )
+                };
+                if len < 0 {
+                    let err = std::io::Error::last_os_error();
+                    if err.kind() == std::io::ErrorKind::Interrupted {
+                        continue;
+                    }
+                    error!("Inotify read failed, stopping socket watch: {}", err);
+                    handler(WatchNotice::Stopped);
+                    break;
+                }
+
+                match parse_events(&buf[..len as usize], &name) {
+                    Some(WatchNotice::Changed) => {
+                        debug!("{} changed", path.display());
+                        handler(WatchNotice::Changed);
+                    }
+                    Some(WatchNotice::Stopped) => {
+                        warn!("Watch on {} removed, stopping socket watch", path.display());
+                        handler(WatchNotice::Stopped);
+                        break;
+                    }
+                    None => {}
+                }
+            }
+        })
+        .map_err(|e| RegmsgError::SystemError(format!("Failed to spawn watch thread: {}", e)))?;
+
+    Ok(())
+}
@@ -0,0 +1,196 @@
+//! DRM Uevent Monitor
+//!
+//! This module listens to kernel uevents on a `NETLINK_KOBJECT_UEVENT` socket and
+//! reports the ones coming from the `drm` subsystem (card nodes being added or removed,
+//! connector hotplug notifications). Backends use it to keep cached device state valid
+//! without rescanning `/dev/dri/` on every request.
+
+use std::mem;
+use std::os::fd::{AsRawFd, FromRawFd, OwnedFd};
+
+use crate::utils::error::{RegmsgError, Result};
+
+use tracing::{debug, error, info, warn};
+
+/// Kernel multicast group carrying uevents (group 2 is used by udevd re-broadcasts)
+const KERNEL_UEVENT_GROUP: u32 = 1;
+
+/// Receive buffer size, large enough for any single uevent message
+const UEVENT_BUFFER_SIZE: usize = 8192;
+
+/// A parsed uevent from the `drm` subsystem
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct DrmUevent {
+    /// Uevent action (e.g., "add", "remove", "change")
+    pub action: String,
+    /// Device node relative to `/dev` (e.g., "dri/card0"), if any
+    pub devname: Option<String>,
+    /// Whether the kernel flagged this event as a connector hotplug
+    pub hotplug: bool,
+}
+
+impl DrmUevent {
+    /// Returns true when a card node appeared or disappeared, meaning the
+    /// selected DRM device must be probed again.
+    pub fn is_device_change(&self) -> bool {
+        matches!(self.action.as_str(), "add" | "remove")
+            && self
+                .devname
+                .as_deref()
+                .map_or(false, |name| name.starts_with("dri/card"))
+    }
+}
+
+/// What the monitor reports to its handler
+#[derive(Debug)]
+pub enum UeventNotice<'a> {
+    /// A uevent from the `drm` subsystem
+    Event(&'a DrmUevent),
+    /// The socket buffer overflowed during a burst and uevents were dropped
+    Lost,
+    /// The socket failed and the monitor thread exited; no further notices follow
+    Stopped,
+}
+
+/// Parses a raw kernel uevent message.
+///
+/// Kernel messages have the form `ACTION@DEVPATH\0KEY=VALUE\0KEY=VALUE\0...`.
+/// Returns `None` for malformed messages and for any subsystem other than `drm`.
+///
+/// # Arguments
+/// * `buf` - The raw bytes received from the netlink socket
+///
+/// # Returns
+/// An `Option` containing the parsed `DrmUevent`
+pub fn parse_uevent(buf: &[u8]) -> Option<DrmUevent> {
+    let mut fields = buf.split(|&b| b == 0).filter(|f| !f.is_empty());
+
+    // The header must look like "action@devpath"; anything else (e.g., udevd's
+    // "libudev" binary header) is not a kernel message.
+    let header = fields.next()?;
+    if !header.contains(&b'@') {
+        return None;
+    }
+
+    let mut action = None;
+    let mut subsystem = None;
+    let mut devname = None;
+    let mut hotplug = false;
+
+    for field in fields {
+        let field = std::str::from_utf8(field).ok()?;
+        match field.split_once('=') {
+            Some(("ACTION", value)) => action = Some(value.to_string()),
+            Some(("SUBSYSTEM", value)) => subsystem = Some(value),
+            Some(("DEVNAME", value)) => devname = Some(value.to_string()),
+            Some(("HOTPLUG", value)) => hotplug = value == "1",
+            _ => {}
+        }
+    }
+
+    if subsystem != Some("drm") {
+        return None;
+    }
+
+    Some(DrmUevent {
+        action: action?,
+        devname,
+        hotplug,
+    })
+}
+
+/// Opens a netlink socket subscribed to kernel uevents.
+fn open_uevent_socket() -> Result<OwnedFd> {
+    let fd = unsafe {
+        libc::socket(
+            libc::AF_NETLINK,
+            libc::SOCK_DGRAM | libc::SOCK_CLOEXEC,
+            libc::NETLINK_KOBJECT_UEVENT,
+        )
+    };
+    if fd < 0 {
+        return Err(RegmsgError::SystemError(format!(
+            "Failed to open uevent socket: {}",
+            std::io::Error::last_os_error()
+        )));
+    }
+    let socket = unsafe { OwnedFd::from_raw_fd(fd) };
+
+    let mut addr: libc::sockaddr_nl = unsafe { mem::zeroed() };
+    addr.nl_family = libc::AF_NETLINK as libc::sa_family_t;
+    addr.nl_groups = KERNEL_UEVENT_GROUP;
+
+    let ret = unsafe {
+        libc::bind(
+            socket.as_raw_fd(),
+            &addr as *const libc::sockaddr_nl as *const libc::sockaddr,
+            mem::size_of::<libc::sockaddr_nl>() as libc::socklen_t,
+        )
+    };
+    if ret < 0 {
+        return Err(RegmsgError::SystemError(format!(
+            "Failed to bind uevent socket: {}",
+            std::io::Error::last_os_error()
+        )));
+    }
+
+    Ok(socket)
+}
+
+/// Spawns a background thread that calls `handler` for every DRM uevent.
+///
+/// The socket is opened before the thread starts so that permission problems are
+/// reported to the caller instead of being lost in the background. The handler is
+/// also told when uevents were dropped (`ENOBUFS` after a burst), after which any
+/// state derived from them must be reread, and when the monitor stops for good.
+///
+/// # Arguments
+/// * `handler` - Callback invoked with each notice
+///
+/// # Returns
+/// A `Result` indicating whether the monitor could be started
+pub fn watch_drm<F>(handler: F) -> Result<()>
+where
+    F: Fn(UeventNotice<'_>) + Send + 'static,
+{
+    let socket = open_uevent_socket()?;
+    info!("Listening for DRM uevents");
+
+    std::thread::Builder::new()
+        .name("drm-uevent".to_string())
+        .spawn(move || {
+            let mut buf = vec![0u8; UEVENT_BUFFER_SIZE];
+            loop {
+                let len = unsafe {
+                    libc::recv(
+                        socket.as_raw_fd(),
+                        buf.as_mut_ptr() as *mut libc::c_void,
+                        buf.len(),
+                        0,
+                    )
+                };
+                if len < 0 {
+                    let err = std::io::Error::last_os_error();
+                    if err.kind() == std::io::ErrorKind::Interrupted {
+                        continue;
+                    }
+                    if err.raw_os_error() == Some(libc::ENOBUFS) {
+                        warn!("Uevent socket overflowed, events were lost");
+                        handler(UeventNotice::Lost);
+                        continue;
+                    }
+                    error!("Uevent socket read failed, stopping monitor: {}", err);
+                    handler(UeventNotice::Stopped);
+                    break;
+                }
+
+                if let Some(event) = parse_uevent(&buf[..len as usize]) {
+                    debug!("DRM uevent: {:?}", event);
+                    handler(UeventNotice::Event(&event));
+                }
+            }
+        })
+        .map_err(|e| RegmsgError::SystemError(format!("Failed to spawn uevent thread: {}", e)))?;
+
+    Ok(())
+}
@@ -1,29 +1,116 @@
-use chrono::Local;
 use std::collections::HashMap;
-use std::fs;
+use std::fmt::Write;
+use std::io;
+use std::os::unix::net::UnixStream;
+use std::path::{Path, PathBuf};
 use std::process::Command;
-use swayipc::{Connection, Output};
+use std::sync::{Arc, Mutex, OnceLock};
+use std::time::Duration;
+use swayipc::{Connection, Event, EventStream, EventType, Input, Mode, Output};
 
+use crate::config;
 use crate::screen::backend::{
-    DisplayBackend, DisplayMode, DisplayOutput, ModeParams, RotationParams,
+    DisplayBackend, DisplayMode, DisplayOutput, ModeParams, ProfileChanges, RotationParams,
+    parse_max_resolution,
 };
+use crate::screen::cache::OutputCache;
+use crate::screen::mode_index::ModeIndex;
+use crate::screen::screenshot::Frame;
 use crate::utils::error::{RegmsgError, Result};
+use crate::utils::stats;
 
 use tracing::{debug, error, info, warn};
 
-/// Pre-processes a vector of outputs into a HashMap for efficient lookup by name.
-fn preprocess_outputs(outputs: Vec<Output>) -> HashMap<String, Output> {
+/// Delay between attempts to re-subscribe to sway events after losing the connection
+const RESUBSCRIBE_DELAY: Duration = Duration::from_secs(1);
+
+/// Returns the sway IPC socket: `$SWAYSOCK` when the daemon runs inside a sway
+/// session, the REG Linux default otherwise
+///
+/// The path is resolved once, so requests neither read nor modify the environment.
+pub fn sway_socket_path() -> &'static Path {
+    static PATH: OnceLock<PathBuf> = OnceLock::new();
+    PATH.get_or_init(|| {
+        std::env::var_os("SWAYSOCK")
+            .map(PathBuf::from)
+            .unwrap_or_else(|| PathBuf::from(config::DEFAULT_SWAYSOCK_PATH))
+    })
+}
+
+/// Pre-processes a list of outputs into a HashMap of positions for efficient lookup by name.
+fn preprocess_outputs(outputs: &[Output]) -> HashMap<String, usize> {
     outputs
-        .into_iter()
-        .map(|output| (output.name.clone(), output))
+        .iter()
+        .enumerate()
+        .map(|(index, output)| (output.name.clone(), index))
         .collect()
 }
 
-/// Converts a refresh rate from mHz to Hz if applicable.
+/// Outputs reported by sway, in compositor order and indexed by name
+struct OutputSnapshot {
+    outputs: Vec<Output>,
+    by_name: HashMap<String, usize>,
+    /// Name of every output, interned once for all output lists built from the snapshot
+    names: Vec<Arc<str>>,
+    /// Mode index of every output, in the order of `outputs`
+    mode_indexes: Vec<ModeIndex>,
+}
+
+impl OutputSnapshot {
+    fn new(outputs: Vec<Output>) -> Self {
+        let by_name = preprocess_outputs(&outputs);
+        let names = outputs
+            .iter()
+            .map(|output| Arc::from(output.name.as_str()))
+            .collect();
+        let mode_indexes = outputs
+            .iter()
+            .map(|output| {
+                ModeIndex::new(output.modes.iter().map(|mode| {
+                    (
+                        mode.width as u32,
+                        mode.height as u32,
+                        refresh_mhz(mode.refresh),
+                    )
+                }))
+            })
+            .collect();
+        Self {
+            outputs,
+            by_name,
+            names,
+            mode_indexes,
+        }
+    }
+
+    /// Looks up an output by name
+    fn get(&self, name: &str) -> Option<&Output> {
+        self.by_name.get(name).map(|&index| &self.outputs[index])
+    }
+
+    /// Looks up the mode index of an output by name
+    fn mode_index(&self, name: &str) -> Option<&ModeIndex> {
+        self.by_name
+            .get(name)
+            .map(|&index| &self.mode_indexes[index])
+    }
+}
+
+/// Normalizes a sway refresh rate to mHz; values below 1000 are taken as Hz
+fn refresh_mhz(refresh: i32) -> u32 {
+    let refresh = refresh.max(0) as u32;
+    if refresh >= 1000 {
+        refresh
+    } else {
+        refresh * 1000
+    }
+}
+
+/// Formats a sway refresh rate for an `output mode` command.
 fn format_refresh(refresh: i32) -> String {
     if refresh >= 1000 {
-        // Value is in mHz, convert to Hz by dividing by 1000
-        format!("{}", refresh / 1000)
+        // Value is in mHz; keep the fraction so that sway picks exactly this mode
+        format!("{}.{:03}", refresh / 1000, refresh % 1000)
     } else {
         // Value is already in Hz, append "Hz" unit
         format!("{}", refresh)
@@ -50,40 +137,25 @@ fn filter_outputs<'a>(
     })
 }
 
-/// Converts swayipc Output to our DisplayOutput
-fn convert_output_sway_to_internal(sway_output: &Output) -> DisplayOutput {
-    let modes = sway_output
-        .modes
-        .iter()
-        .map(|mode| DisplayMode {
-            width: mode.width as u32,
-            height: mode.height as u32,
-            refresh_rate: (mode.refresh as f32 / 1000.0).round() as u32, // Convert mHz to Hz
-            name: format!(
-                "{}x{}@{}Hz",
-                mode.width,
-                mode.height,
-                (mode.refresh as f32 / 1000.0).round() as u32
-            ),
-        })
-        .collect();
-
-    let current_mode = sway_output.current_mode.as_ref().map(|mode| DisplayMode {
-        width: mode.width as u32,
-        height: mode.height as u32,
-        refresh_rate: (mode.refresh as f32 / 1000.0).round() as u32, // Convert mHz to Hz
-        name: format!(
-            "{}x{}@{}Hz",
-            mode.width,
-            mode.height,
-            (mode.refresh as f32 / 1000.0).round() as u32
-        ),
-    });
+/// Converts a swayipc Mode to our DisplayMode
+fn to_display_mode(mode: &Mode) -> DisplayMode {
+    DisplayMode::new(
+        mode.width as u32,
+        mode.height as u32,
+        refresh_mhz(mode.refresh),
+    )
+}
 
+/// Converts swayipc Output to our DisplayOutput
+///
+/// # Arguments
+/// * `sway_output` - The output reported by sway
+/// * `name` - The interned name of the output
+fn convert_output_sway_to_internal(sway_output: &Output, name: &Arc<str>) -> DisplayOutput {
     DisplayOutput {
-        name: sway_output.name.clone(),
-        modes,
-        current_mode,
+        name: Arc::clone(name),
+        modes: sway_output.modes.iter().map(to_display_mode).collect(),
+        current_mode: sway_output.current_mode.as_ref().map(to_display_mode),
         is_connected: true, // swayipc doesn't have a direct connection status, assume connected
         rotation: match &sway_output.transform {
             Some(transform_str) => {
@@ -97,97 +169,293 @@ fn convert_output_sway_to_internal(sway_output: &Output) -> DisplayOutput {
             }
             None => 0,
         },
+        position: Some((sway_output.rect.x, sway_output.rect.y)),
+    }
+}
+
+/// Applies a liveness change to the backend snapshot and every registered cache
+fn notify_caches(
+    outputs: &OutputCache<OutputSnapshot>,
+    listeners: &Mutex<Vec<Arc<OutputCache>>>,
+    live: Option<bool>,
+) {
+    let listeners = listeners.lock().unwrap_or_else(|e| e.into_inner());
+    match live {
+        Some(live) => {
+            outputs.set_live(live);
+            listeners.iter().for_each(|cache| cache.set_live(live));
+        }
+        None => {
+            outputs.invalidate();
+            listeners.iter().for_each(|cache| cache.invalidate());
+        }
+    }
+}
+
+/// Opens a new connection to the sway IPC socket
+fn connect() -> Result<Connection> {
+    UnixStream::connect(sway_socket_path())
+        .map(Connection::from)
+        .map_err(|e| RegmsgError::BackendError {
+            backend: "Wayland".to_string(),
+            message: format!("Failed to connect to Wayland/Sway: {}", e),
+        })
+}
+
+/// Opens a dedicated connection subscribed to output and shutdown events
+fn subscribe_output_events() -> Result<EventStream> {
+    connect()?
+        .subscribe([EventType::Output, EventType::Shutdown])
+        .map_err(|e| RegmsgError::BackendError {
+            backend: "Wayland".to_string(),
+            message: format!("Failed to subscribe to sway events: {}", e),
+        })
+}
+
+/// Body of the `sway-events` thread
+///
+/// Output events invalidate the snapshots. When the stream ends (sway shut down or
+/// the socket failed) the snapshots stop being served until the subscription is back.
+fn run_subscriber(
+    initial: Option<EventStream>,
+    outputs: Arc<OutputCache<OutputSnapshot>>,
+    listeners: Arc<Mutex<Vec<Arc<OutputCache>>>>,
+) {
+    let mut events = initial;
+    loop {
+        let stream = match events.take() {
+            Some(stream) => stream,
+            None => match subscribe_output_events() {
+                Ok(stream) => {
+                    info!("Subscribed to sway output events");
+                    notify_caches(&outputs, &listeners, Some(true));
+                    stream
+                }
+                Err(e) => {
+                    debug!("Sway not available yet: {}", e);
+                    std::thread::sleep(RESUBSCRIBE_DELAY);
+                    continue;
+                }
+            },
+        };
+
+        for event in stream {
+            match event {
+                Ok(Event::Output(_)) => notify_caches(&outputs, &listeners, None),
+                Ok(Event::Shutdown(_)) => {
+                    info!("Sway is shutting down");
+                    break;
+                }
+                Ok(_) => {}
+                Err(e) => {
+                    warn!("Sway event stream failed: {}", e);
+                    break;
+                }
+            }
+        }
+
+        // Serve live queries until the subscription is back
+        notify_caches(&outputs, &listeners, Some(false));
+        std::thread::sleep(RESUBSCRIBE_DELAY);
+    }
+}
+
+/// Wraps a sway IPC error into a backend error
+fn sway_error(e: swayipc::Error) -> RegmsgError {
+    RegmsgError::BackendError {
+        backend: "Wayland".to_string(),
+        message: e.to_string(),
     }
 }
 
 /// Backend implementation for Wayland
-pub struct WaylandBackend;
+///
+/// A single IPC connection is kept open and shared by all requests. It is dropped
+/// and re-established when a request fails at the socket level, e.g. after sway
+/// restarted.
+///
+/// The output list is kept in memory and refreshed only after sway reports an
+/// output event, so queries don't pay for a `get_outputs` round-trip and JSON parse.
+pub struct WaylandBackend {
+    /// Long-lived IPC connection, opened on first use
+    connection: Mutex<Option<Connection>>,
+    /// Last output list read from sway, live while the event subscriber runs
+    outputs: Arc<OutputCache<OutputSnapshot>>,
+    /// Caches invalidated together with `outputs`
+    listeners: Arc<Mutex<Vec<Arc<OutputCache>>>>,
+    /// Whether the event subscriber thread started, set on first use
+    subscriber: OnceLock<bool>,
+}
 
 impl WaylandBackend {
     pub fn new() -> Self {
-        Self
+        Self {
+            connection: Mutex::new(None),
+            outputs: Arc::new(OutputCache::with_stats("sway.outputs")),
+            listeners: Arc::new(Mutex::new(Vec::new())),
+            subscriber: OnceLock::new(),
+        }
     }
 
-    /// Helper method to get sway connection
-    fn get_connection(&self) -> Result<Connection> {
-        Connection::new().map_err(|e| RegmsgError::BackendError {
-            backend: "Wayland".to_string(),
-            message: format!("Failed to connect to Wayland/Sway: {}", e),
+    /// Runs `request` on the shared connection, reconnecting once if the socket failed.
+    ///
+    /// # Arguments
+    /// * `request` - IPC request to run; it may be called twice
+    ///
+    /// # Returns
+    /// A `Result` containing the value returned by `request`
+    fn with_connection<T, F>(&self, mut request: F) -> Result<T>
+    where
+        F: FnMut(&mut Connection) -> swayipc::Fallible<T>,
+    {
+        let mut guard = self.connection.lock().unwrap_or_else(|e| e.into_inner());
+
+        let mut reconnected = false;
+        loop {
+            let connection = match guard.as_mut() {
+                Some(connection) => connection,
+                None => {
+                    reconnected = true;
+                    guard.insert(connect()?)
+                }
+            };
+
+            match request(connection) {
+                Ok(value) => return Ok(value),
+                Err(swayipc::Error::Io(e)) => {
+                    // The compositor went away or restarted; retry once on a new socket
+                    *guard = None;
+                    if reconnected {
+                        return Err(sway_error(swayipc::Error::Io(e)));
+                    }
+                    info!("Sway IPC connection lost ({}), reconnecting", e);
+                }
+                Err(e) => return Err(sway_error(e)),
+            }
+        }
+    }
+
+    /// Fetches the current outputs over the shared connection
+    fn get_outputs(&self) -> Result<Vec<Output>> {
+        stats::CALLS.time("sway.get_outputs", || {
+            self.with_connection(|connection| connection.get_outputs())
+        })
+    }
+
+    /// Fetches the input devices over the shared connection
+    fn get_inputs(&self) -> Result<Vec<Input>> {
+        stats::CALLS.time("sway.get_inputs", || {
+            self.with_connection(|connection| connection.get_inputs())
+        })
+    }
+
+    /// Runs per-output commands as a single `;`-separated sway command list
+    ///
+    /// sway executes the list in order within one IPC request and returns one reply
+    /// per command, so a multi-output change costs a single round-trip.
+    ///
+    /// # Arguments
+    /// * `commands` - Commands to run, in order; nothing is sent when empty
+    fn run_batch(&self, commands: &[String]) -> Result<()> {
+        if commands.is_empty() {
+            return Ok(());
+        }
+        self.run_command(&commands.join("; "))
+    }
+
+    /// Returns the output list, asking sway only after it reported a change
+    fn snapshot(&self) -> Result<Arc<OutputSnapshot>> {
+        self.start_subscriber();
+        self.outputs
+            .outputs(|| self.get_outputs().map(OutputSnapshot::new))
+    }
+
+    /// Starts the event subscriber on first use and returns whether it is running
+    ///
+    /// The first subscription is attempted synchronously so that the snapshot is live
+    /// right away; if sway is not up yet, the thread keeps retrying in the background.
+    fn start_subscriber(&self) -> bool {
+        *self.subscriber.get_or_init(|| {
+            let initial = match subscribe_output_events() {
+                Ok(stream) => {
+                    self.outputs.set_live(true);
+                    Some(stream)
+                }
+                Err(e) => {
+                    debug!("Sway events unavailable, retrying in background: {}", e);
+                    None
+                }
+            };
+
+            let outputs = Arc::clone(&self.outputs);
+            let listeners = Arc::clone(&self.listeners);
+            let spawned = std::thread::Builder::new()
+                .name("sway-events".to_string())
+                .spawn(move || run_subscriber(initial, outputs, listeners));
+
+            match spawned {
+                Ok(_) => true,
+                Err(e) => {
+                    error!("Failed to spawn sway event thread: {}", e);
+                    self.outputs.set_live(false);
+                    false
+                }
+            }
         })
     }
+
+    /// Runs a sway command over the shared connection and checks every reply
+    ///
+    /// The output snapshot is invalidated right away instead of waiting for the
+    /// output event, so a query issued just after a setter sees the new state.
+    ///
+    /// # Arguments
+    /// * `command` - One or more sway commands separated by `;` or `,`
+    fn run_command(&self, command: &str) -> Result<()> {
+        debug!("Running sway command: {}", command);
+        let replies = stats::CALLS.time("sway.run_command", || {
+            self.with_connection(|connection| connection.run_command(command))
+        });
+        self.outputs.invalidate();
+        for reply in replies? {
+            reply.map_err(sway_error)?;
+        }
+        Ok(())
+    }
 }
 
 impl DisplayBackend for WaylandBackend {
     fn list_outputs(&self) -> Result<Vec<DisplayOutput>> {
-        let mut connection = self.get_connection()?;
-        let outputs: Vec<Output> =
-            connection
-                .get_outputs()
-                .map_err(|e| RegmsgError::BackendError {
-                    backend: "Wayland".to_string(),
-                    message: e.to_string(),
-                })?;
+        let snapshot = self.snapshot()?;
+        let outputs = &snapshot.outputs;
 
         let internal_outputs = outputs
             .iter()
-            .map(convert_output_sway_to_internal)
+            .zip(&snapshot.names)
+            .map(|(output, name)| convert_output_sway_to_internal(output, name))
             .collect();
 
         Ok(internal_outputs)
     }
 
     fn list_modes(&self, screen: Option<&str>) -> Result<Vec<DisplayMode>> {
-        let mut connection = self.get_connection()?;
-        let outputs: Vec<Output> =
-            connection
-                .get_outputs()
-                .map_err(|e| RegmsgError::BackendError {
-                    backend: "Wayland".to_string(),
-                    message: e.to_string(),
-                })?;
+        let snapshot = self.snapshot()?;
+        let outputs = &snapshot.outputs;
 
         let all_modes: Vec<DisplayMode> = filter_outputs(&outputs, screen)
-            .flat_map(|output| {
-                output.modes.iter().map(|mode| DisplayMode {
-                    width: mode.width as u32,
-                    height: mode.height as u32,
-                    refresh_rate: (mode.refresh as f32 / 1000.0).round() as u32, // Convert mHz to Hz
-                    name: format!(
-                        "{}x{}@{}Hz",
-                        mode.width,
-                        mode.height,
-                        (mode.refresh as f32 / 1000.0).round() as u32
-                    ),
-                })
-            })
+            .flat_map(|output| output.modes.iter().map(to_display_mode))
             .collect();
 
         Ok(all_modes)
     }
 
     fn current_mode(&self, screen: Option<&str>) -> Result<DisplayMode> {
-        let mut connection = self.get_connection()?;
-        let outputs: Vec<Output> =
-            connection
-                .get_outputs()
-                .map_err(|e| RegmsgError::BackendError {
-                    backend: "Wayland".to_string(),
-                    message: e.to_string(),
-                })?;
+        let snapshot = self.snapshot()?;
+        let outputs = &snapshot.outputs;
 
         for output in filter_outputs(&outputs, screen) {
             if let Some(current_mode) = &output.current_mode {
-                return Ok(DisplayMode {
-                    width: current_mode.width as u32,
-                    height: current_mode.height as u32,
-                    refresh_rate: (current_mode.refresh as f32 / 1000.0).round() as u32, // Convert mHz to Hz
-                    name: format!(
-                        "{}x{}@{}Hz",
-                        current_mode.width,
-                        current_mode.height,
-                        (current_mode.refresh as f32 / 1000.0).round() as u32
-                    ),
-                });
+                return Ok(to_display_mode(current_mode));
             }
         }
 
@@ -201,18 +469,12 @@ impl DisplayBackend for WaylandBackend {
 
     fn current_refresh_rate(&self, screen: Option<&str>) -> Result<u32> {
         let mode = self.current_mode(screen)?;
-        Ok(mode.refresh_rate)
+        Ok(mode.refresh_rate())
     }
 
     fn current_rotation(&self, screen: Option<&str>) -> Result<u32> {
-        let mut connection = self.get_connection()?;
-        let outputs: Vec<Output> =
-            connection
-                .get_outputs()
-                .map_err(|e| RegmsgError::BackendError {
-                    backend: "Wayland".to_string(),
-                    message: e.to_string(),
-                })?;
+        let snapshot = self.snapshot()?;
+        let outputs = &snapshot.outputs;
 
         for output in filter_outputs(&outputs, screen) {
             match &output.transform {
@@ -233,22 +495,13 @@ impl DisplayBackend for WaylandBackend {
     }
 
     fn set_mode(&self, screen: Option<&str>, mode: &ModeParams) -> Result<()> {
-        let mut connection = self.get_connection()?;
-        let outputs = connection
-            .get_outputs()
-            .map_err(|e| RegmsgError::BackendError {
-                backend: "Wayland".to_string(),
-                message: e.to_string(),
-            })?;
-
-        // Pre-process outputs into a HashMap for efficient lookup
-        let outputs_map = preprocess_outputs(outputs);
+        let snapshot = self.snapshot()?;
 
         // Determine target outputs based on the screen argument
         let target_outputs: Vec<&Output> = match screen {
             Some(screen_name) => {
                 // If a specific screen is provided, look it up directly in the map
-                if let Some(output) = outputs_map.get(screen_name) {
+                if let Some(output) = snapshot.get(screen_name) {
                     vec![output]
                 } else {
                     // Screen not found, return an error
@@ -260,58 +513,54 @@ impl DisplayBackend for WaylandBackend {
             }
             None => {
                 // No screen specified, target all outputs
-                outputs_map.values().collect()
+                snapshot.outputs.iter().collect()
             }
         };
 
-        let mut any_success = false;
+        // Build one command per output and send them together
+        let mut commands = Vec::new();
+        let mut applied = Vec::new();
 
         for output in target_outputs {
-            // Check if the requested mode exists among available modes
-            let mode_exists = output
-                .modes
-                .iter()
-                .any(|m| m.width == mode.width as i32 && m.height == mode.height as i32);
+            // Find the mode with the requested resolution and a refresh rate within 1 Hz
+            let target = snapshot
+                .mode_index(&output.name)
+                .and_then(|index| index.nearest(mode.width, mode.height, mode.refresh_rate))
+                .map(|position| &output.modes[position]);
 
-            if !mode_exists {
+            let Some(target) = target else {
                 // Mode not available, log a warning and skip this output
                 warn!(
                     "Mode {}x{}@{}Hz is not available for output '{}'",
                     mode.width, mode.height, mode.refresh_rate, output.name
                 );
                 continue;
-            }
+            };
 
             // Construct the IPC command to set the mode
-            let command = format!(
+            commands.push(format!(
                 "output {} mode {}x{}@{}Hz",
-                output.name, mode.width, mode.height, mode.refresh_rate
-            );
-
-            // Execute the command and handle replies
-            let replies =
-                connection
-                    .run_command(&command)
-                    .map_err(|e| RegmsgError::BackendError {
-                        backend: "Wayland".to_string(),
-                        message: e.to_string(),
-                    })?;
-
-            for reply in replies {
-                reply.map_err(|e| RegmsgError::BackendError {
-                    backend: "Wayland".to_string(),
-                    message: e.to_string(),
-                })?;
-            }
+                output.name,
+                target.width,
+                target.height,
+                format_refresh(target.refresh)
+            ));
+            applied.push((&output.name, target));
+        }
 
+        // Execute all commands in one request and handle replies
+        self.run_batch(&commands)?;
+        for (name, target) in &applied {
             info!(
                 "Mode set to {}x{}@{}Hz for output '{}'",
-                mode.width, mode.height, mode.refresh_rate, output.name
+                target.width,
+                target.height,
+                format_refresh(target.refresh),
+                name
             );
-            any_success = true;
         }
 
-        if !any_success && screen.is_some() {
+        if applied.is_empty() && screen.is_some() {
             return Err(RegmsgError::BackendError {
                 backend: "Wayland".to_string(),
                 message: format!(
@@ -325,14 +574,8 @@ impl DisplayBackend for WaylandBackend {
     }
 
     fn set_rotation(&self, screen: Option<&str>, rotation: &RotationParams) -> Result<()> {
-        let mut connection = self.get_connection()?;
-        let outputs: Vec<Output> =
-            connection
-                .get_outputs()
-                .map_err(|e| RegmsgError::BackendError {
-                    backend: "Wayland".to_string(),
-                    message: e.to_string(),
-                })?;
+        let snapshot = self.snapshot()?;
+        let outputs = &snapshot.outputs;
 
         // Validate rotation value
         if ![0, 90, 180, 270].contains(&rotation.rotation) {
@@ -341,24 +584,15 @@ impl DisplayBackend for WaylandBackend {
             ));
         }
 
-        // Iterate over filtered outputs
-        for output in filter_outputs(&outputs, screen) {
-            // Construct and execute the IPC command to set rotation
-            let command = format!("output {} transform {}", output.name, rotation.rotation);
-            let replies =
-                connection
-                    .run_command(&command)
-                    .map_err(|e| RegmsgError::BackendError {
-                        backend: "Wayland".to_string(),
-                        message: e.to_string(),
-                    })?;
-
-            for reply in replies {
-                reply.map_err(|e| RegmsgError::BackendError {
-                    backend: "Wayland".to_string(),
-                    message: e.to_string(),
-                })?;
-            }
+        // Rotate all filtered outputs in one request
+        let targets: Vec<&Output> = filter_outputs(&outputs, screen).collect();
+        let commands: Vec<String> = targets
+            .iter()
+            .map(|output| format!("output {} transform {}", output.name, rotation.rotation))
+            .collect();
+        self.run_batch(&commands)?;
+
+        for output in targets {
             info!(
                 "Rotation set to '{}' for output '{}'",
                 rotation.rotation, output.name
@@ -373,42 +607,12 @@ impl DisplayBackend for WaylandBackend {
         screen: Option<&str>,
         max_resolution: Option<&str>,
     ) -> Result<()> {
-        let (max_width, max_height) = match max_resolution {
-            Some(res) => {
-                let parts: Vec<&str> = res.split('x').collect();
-                if parts.len() != 2 {
-                    return Err(RegmsgError::InvalidArguments(format!(
-                        "Invalid resolution format: '{}'. Expected 'WxH'",
-                        res
-                    )));
-                }
-                let width = parts[0].parse::<u32>().map_err(|e| {
-                    RegmsgError::ParseError(format!("Failed to parse width: {}", e))
-                })?;
-                let height = parts[1].parse::<u32>().map_err(|e| {
-                    RegmsgError::ParseError(format!("Failed to parse height: {}", e))
-                })?;
-                if width == 0 || height == 0 {
-                    return Err(RegmsgError::InvalidArguments(format!(
-                        "Resolution dimensions must be positive: {}x{}",
-                        width, height
-                    )));
-                }
-                (width, height)
-            }
-            None => (1920, 1080),
-        };
+        let (max_width, max_height) = parse_max_resolution(max_resolution)?;
 
         let max_area = max_width * max_height;
 
-        let mut connection = self.get_connection()?;
-        let outputs: Vec<Output> =
-            connection
-                .get_outputs()
-                .map_err(|e| RegmsgError::BackendError {
-                    backend: "Wayland".to_string(),
-                    message: e.to_string(),
-                })?;
+        let snapshot = self.snapshot()?;
+        let outputs = &snapshot.outputs;
 
         // Determine target output (specified screen or all outputs if no screen specified)
         let target_outputs: Vec<&Output> = match screen {
@@ -419,7 +623,9 @@ impl DisplayBackend for WaylandBackend {
             None => outputs.iter().collect(),
         };
 
-        let mut any_success = false;
+        // Collect the mode change of every output and send them together
+        let mut commands = Vec::new();
+        let mut applied = Vec::new();
 
         for output in target_outputs {
             // Check if current resolution exceeds the max allowed resolution
@@ -463,46 +669,22 @@ impl DisplayBackend for WaylandBackend {
                 );
             }
 
-            // Find the best mode within the specified limits
-            let best_mode = output
-                .modes
-                .iter()
-                .filter(|mode| mode.width as u32 <= max_width && mode.height as u32 <= max_height)
-                .max_by_key(|mode| {
-                    (mode.width * mode.height) * if mode.refresh > 0 { mode.refresh } else { 1 }
-                }); // Prioritize higher resolution and refresh rate
+            // Find the best mode within the specified limits, preferring the higher
+            // refresh rate among modes of the same size
+            let best_mode = snapshot
+                .mode_index(&output.name)
+                .and_then(|index| index.best_within(max_width, max_height))
+                .map(|position| &output.modes[position]);
 
             if let Some(mode) = best_mode {
-                let command = format!(
+                commands.push(format!(
                     "output {} mode {}x{}@{}Hz",
                     output.name,
                     mode.width,
                     mode.height,
                     format_refresh(mode.refresh)
-                );
-
-                let replies =
-                    connection
-                        .run_command(&command)
-                        .map_err(|e| RegmsgError::BackendError {
-                            backend: "Wayland".to_string(),
-                            message: e.to_string(),
-                        })?;
-
-                for reply in replies {
-                    reply.map_err(|e| RegmsgError::BackendError {
-                        backend: "Wayland".to_string(),
-                        message: e.to_string(),
-                    })?;
-                }
-                info!(
-                    "Resolution set to {}x{}@{}Hz for output '{}'",
-                    mode.width,
-                    mode.height,
-                    format_refresh(mode.refresh),
-                    output.name
-                );
-                any_success = true;
+                ));
+                applied.push((&output.name, mode));
             } else {
                 warn!(
                     "No suitable resolution found within {}x{} limits for output '{}'.",
@@ -511,7 +693,18 @@ impl DisplayBackend for WaylandBackend {
             }
         }
 
-        if !any_success && screen.is_some() {
+        self.run_batch(&commands)?;
+        for (name, mode) in &applied {
+            info!(
+                "Resolution set to {}x{}@{}Hz for output '{}'",
+                mode.width,
+                mode.height,
+                format_refresh(mode.refresh),
+                name
+            );
+        }
+
+        if applied.is_empty() && screen.is_some() {
             return Err(RegmsgError::NotFound(format!(
                 "No suitable resolution found within {}x{} limits for specified screen",
                 max_width, max_height
@@ -521,29 +714,11 @@ impl DisplayBackend for WaylandBackend {
         Ok(())
     }
 
-    fn take_screenshot(&self, screenshot_dir: &str) -> Result<String> {
+    fn capture_frame(&self) -> Result<Frame> {
         info!("Capturing screenshot.");
 
-        // Check if `grim` is available
-        if !Command::new("grim")
-            .output()
-            .map_err(|e| RegmsgError::SystemError(e.to_string()))?
-            .status
-            .success()
-        {
-            return Err(RegmsgError::SystemError(
-                "grim is not installed or unavailable".to_string(),
-            ));
-        }
-
-        let mut connection = self.get_connection()?;
-        let outputs: Vec<Output> =
-            connection
-                .get_outputs()
-                .map_err(|e| RegmsgError::BackendError {
-                    backend: "Wayland".to_string(),
-                    message: e.to_string(),
-                })?;
+        let snapshot = self.snapshot()?;
+        let outputs = &snapshot.outputs;
 
         // Find the active output
         let output_name = outputs
@@ -552,23 +727,22 @@ impl DisplayBackend for WaylandBackend {
             .map(|output| &output.name)
             .ok_or_else(|| RegmsgError::NotFound("No active output found".to_string()))?;
 
-        // Ensure screenshot directory exists
-        fs::create_dir_all(screenshot_dir).map_err(|e| RegmsgError::SystemError(e.to_string()))?;
-
-        // Generate timestamped filename
-        let file_name = format!(
-            "{}/screenshot-{}.png",
-            screenshot_dir,
-            Local::now().format("%Y.%m.%d-%Hh%M.%S")
-        );
-
-        // Execute `grim` to capture the screenshot
-        let grim_output = Command::new("grim")
-            .arg("-o")
-            .arg(output_name)
-            .arg(&file_name)
-            .output()
-            .map_err(|e| RegmsgError::SystemError(e.to_string()))?;
+        // Execute `grim` once, reading an uncompressed PPM from its stdout; a missing
+        // binary surfaces as a spawn error
+        let grim_output = stats::CALLS
+            .time("spawn.grim", || {
+                Command::new("grim")
+                    .args(["-t", "ppm", "-o"])
+                    .arg(output_name)
+                    .arg("-")
+                    .output()
+            })
+            .map_err(|e| match e.kind() {
+                io::ErrorKind::NotFound => {
+                    RegmsgError::SystemError("grim is not installed or unavailable".to_string())
+                }
+                _ => RegmsgError::SystemError(e.to_string()),
+            })?;
 
         if !grim_output.status.success() {
             let error_message = String::from_utf8_lossy(&grim_output.stderr);
@@ -578,20 +752,12 @@ impl DisplayBackend for WaylandBackend {
                 error_message
             )));
         }
-        info!("Screenshot saved in: {}", file_name);
-        Ok(file_name)
+        Frame::from_ppm(&grim_output.stdout)
     }
 
     fn map_touchscreen(&self) -> Result<()> {
-        let mut connection = self.get_connection()?;
-
         // Get list of input devices
-        let inputs = connection
-            .get_inputs()
-            .map_err(|e| RegmsgError::BackendError {
-                backend: "Wayland".to_string(),
-                message: e.to_string(),
-            })?;
+        let inputs = self.get_inputs()?;
 
         // Find touchscreen device
         let touchscreen = inputs
@@ -609,12 +775,8 @@ impl DisplayBackend for WaylandBackend {
         };
 
         // Get list of outputs
-        let outputs = connection
-            .get_outputs()
-            .map_err(|e| RegmsgError::BackendError {
-                backend: "Wayland".to_string(),
-                message: e.to_string(),
-            })?;
+        let snapshot = self.snapshot()?;
+        let outputs = &snapshot.outputs;
 
         // Find focused output
         let focused_output = outputs
@@ -631,19 +793,7 @@ impl DisplayBackend for WaylandBackend {
 
         // Construct and execute IPC command to map touchscreen
         let command = format!("input {} map_to_output {}", touchscreen_id, output_name);
-        let replies = connection
-            .run_command(&command)
-            .map_err(|e| RegmsgError::BackendError {
-                backend: "Wayland".to_string(),
-                message: e.to_string(),
-            })?;
-
-        for reply in replies {
-            reply.map_err(|e| RegmsgError::BackendError {
-                backend: "Wayland".to_string(),
-                message: e.to_string(),
-            })?;
-        }
+        self.run_command(&command)?;
 
         info!(
             "Mapped touchscreen '{}' to output '{}'",
@@ -652,7 +802,73 @@ impl DisplayBackend for WaylandBackend {
         Ok(())
     }
 
+    fn apply_profile(&self, changes: &ProfileChanges) -> Result<()> {
+        // One `output` command per output carrying all its settings, so sway applies
+        // each output configuration once, and one command list for the whole layout
+        let mut commands = Vec::new();
+        for change in &changes.outputs {
+            let mut command = format!("output {}", change.output);
+            if let Some(mode) = change.mode {
+                let _ = write!(
+                    command,
+                    " mode {}x{}@{}Hz",
+                    mode.width,
+                    mode.height,
+                    format_refresh(mode.refresh_mhz as i32)
+                );
+            }
+            if let Some(rotation) = change.rotation {
+                let _ = write!(command, " transform {}", rotation);
+            }
+            if let Some((x, y)) = change.position {
+                let _ = write!(command, " pos {} {}", x, y);
+            }
+            commands.push(command);
+        }
+
+        if let Some(output) = &changes.touchscreen {
+            let inputs = self.get_inputs()?;
+            let touchscreens: Vec<&Input> = inputs
+                .iter()
+                .filter(|input| input.input_type == "touch")
+                .collect();
+            if touchscreens.is_empty() {
+                return Err(RegmsgError::NotFound(
+                    "No touchscreen device found".to_string(),
+                ));
+            }
+            for input in touchscreens {
+                commands.push(format!(
+                    "input {} map_to_output {}",
+                    input.identifier, output
+                ));
+            }
+        }
+
+        self.run_batch(&commands)?;
+        info!(
+            "Display profile applied with {} sway commands",
+            commands.len()
+        );
+        Ok(())
+    }
+
     fn backend_name(&self) -> &'static str {
         "Wayland"
     }
+
+    fn watch_changes(&self, cache: Arc<OutputCache>) -> Result<()> {
+        if !self.start_subscriber() {
+            return Err(RegmsgError::BackendError {
+                backend: "Wayland".to_string(),
+                message: "Sway event subscriber unavailable".to_string(),
+            });
+        }
+
+        let mut listeners = self.listeners.lock().unwrap_or_else(|e| e.into_inner());
+        cache.set_live(self.outputs.is_live());
+        listeners.push(cache);
+        info!("Display cache enabled with sway output event invalidation");
+        Ok(())
+    }
 }
@@ -0,0 +1,124 @@
+//! Setter Coalescing
+//!
+//! A UI scrolling through display modes sends a burst of `setMode` requests, and every
+//! applied request reconfigures the compositor or resyncs the display. Setters
+//! therefore wait a short window before being dispatched: a request for the same target
+//! arriving meanwhile supersedes the waiting one, so a burst only applies its last
+//! request. Setters are applied one at a time, and a request superseded while waiting
+//! for an earlier one to finish is dropped as well.
+//!
+//! Waiting happens on the executor, before a command takes a blocking pool slot, and a
+//! superseded request answers with the result of the request that replaced it.
+
+use futures::channel::oneshot;
+use std::collections::HashMap;
+use std::future::Future;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Mutex, MutexGuard};
+use std::time::Duration;
+
+/// Requests for one target
+struct Target<T> {
+    /// Newest request
+    ticket: u64,
+    /// Superseded requests waiting for the result of the newest one
+    waiters: Vec<oneshot::Sender<T>>,
+    /// Last request that completed and its result
+    done: Option<(u64, T)>,
+}
+
+/// Serializes setters and drops the ones superseded within the window
+pub struct Coalescer<T> {
+    window: Duration,
+    /// Ticket source, increasing with every request
+    next: AtomicU64,
+    /// Requests by target key
+    targets: Mutex<HashMap<String, Target<T>>>,
+    /// Held while a setter is applied
+    apply: futures::lock::Mutex<()>,
+}
+
+impl<T: Clone> Coalescer<T> {
+    /// Creates a coalescer waiting `window` before applying a request
+    pub fn new(window: Duration) -> Self {
+        Self {
+            window,
+            next: AtomicU64::new(0),
+            targets: Mutex::new(HashMap::new()),
+            apply: futures::lock::Mutex::new(()),
+        }
+    }
+
+    fn targets(&self) -> MutexGuard<'_, HashMap<String, Target<T>>> {
+        self.targets.lock().unwrap_or_else(|e| e.into_inner())
+    }
+
+    /// Queues for the result of the newer request that took the place of `ticket`
+    ///
+    /// # Returns
+    /// The receiver of that result, or `None` if `ticket` is still the newest request
+    fn superseded(&self, key: &str, ticket: u64) -> Option<oneshot::Receiver<T>> {
+        let mut targets = self.targets();
+        let target = targets
+            .get_mut(key)
+            .filter(|target| target.ticket != ticket)?;
+        let (tx, rx) = oneshot::channel();
+        match &target.done {
+            Some((done, result)) if *done == target.ticket => {
+                let _ = tx.send(result.clone());
+            }
+            _ => target.waiters.push(tx),
+        }
+        Some(rx)
+    }
+
+    /// Runs `apply` unless a newer request for `key` arrives before its turn
+    ///
+    /// # Arguments
+    /// * `key` - The target of the setter; requests for different keys do not replace
+    ///   each other
+    /// * `apply` - The setter
+    ///
+    /// # Returns
+    /// The result of `apply`, or of the newest request for `key` if this one was
+    /// superseded; `None` if that request never completed
+    pub async fn run(&self, key: &str, apply: impl Future<Output = T>) -> Option<T> {
+        let ticket = self.next.fetch_add(1, Ordering::Relaxed);
+        self.targets()
+            .entry(key.to_string())
+            .or_insert_with(|| Target {
+                ticket,
+                waiters: Vec::new(),
+                done: None,
+            })
+            .ticket = ticket;
+
+        if !self.window.is_zero() {
+            async_std::task::sleep(self.window).await;
+        }
+        if let Some(newest) = self.superseded(key, ticket) {
+            return newest.await.ok();
+        }
+
+        let turn = self.apply.lock().await;
+        if let Some(newest) = self.superseded(key, ticket) {
+            drop(turn);
+            return newest.await.ok();
+        }
+        let result = apply.await;
+        drop(turn);
+
+        // Answer the requests this one replaced, unless a newer one took them over
+        let waiters = match self.targets().get_mut(key) {
+            Some(target) if target.ticket == ticket => {
+                target.done = Some((ticket, result.clone()));
+                std::mem::take(&mut target.waiters)
+            }
+            _ => Vec::new(),
+        };
+        for waiter in waiters {
+            let _ = waiter.send(result.clone());
+        }
+        Some(result)
+    }
+}
@@ -4,9 +4,16 @@
 //! It allows dynamic registration of commands with different argument patterns and execution behaviors.
 //! The system includes specialized command handlers for different use cases like screen management.
 
+use crate::utils::stats;
+use serde::Serialize;
+use smallvec::SmallVec;
 use std::collections::HashMap;
 use std::fmt;
-use tracing::{debug, info, warn};
+use std::sync::{Arc, OnceLock};
+use tracing::{debug, warn};
+
+/// Command line parts kept on the stack while dispatching
+const INLINE_ARGS: usize = 8;
 
 /// Result type for command execution
 ///
@@ -42,6 +49,60 @@ impl fmt::Display for CommandError {
 
 impl std::error::Error for CommandError {}
 
+/// Format of a command reply
+///
+/// Clients select it by prefixing the command line with `--format <name>`, e.g.
+/// `--format json listModes HDMI-1`.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum OutputFormat {
+    /// Human-readable text, as printed by the CLI (default)
+    Text,
+    /// The backend structures serialized as JSON
+    Json,
+}
+
+impl OutputFormat {
+    /// Option selecting the reply format in front of a command line
+    pub const OPTION: &'static str = "--format";
+
+    /// Parses a format name
+    ///
+    /// # Arguments
+    /// * `name` - The format name ("text" or "json")
+    ///
+    /// # Returns
+    /// * `Result<OutputFormat, CommandError>` - The format, or an error for unknown names
+    pub fn parse(name: &str) -> Result<Self, CommandError> {
+        match name {
+            "text" => Ok(OutputFormat::Text),
+            "json" => Ok(OutputFormat::Json),
+            _ => Err(CommandError::InvalidArguments(format!(
+                "Unsupported format: '{}'. Valid options are: text, json",
+                name
+            ))),
+        }
+    }
+
+    /// Splits a leading `--format <name>` option off the parts of a command line
+    ///
+    /// # Arguments
+    /// * `parts` - The whitespace-separated parts of the command line
+    ///
+    /// # Returns
+    /// * `Result<(OutputFormat, &[&str]), CommandError>` - The format and the remaining parts
+    pub fn split_option<'a, 'b>(
+        parts: &'a [&'b str],
+    ) -> Result<(Self, &'a [&'b str]), CommandError> {
+        match parts {
+            [option, name, rest @ ..] if *option == Self::OPTION => Ok((Self::parse(name)?, rest)),
+            [option] if *option == Self::OPTION => Err(CommandError::InvalidArguments(
+                "Missing format name".to_string(),
+            )),
+            _ => Ok((OutputFormat::Text, parts)),
+        }
+    }
+}
+
 /// Trait for command handlers
 ///
 /// Defines the interface that all command handlers must implement to be registered
@@ -57,6 +118,20 @@ pub trait CommandHandler: Send + Sync {
     /// * `CommandResult` - The result of command execution
     fn execute(&self, args: &[&str]) -> CommandResult;
 
+    /// Execute the command and serialize its result as JSON
+    ///
+    /// Handlers without a structured result reply with their text result as a JSON string.
+    ///
+    /// # Arguments
+    /// * `args` - A slice of string arguments to pass to the command
+    ///
+    /// # Returns
+    /// * `CommandResult` - The JSON document, or the error of command execution
+    fn execute_json(&self, args: &[&str]) -> CommandResult {
+        let text = self.execute(args)?;
+        serde_json::to_string(&text).map_err(|e| CommandError::ExecutionError(Box::new(e)))
+    }
+
     /// Get command description
     ///
     /// # Returns
@@ -70,6 +145,20 @@ pub trait CommandHandler: Send + Sync {
     fn expected_args(&self) -> Option<usize> {
         None
     }
+
+    /// Get the target of a setter whose requests replace each other
+    ///
+    /// Requests with the same key arriving in a burst are applied once, see the
+    /// `coalesce` module.
+    ///
+    /// # Arguments
+    /// * `args` - A slice of string arguments passed to the command
+    ///
+    /// # Returns
+    /// * `Option<String>` - The target key, or None if the command is not coalesced
+    fn coalesce_key(&self, _args: &[&str]) -> Option<String> {
+        None
+    }
 }
 
 /// Command registry for dynamic command management
@@ -99,7 +188,7 @@ impl CommandRegistry {
     /// * `handler` - The command handler to register
     pub fn register<S: Into<String>>(&mut self, name: S, handler: Box<dyn CommandHandler>) {
         let name = name.into();
-        info!("Registering command: {}", name);
+        debug!("Registering command: {}", name);
         self.commands.insert(name, handler);
     }
 
@@ -116,7 +205,8 @@ impl CommandRegistry {
     pub fn handle(&self, cmdline: &str) -> CommandResult {
         debug!("Handling command: '{}'", cmdline);
 
-        let parts: Vec<&str> = cmdline.split_whitespace().collect();
+        let parts: SmallVec<[&str; INLINE_ARGS]> = cmdline.split_whitespace().collect();
+        let (format, parts) = OutputFormat::split_option(&parts)?;
         if parts.is_empty() {
             warn!("Received empty command");
             return Err(CommandError::EmptyCommand);
@@ -138,8 +228,11 @@ impl CommandRegistry {
                     }
                 }
 
-                info!("Executing command: {} with {} args", cmd, args.len());
-                handler.execute(args)
+                debug!("Executing command: {} with {} args", cmd, args.len());
+                stats::COMMANDS.time(cmd, || match format {
+                    OutputFormat::Text => handler.execute(args),
+                    OutputFormat::Json => handler.execute_json(args),
+                })
             }
             None => {
                 warn!("Unknown command: {}", cmd);
@@ -148,19 +241,160 @@ impl CommandRegistry {
         }
     }
 
-    /// List all registered commands with descriptions
+    /// Get the coalescing key of a command line, see `CommandHandler::coalesce_key`
+    ///
+    /// Requests only replace requests asking for the same reply format.
+    ///
+    /// # Arguments
+    /// * `cmdline` - The command line string
+    ///
+    /// # Returns
+    /// * `Option<String>` - The key, or None for commands that are not coalesced
+    pub fn coalesce_key(&self, cmdline: &str) -> Option<String> {
+        let parts: SmallVec<[&str; INLINE_ARGS]> = cmdline.split_whitespace().collect();
+        let (format, parts) = OutputFormat::split_option(&parts).ok()?;
+        let (cmd, args) = parts.split_first()?;
+        let key = self.commands.get(*cmd)?.coalesce_key(args)?;
+        Some(format!("{:?}:{}", format, key))
+    }
+
+    /// Handle a batch of command lines
+    ///
+    /// Commands run in order on the calling thread, so a setter in the batch is
+    /// visible to the queries that follow it. A failing command does not stop the batch.
+    ///
+    /// # Arguments
+    /// * `cmdlines` - The command lines to execute
+    ///
+    /// # Returns
+    /// * `impl Iterator<Item = CommandResult>` - One result per command line, in the same
+    ///   order; each command runs when its result is taken
+    pub fn handle_batch<'a, S: AsRef<str>>(
+        &'a self,
+        cmdlines: &'a [S],
+    ) -> impl Iterator<Item = CommandResult> + 'a {
+        debug!("Handling batch of {} commands", cmdlines.len());
+        cmdlines.iter().map(|cmdline| self.handle(cmdline.as_ref()))
+    }
+
+    /// Get the number of registered commands
     ///
     /// # Returns
-    /// * `String` - A formatted string listing all registered commands and their descriptions
-    pub fn list_commands(&self) -> String {
-        let mut commands: Vec<_> = self.commands.iter().collect();
-        commands.sort_by_key(|(name, _)| *name);
+    /// * `usize` - The number of registered commands
+    pub fn len(&self) -> usize {
+        self.commands.len()
+    }
 
-        commands
+    /// Build the catalogue of all registered commands
+    ///
+    /// # Returns
+    /// * `CommandCatalogue` - The commands sorted by name and description, rendered as
+    ///   text and JSON
+    pub fn catalogue(&self) -> CommandCatalogue {
+        let mut commands: Vec<CommandInfo> = self
+            .commands
             .iter()
-            .map(|(name, handler)| format!("{}: {}", name, handler.description()))
+            .map(|(name, handler)| CommandInfo {
+                name: name.clone(),
+                description: handler.description().to_string(),
+                args: handler.expected_args(),
+            })
+            .collect();
+        commands.sort_by(|a, b| a.name.cmp(&b.name));
+        CommandCatalogue::new(commands)
+    }
+}
+
+/// Description of one registered command
+#[derive(Debug, Clone, PartialEq, Eq, Serialize)]
+pub struct CommandInfo {
+    pub name: String,
+    pub description: String,
+    /// Expected argument count, `None` for a variable number of arguments
+    pub args: Option<usize>,
+}
+
+/// Immutable catalogue of the registered commands
+///
+/// The text and JSON listings are rendered once, when the catalogue is built.
+#[derive(Debug)]
+pub struct CommandCatalogue {
+    text: String,
+    json: String,
+}
+
+impl CommandCatalogue {
+    fn new(commands: Vec<CommandInfo>) -> Self {
+        let text = commands
+            .iter()
+            .map(|info| format!("{}: {}", info.name, info.description))
             .collect::<Vec<_>>()
-            .join("\n")
+            .join("\n");
+        let json = serde_json::to_string(&commands).unwrap_or_default();
+        Self { text, json }
+    }
+
+    /// Get the listing as `name: description` lines
+    pub fn text(&self) -> &str {
+        &self.text
+    }
+
+    /// Get the listing as a JSON array of `CommandInfo`
+    pub fn json(&self) -> &str {
+        &self.json
+    }
+}
+
+/// Catalogue shared with the command serving it, set once registration is complete
+pub type SharedCatalogue = Arc<OnceLock<CommandCatalogue>>;
+
+/// Catalogue command handler
+///
+/// Serves the prebuilt catalogue of its registry instead of walking the registry on
+/// every call.
+pub struct CatalogueCommand {
+    description: String,
+    catalogue: SharedCatalogue,
+}
+
+impl CatalogueCommand {
+    /// Create a handler serving `catalogue`
+    ///
+    /// # Arguments
+    /// * `description` - The command description
+    /// * `catalogue` - The catalogue, set after every command has been registered
+    ///
+    /// # Returns
+    /// * `Box<dyn CommandHandler>` - A boxed command handler
+    pub fn new(description: &str, catalogue: SharedCatalogue) -> Box<dyn CommandHandler> {
+        Box::new(CatalogueCommand {
+            description: description.to_string(),
+            catalogue,
+        })
+    }
+
+    fn catalogue(&self) -> Result<&CommandCatalogue, CommandError> {
+        self.catalogue
+            .get()
+            .ok_or_else(|| CommandError::ExecutionError("Command catalogue not initialized".into()))
+    }
+}
+
+impl CommandHandler for CatalogueCommand {
+    fn execute(&self, _args: &[&str]) -> CommandResult {
+        Ok(self.catalogue()?.text().to_string())
+    }
+
+    fn execute_json(&self, _args: &[&str]) -> CommandResult {
+        Ok(self.catalogue()?.json().to_string())
+    }
+
+    fn description(&self) -> &str {
+        &self.description
+    }
+
+    fn expected_args(&self) -> Option<usize> {
+        Some(0)
     }
 }
 
@@ -258,6 +492,34 @@ impl CommandHandler for ArgCommand {
     }
 }
 
+/// Command handler with optional arguments
+///
+/// Handles commands that take up to a fixed number of positional arguments, all of them
+/// optional, and return a string result.
+pub struct OptionalArgsCommand {
+    description: String,
+    max_args: usize,
+    executor: Box<dyn Fn(&[&str]) -> Result<String, Box<dyn std::error::Error>> + Send + Sync>,
+}
+
+impl CommandHandler for OptionalArgsCommand {
+    fn execute(&self, args: &[&str]) -> CommandResult {
+        if args.len() > self.max_args {
+            return Err(CommandError::InvalidArguments(format!(
+                "expects at most {} arguments, got {}",
+                self.max_args,
+                args.len()
+            )));
+        }
+
+        (self.executor)(args).map_err(CommandError::ExecutionError)
+    }
+
+    fn description(&self) -> &str {
+        &self.description
+    }
+}
+
 /// Screen command handler (with optional screen parameter)
 ///
 /// Handles commands that operate on a screen, with an optional screen parameter.
@@ -318,6 +580,104 @@ impl CommandHandler for ScreenSetterCommand {
     }
 }
 
+/// Executor of a command with a structured result, serializing it as JSON
+type JsonExecutor =
+    Box<dyn Fn(Option<&str>) -> Result<String, Box<dyn std::error::Error>> + Send + Sync>;
+
+/// Structured command handler (with optional screen parameter)
+///
+/// Handles query commands that can reply either with text or with the backend
+/// structures serialized as JSON, without formatting and re-parsing strings in between.
+pub struct StructuredCommand {
+    description: String,
+    expected_args: Option<usize>,
+    text: Box<dyn Fn(Option<&str>) -> Result<String, Box<dyn std::error::Error>> + Send + Sync>,
+    json: JsonExecutor,
+}
+
+impl StructuredCommand {
+    fn screen<'a>(args: &[&'a str]) -> Option<&'a str> {
+        args.first().copied()
+    }
+}
+
+impl CommandHandler for StructuredCommand {
+    fn execute(&self, args: &[&str]) -> CommandResult {
+        (self.text)(Self::screen(args)).map_err(CommandError::ExecutionError)
+    }
+
+    fn execute_json(&self, args: &[&str]) -> CommandResult {
+        (self.json)(Self::screen(args)).map_err(CommandError::ExecutionError)
+    }
+
+    fn description(&self) -> &str {
+        &self.description
+    }
+
+    fn expected_args(&self) -> Option<usize> {
+        self.expected_args
+    }
+}
+
+/// Wraps a structured query into an executor serializing its result as JSON
+fn json_executor<F, T>(query: F) -> JsonExecutor
+where
+    F: Fn(Option<&str>) -> Result<T, Box<dyn std::error::Error>> + Send + Sync + 'static,
+    T: Serialize,
+{
+    Box::new(move |screen| Ok(serde_json::to_string(&query(screen)?)?))
+}
+
+/// Helper to create structured command handlers without arguments
+///
+/// # Arguments
+/// * `description` - The command description
+/// * `text` - The function producing the text reply
+/// * `query` - The function producing the structured reply
+///
+/// # Returns
+/// * `Box<dyn CommandHandler>` - A boxed command handler
+pub fn structured_command<F, Q, T>(description: &str, text: F, query: Q) -> Box<dyn CommandHandler>
+where
+    F: Fn() -> Result<String, Box<dyn std::error::Error>> + Send + Sync + 'static,
+    Q: Fn() -> Result<T, Box<dyn std::error::Error>> + Send + Sync + 'static,
+    T: Serialize,
+{
+    Box::new(StructuredCommand {
+        description: description.to_string(),
+        expected_args: Some(0),
+        text: Box::new(move |_| text()),
+        json: json_executor(move |_| query()),
+    })
+}
+
+/// Helper to create structured screen command handlers
+///
+/// # Arguments
+/// * `description` - The command description
+/// * `text` - The function producing the text reply for an optional screen
+/// * `query` - The function producing the structured reply for an optional screen
+///
+/// # Returns
+/// * `Box<dyn CommandHandler>` - A boxed command handler
+pub fn structured_screen_command<F, Q, T>(
+    description: &str,
+    text: F,
+    query: Q,
+) -> Box<dyn CommandHandler>
+where
+    F: Fn(Option<&str>) -> Result<String, Box<dyn std::error::Error>> + Send + Sync + 'static,
+    Q: Fn(Option<&str>) -> Result<T, Box<dyn std::error::Error>> + Send + Sync + 'static,
+    T: Serialize,
+{
+    Box::new(StructuredCommand {
+        description: description.to_string(),
+        expected_args: None,
+        text: Box::new(text),
+        json: json_executor(query),
+    })
+}
+
 /// Helper to create screen command handlers
 ///
 /// Creates a ScreenCommand instance with the provided description and executor function.
@@ -338,6 +698,30 @@ where
     })
 }
 
+/// Helper to create command handlers with optional arguments
+///
+/// # Arguments
+/// * `description` - The command description
+/// * `max_args` - The maximum number of arguments accepted
+/// * `executor` - The function to execute with the given arguments
+///
+/// # Returns
+/// * `Box<dyn CommandHandler>` - A boxed command handler
+pub fn optional_args_command<F>(
+    description: &str,
+    max_args: usize,
+    executor: F,
+) -> Box<dyn CommandHandler>
+where
+    F: Fn(&[&str]) -> Result<String, Box<dyn std::error::Error>> + Send + Sync + 'static,
+{
+    Box::new(OptionalArgsCommand {
+        description: description.to_string(),
+        max_args,
+        executor: Box::new(executor),
+    })
+}
+
 /// Helper to create screen setter command handlers
 ///
 /// Creates a ScreenSetterCommand instance with the provided description and executor function.
@@ -357,3 +741,48 @@ where
         executor: Box::new(executor),
     })
 }
+
+/// Setter handler whose requests for the same target replace each other
+///
+/// Forwards to the wrapped handler and names the target of each request.
+pub struct CoalescedCommand {
+    handler: Box<dyn CommandHandler>,
+    target: fn(&[&str]) -> String,
+}
+
+impl CommandHandler for CoalescedCommand {
+    fn execute(&self, args: &[&str]) -> CommandResult {
+        self.handler.execute(args)
+    }
+
+    fn execute_json(&self, args: &[&str]) -> CommandResult {
+        self.handler.execute_json(args)
+    }
+
+    fn description(&self) -> &str {
+        self.handler.description()
+    }
+
+    fn expected_args(&self) -> Option<usize> {
+        self.handler.expected_args()
+    }
+
+    fn coalesce_key(&self, args: &[&str]) -> Option<String> {
+        Some((self.target)(args))
+    }
+}
+
+/// Helper to make the requests of a setter coalesce
+///
+/// # Arguments
+/// * `handler` - The setter
+/// * `target` - The function naming the target of a request from its arguments
+///
+/// # Returns
+/// * `Box<dyn CommandHandler>` - A boxed command handler
+pub fn coalesced_command(
+    handler: Box<dyn CommandHandler>,
+    target: fn(&[&str]) -> String,
+) -> Box<dyn CommandHandler> {
+    Box::new(CoalescedCommand { handler, target })
+}
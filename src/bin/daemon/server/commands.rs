@@ -4,9 +4,20 @@
 //! It maps command names to their respective functions in the screen module,
 //! providing a clean interface between the ZeroMQ server and screen management functions.
 
-use super::command_registry::{CommandRegistry, screen_command, screen_setter_command};
+use super::command_registry::{
+    CatalogueCommand, CommandRegistry, SharedCatalogue, coalesced_command, optional_args_command,
+    screen_command, screen_setter_command, structured_command, structured_screen_command,
+};
 use crate::screen;
 use crate::simple_command;
+use crate::utils::stats;
+use crate::utils::tracing::{log_level, set_log_level};
+use std::sync::Arc;
+
+/// Coalescing key of a mode setter targeting `screen`, or all screens
+fn mode_target(screen: Option<&&str>) -> String {
+    screen.map_or("*", |screen| *screen).to_string()
+}
 
 /// Initialize all available commands in the registry
 ///
@@ -25,17 +36,19 @@ pub fn init_commands() -> CommandRegistry {
     // Query commands (no arguments) - Commands that return information about the system
     registry.register(
         "listOutputs",
-        simple_command!("listOutputs", "List all available display outputs", || {
-            Ok(screen::list_outputs()?)
-        }),
+        structured_command(
+            "List all available display outputs",
+            || Ok(screen::list_outputs()?),
+            || Ok(screen::display_outputs()?),
+        ),
     );
 
     registry.register(
         "currentOutput",
-        simple_command!(
-            "currentOutput",
+        structured_command(
             "Displays the current output (e.g., HDMI, VGA)",
-            || Ok(screen::current_output()?)
+            || Ok(screen::current_output()?),
+            || Ok(screen::current_display_output()?),
         ),
     );
 
@@ -48,15 +61,53 @@ pub fn init_commands() -> CommandRegistry {
         ),
     );
 
+    registry.register(
+        "stats",
+        structured_command(
+            "Shows command, backend and cache latency statistics",
+            || Ok(stats::report().to_string()),
+            || Ok(stats::report()),
+        ),
+    );
+
+    registry.register(
+        "logLevel",
+        optional_args_command(
+            "Shows the log filter, or replaces it (e.g., debug or info,regmsgd::screen=trace)",
+            1,
+            |args| match args.first() {
+                Some(directives) => {
+                    set_log_level(directives)?;
+                    Ok(format!("Log level set to: {}", directives))
+                }
+                None => Ok(log_level()?),
+            },
+        ),
+    );
+
     registry.register(
         "getScreenshot",
-        simple_command!(
-            "getScreenshot",
-            "Takes a screenshot of the current screen",
-            || {
-                screen::get_screenshot()?;
-                Ok("Screenshot taken".to_string())
-            }
+        optional_args_command(
+            "Takes a screenshot of the current screen (format: png, qoi, ppm; PNG level 0-9)",
+            2,
+            |args| {
+                let path = screen::get_screenshot(args.first().copied(), args.get(1).copied())?;
+                Ok(format!("Screenshot taken: {}", path))
+            },
+        ),
+    );
+
+    registry.register(
+        "applyProfile",
+        optional_args_command(
+            "Applies a display profile by name, or inline as OUTPUT:MODE[:ROTATION[:X,Y]] specs",
+            16,
+            |args| {
+                if args.is_empty() {
+                    return Err("expects a profile name or output specs".into());
+                }
+                Ok(screen::apply_profile(args)?)
+            },
         ),
     );
 
@@ -75,72 +126,90 @@ pub fn init_commands() -> CommandRegistry {
     // Screen-aware query commands - Commands that can operate on a specific screen
     registry.register(
         "listModes",
-        screen_command("Lists all available outputs (e.g., HDMI, VGA)", |screen| {
-            Ok(screen::list_modes(screen)?)
-        }),
+        structured_screen_command(
+            "Lists all available outputs (e.g., HDMI, VGA)",
+            |screen| Ok(screen::list_modes(screen)?),
+            |screen| Ok(screen::display_modes(screen)?),
+        ),
     );
 
     registry.register(
         "currentMode",
-        screen_command(
+        structured_screen_command(
             "Displays the current display mode for the specified screen",
             |screen| Ok(screen::current_mode(screen)?),
+            |screen| Ok(screen::current_display_mode(screen)?),
         ),
     );
 
     registry.register(
         "currentResolution",
-        screen_command(
+        structured_screen_command(
             "Displays the current resolution for the specified screen",
             |screen| Ok(screen::current_resolution(screen)?),
+            |screen| {
+                let (width, height) = screen::current_display_resolution(screen)?;
+                Ok(serde_json::json!({ "width": width, "height": height }))
+            },
         ),
     );
 
     registry.register(
         "currentRotation",
-        screen_command(
+        structured_screen_command(
             "Displays the current screen rotation for the specified screen",
             |screen| Ok(screen::current_rotation(screen)?),
+            |screen| Ok(screen::current_rotation_degrees(screen)?),
         ),
     );
 
     registry.register(
         "currentRefresh",
-        screen_command(
+        structured_screen_command(
             "Displays the current refresh rate for the specified screen",
             |screen| Ok(screen::current_refresh(screen)?),
+            |screen| Ok(screen::current_refresh_rate(screen)?),
         ),
     );
 
     registry.register(
         "minToMaxResolution",
-        screen_command(
-            "Sets the screen resolution to the maximum supported resolution",
-            |screen| {
-                screen::min_to_max_resolution(screen)?;
-                Ok("Resolution set to maximum".to_string())
-            },
+        coalesced_command(
+            screen_command(
+                "Sets the screen resolution to the maximum supported resolution",
+                |screen| {
+                    screen::min_to_max_resolution(screen)?;
+                    Ok("Resolution set to maximum".to_string())
+                },
+            ),
+            |args| mode_target(args.first()),
         ),
     );
 
     // Setter commands (with arguments) - Commands that modify system settings
     registry.register(
         "setMode",
-        screen_setter_command(
-            "Sets the display mode for the specified screen (e.g., 1920x1080@60)",
-            |screen, mode| Ok(screen::set_mode(screen, mode)?),
+        coalesced_command(
+            screen_setter_command(
+                "Sets the display mode for the specified screen (e.g., 1920x1080@60)",
+                |screen, mode| Ok(screen::set_mode(screen, mode)?),
+            ),
+            |args| mode_target(args.get(1)),
         ),
     );
 
     registry.register(
         "setOutput",
-        Box::new(super::command_registry::ArgCommand {
-            name: "setOutput".to_string(),
-            description: "Sets the output resolution and refresh rate (e.g., WxH@R or WxH)"
-                .to_string(),
-            expected_args: 1,
-            executor: Box::new(|args| Ok(screen::set_output(args[0])?)),
-        }),
+        coalesced_command(
+            Box::new(super::command_registry::ArgCommand {
+                name: "setOutput".to_string(),
+                description: "Sets the output resolution and refresh rate (e.g., WxH@R or WxH)"
+                    .to_string(),
+                expected_args: 1,
+                executor: Box::new(|args| Ok(screen::set_output(args[0])?)),
+            }),
+            |_| mode_target(None),
+        ),
     );
 
     registry.register(
@@ -161,18 +230,13 @@ pub fn init_commands() -> CommandRegistry {
         ),
     );
 
-    // Registramos o comando listCommands com descrição fixa,
-    // mas como o registry.list_commands() não é acessível aqui,
-    // o registry já tem um método list_commands() que é usado internamente
+    // listCommands serves the catalogue built once every command is registered
+    let catalogue = SharedCatalogue::default();
     registry.register(
         "listCommands",
-        simple_command!("listCommands", "List all available commands", || {
-            // Obtemos a lista de comandos do registry criando um temporário
-            let temp_registry = init_commands();
-            Ok(temp_registry.list_commands())
-        }),
+        CatalogueCommand::new("List all available commands", Arc::clone(&catalogue)),
     );
+    let _ = catalogue.set(registry.catalogue());
+
     registry
 }
-
-
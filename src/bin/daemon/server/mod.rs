@@ -4,10 +4,13 @@
 //! It provides a modular architecture for handling client requests and communicating
 //! with display backends through a ZeroMQ interface.
 //!
-//! The server module is organized into three main components:
+//! The server module is organized into six main components:
 //! - command_registry: Manages dynamic command registration and execution
 //! - commands: Initializes and registers all available commands
+//! - coalesce: Applies only the last of a burst of mode setters
 //! - server: Implements the ZeroMQ communication layer
+//! - publisher: Publishes display change events
+//! - readiness: Announces when the daemon accepts connections
 
 /// Command registry module - manages dynamic command registration and execution
 pub mod command_registry;
@@ -15,9 +18,22 @@ pub mod command_registry;
 /// Commands module - initializes and registers all available commands with the registry
 pub mod commands;
 
+/// Coalesce module - applies only the last of a burst of mode setters
+pub mod coalesce;
+
 /// Server module - implements the ZeroMQ communication layer and message handling
 pub mod server;
 
+/// Publisher module - publishes display change events to subscribed clients
+pub mod publisher;
+
+/// Readiness module - tells init scripts and service managers that the daemon is ready
+pub mod readiness;
+
 /// Server tests module - contains comprehensive tests for the server components
 #[cfg(test)]
 mod server_tests;
+
+/// Benchmarks of the daemon hot paths, run as ignored tests
+#[cfg(test)]
+mod server_benches;
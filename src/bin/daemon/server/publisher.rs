@@ -0,0 +1,72 @@
+//! Event Publisher Module
+//!
+//! This module publishes display change events on a ZeroMQ PUB socket bound next to the
+//! command socket, at `ipc:///var/run/regmsgd-events.sock`. Each event is a single text
+//! frame starting with its topic (e.g., `outputConnected HDMI-A-1`), so clients can
+//! subscribe to all events or to one topic and stop polling the query commands.
+
+use crate::config;
+use crate::screen;
+use crate::screen::events::{self, DisplayEvent};
+use async_std::channel::{self, Receiver};
+use std::fs;
+use tracing::{debug, info, warn};
+use zeromq::prelude::*;
+use zeromq::{PubSocket, ZmqMessage};
+
+/// Number of events queued for the publisher before new ones are dropped
+const EVENT_QUEUE_SIZE: usize = 64;
+
+/// Publishes display change events to subscribed clients
+pub struct EventPublisher {
+    /// ZeroMQ publish socket
+    socket: PubSocket,
+    /// Events emitted by the screen module
+    events: Receiver<DisplayEvent>,
+}
+
+impl EventPublisher {
+    /// Bind the event socket and start watching the display state
+    ///
+    /// # Returns
+    /// * `Result<EventPublisher, Box<dyn std::error::Error>>` - The publisher or an error
+    pub async fn bind() -> Result<Self, Box<dyn std::error::Error>> {
+        // Remove existing socket if present
+        let _ = fs::remove_file(config::DEFAULT_EVENTS_SOCKET_PATH);
+
+        let endpoint = format!("ipc://{}", config::DEFAULT_EVENTS_SOCKET_PATH);
+        let mut socket = PubSocket::new();
+        socket.bind(&endpoint).await?;
+
+        let (tx, rx) = channel::bounded(EVENT_QUEUE_SIZE);
+        if !events::set_sink(tx) {
+            return Err("Event publisher already running".into());
+        }
+        screen::watch_display_events();
+
+        info!("Publishing display events on {}", endpoint);
+        Ok(EventPublisher { socket, events: rx })
+    }
+
+    /// Publish events until the screen module stops emitting them
+    pub async fn run(mut self) {
+        while let Ok(event) = self.events.recv().await {
+            let message = event.to_string();
+            debug!("Publishing event: '{}'", message);
+            if let Err(e) = self.socket.send(ZmqMessage::from(message)).await {
+                warn!("Failed to publish event: {:?}", e);
+            }
+        }
+    }
+
+    /// Remove the event socket file
+    pub fn remove_socket() {
+        if let Err(e) = fs::remove_file(config::DEFAULT_EVENTS_SOCKET_PATH) {
+            debug!(
+                "Failed to remove socket file {}: {}",
+                config::DEFAULT_EVENTS_SOCKET_PATH,
+                e
+            );
+        }
+    }
+}
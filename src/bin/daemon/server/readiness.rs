@@ -0,0 +1,86 @@
+//! Readiness Notification Module
+//!
+//! This module tells the service manager when the daemon accepts connections, so init
+//! scripts can wait for it instead of polling the process. Once the sockets are bound
+//! the daemon:
+//! - writes its PID to the ready file, `/var/run/regmsgd.ready`, which `S06regmsgd` waits for
+//! - sends `READY=1` to `$NOTIFY_SOCKET` when started by a manager speaking the
+//!   sd_notify protocol
+//!
+//! Both are best effort: a failure is logged and the daemon keeps serving.
+
+use crate::config;
+use std::fs;
+use std::io;
+use std::os::unix::net::UnixDatagram;
+use std::path::Path;
+use tracing::{debug, info, warn};
+
+/// Environment variable naming the sd_notify datagram socket
+const NOTIFY_SOCKET_ENV: &str = "NOTIFY_SOCKET";
+
+/// Announce that the daemon is ready to serve clients
+pub fn notify_ready() {
+    let ready_path = Path::new(config::DEFAULT_READY_PATH);
+    match write_ready_file(ready_path) {
+        Ok(()) => info!("Daemon ready, wrote {}", ready_path.display()),
+        Err(e) => warn!("Failed to write ready file {}: {}", ready_path.display(), e),
+    }
+
+    if let Some(socket) = std::env::var_os(NOTIFY_SOCKET_ENV) {
+        if let Err(e) = sd_notify(Path::new(&socket), "READY=1") {
+            warn!("Failed to notify {}: {}", Path::new(&socket).display(), e);
+        }
+    }
+}
+
+/// Remove the ready file, before binding and on shutdown
+pub fn clear() {
+    if let Err(e) = fs::remove_file(config::DEFAULT_READY_PATH) {
+        debug!(
+            "Failed to remove ready file {}: {}",
+            config::DEFAULT_READY_PATH,
+            e
+        );
+    }
+}
+
+/// Write the daemon PID to a ready file
+///
+/// The file is written under a temporary name and renamed, so a waiting script never
+/// sees it partially written.
+///
+/// # Arguments
+/// * `path` - The ready file
+///
+/// # Returns
+/// * `io::Result<()>` - Ok if the file was written, or the I/O error
+pub fn write_ready_file(path: &Path) -> io::Result<()> {
+    let tmp = path.with_extension("tmp");
+    fs::write(&tmp, format!("{}\n", std::process::id()))?;
+    fs::rename(&tmp, path)
+}
+
+/// Send a state string to an sd_notify socket
+///
+/// # Arguments
+/// * `socket` - The socket path; a leading `@` names a socket in the abstract namespace
+/// * `state` - The state, e.g. `READY=1`
+///
+/// # Returns
+/// * `io::Result<()>` - Ok if the datagram was sent, or the I/O error
+fn sd_notify(socket: &Path, state: &str) -> io::Result<()> {
+    let sender = UnixDatagram::unbound()?;
+    match socket.to_str().and_then(|name| name.strip_prefix('@')) {
+        Some(name) => {
+            use std::os::linux::net::SocketAddrExt;
+            let addr = std::os::unix::net::SocketAddr::from_abstract_name(name)?;
+            sender.send_to_addr(state.as_bytes(), &addr)?;
+        }
+        None => {
+            sender.send_to(state.as_bytes(), socket)?;
+        }
+    }
+    debug!("Sent '{}' to {}", state, socket.display());
+    Ok(())
+}
@@ -4,17 +4,37 @@
 //! It provides a communication interface between clients and the screen management functions
 //! through a command registry system. The server handles incoming commands,
 //! processes them using registered handlers, and returns appropriate responses.
+//!
+//! By default the daemon binds a ROUTER socket: every request is executed as soon as
+//! it arrives and answered as soon as it completes, so a slow command from one client
+//! never delays the others. REQ clients keep working unchanged, and DEALER clients may
+//! pipeline several requests by tagging each with a request id frame (`id:<token>`)
+//! that is echoed in front of the reply. Setting `REGMSGD_SOCKET_MODE=rep` restores the
+//! legacy lockstep REP socket.
+//!
+//! A request may carry several command frames. They run in order as one batch, and the
+//! reply holds one result frame per command, so a client can query several values in
+//! a single round-trip.
 
+use super::coalesce::Coalescer;
 use super::command_registry::{CommandError, CommandRegistry};
 use super::commands;
+use super::publisher::EventPublisher;
+use super::readiness;
 use crate::config;
-use async_std::channel::Receiver;
+use crate::utils::tracing::RateLimit;
+use async_std::channel::{self, Receiver, Sender};
+use bytes::Bytes;
 use futures::FutureExt;
+use smallvec::SmallVec;
+use std::fmt;
 use std::fs;
+use std::sync::Arc;
+use std::sync::atomic::{AtomicUsize, Ordering};
 use std::time::Duration;
 use tracing::{debug, error, info, warn};
 use zeromq::prelude::*;
-use zeromq::{RepSocket, ZmqMessage};
+use zeromq::{RepSocket, RouterSocket, ZmqMessage};
 
 /// Maximum message size (1MB)
 ///
@@ -26,55 +46,376 @@ const MAX_MESSAGE_SIZE: usize = 1024 * 1024;
 /// Number of times the server will attempt to send a reply before giving up.
 const MAX_SEND_RETRIES: usize = 3;
 
+/// Default time a command may run before the client receives a timeout error
+const COMMAND_TIMEOUT: Duration = Duration::from_secs(10);
+
+/// Commands allowed to run longer than `COMMAND_TIMEOUT`
+const SLOW_COMMAND_TIMEOUTS: &[(&str, Duration)] = &[("getScreenshot", Duration::from_secs(30))];
+
+/// Maximum number of commands executing on the blocking pool at once
+///
+/// Commands that timed out keep their worker until the backend call returns, so this
+/// bounds how many stuck workers can pile up before new requests are refused.
+const MAX_RUNNING_COMMANDS: usize = 8;
+
+/// Prefix of the optional request id frame sent by pipelining clients
+const REQUEST_ID_PREFIX: &[u8] = b"id:";
+
+/// Maximum number of commands in one batch request
+const MAX_BATCH_COMMANDS: usize = 64;
+
+/// Batch size kept inline without a heap allocation
+const INLINE_BATCH: usize = 4;
+
+/// Command lines of one request
+type Batch = SmallVec<[CommandLine; INLINE_BATCH]>;
+
+/// Reply sent when every blocking pool slot is taken
+const SERVER_BUSY_REPLY: &[u8] = b"Error: Server busy, too many commands still running";
+
+/// Budget of received commands logged at info level, the rest go to debug level
+static REQUEST_LOG: RateLimit = RateLimit::new(config::REQUEST_LOG_RATE);
+
+/// Returns the timeout that applies to a command line
+fn command_timeout(cmdline: &str) -> Duration {
+    let name = cmdline.split_whitespace().next().unwrap_or_default();
+    SLOW_COMMAND_TIMEOUTS
+        .iter()
+        .find(|(slow, _)| *slow == name)
+        .map_or(COMMAND_TIMEOUT, |(_, timeout)| *timeout)
+}
+
+/// Releases a blocking pool slot when a command finishes, even if it panics
+struct RunningSlot(Arc<AtomicUsize>);
+
+impl Drop for RunningSlot {
+    fn drop(&mut self) {
+        self.0.fetch_sub(1, Ordering::AcqRel);
+    }
+}
+
+/// Socket pattern used to serve clients
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum ServerMode {
+    /// Legacy REP socket: requests are received and answered strictly one at a time
+    Rep,
+    /// ROUTER socket: requests from all clients run concurrently and are answered
+    /// in completion order
+    Router,
+}
+
+impl ServerMode {
+    /// Reads the mode from `REGMSGD_SOCKET_MODE` ("rep" or "router"), defaulting to `Router`
+    pub fn from_env() -> Self {
+        match std::env::var(config::SOCKET_MODE_ENV) {
+            Ok(value) if value.eq_ignore_ascii_case("rep") => ServerMode::Rep,
+            Ok(value) if !value.eq_ignore_ascii_case("router") => {
+                warn!(
+                    "Unknown {} '{}', using router",
+                    config::SOCKET_MODE_ENV,
+                    value
+                );
+                ServerMode::Router
+            }
+            _ => ServerMode::Router,
+        }
+    }
+}
+
+/// Bound ZeroMQ socket of the selected mode
+enum ServerSocket {
+    Rep(RepSocket),
+    Router(RouterSocket),
+}
+
+/// Executes commands against the registry
+///
+/// Cheap to clone, so every in-flight ROUTER request owns a handle to it.
+#[derive(Clone)]
+struct Dispatcher {
+    /// Command registry for dynamic command handling, shared with the blocking pool
+    registry: Arc<CommandRegistry>,
+    /// Number of commands currently executing on the blocking pool
+    running: Arc<AtomicUsize>,
+    /// Waiting mode setters, see the `coalesce` module
+    setters: Arc<Coalescer<Vec<Bytes>>>,
+}
+
+impl Dispatcher {
+    /// Execute a batch of commands on the blocking thread pool
+    ///
+    /// Backend calls (DRM ioctls, sway IPC, `grim`) block, so they never run on the
+    /// executor thread. The whole batch runs in order on one worker and holds a single
+    /// slot; its timeout is the sum of the timeouts of its commands. Replies are
+    /// formatted on the worker, and a batch exceeding its timeout is answered with an
+    /// error for every command while its worker runs to completion. A lone mode setter
+    /// is coalesced with the requests for the same screen first; a superseded request
+    /// gets the reply of the request that replaced it.
+    ///
+    /// # Arguments
+    /// * `cmdlines` - The command lines to execute
+    ///
+    /// # Returns
+    /// * `Vec<Bytes>` - One formatted response frame per command line
+    async fn execute(&self, cmdlines: Batch) -> Vec<Bytes> {
+        if cmdlines.is_empty() {
+            return Vec::new();
+        }
+        let key = match cmdlines.as_slice() {
+            [cmdline] => self.registry.coalesce_key(cmdline.as_str()),
+            _ => None,
+        };
+        let Some(key) = key else {
+            return self.run_blocking(cmdlines).await;
+        };
+
+        // Mode setters wait their turn here, without holding a blocking pool slot
+        self.setters
+            .run(&key, self.run_blocking(cmdlines))
+            .await
+            .unwrap_or_else(|| {
+                warn!("Superseding request for '{}' did not complete", key);
+                vec![Bytes::from_static(
+                    b"Error: Superseded by a request that did not complete",
+                )]
+            })
+    }
+
+    /// Execute a batch of commands on the blocking thread pool, see `execute`
+    async fn run_blocking(&self, cmdlines: Batch) -> Vec<Bytes> {
+        let count = cmdlines.len();
+        if self.running.fetch_add(1, Ordering::AcqRel) >= MAX_RUNNING_COMMANDS {
+            self.running.fetch_sub(1, Ordering::AcqRel);
+            warn!("Rejecting {:?}: too many commands still running", cmdlines);
+            return vec![Bytes::from_static(SERVER_BUSY_REPLY); count];
+        }
+        let slot = RunningSlot(Arc::clone(&self.running));
+
+        let timeout = cmdlines
+            .iter()
+            .map(|cmdline| command_timeout(cmdline.as_str()))
+            .sum();
+        let registry = Arc::clone(&self.registry);
+        let task = async_std::task::spawn_blocking(move || {
+            let _slot = slot;
+            registry
+                .handle_batch(&cmdlines)
+                .map(Self::format_response)
+                .collect()
+        });
+
+        match async_std::future::timeout(timeout, task).await {
+            Ok(replies) => replies,
+            Err(_) => {
+                error!("Command timed out after {:?}", timeout);
+                let reply = Bytes::from(format!(
+                    "Error: Command timed out after {}s",
+                    timeout.as_secs()
+                ));
+                vec![reply; count]
+            }
+        }
+    }
+
+    /// Decode and execute the command frames of a request
+    ///
+    /// Each frame holds one command line; a request with several frames is a batch.
+    /// A frame that fails to decode is answered with an error without stopping the
+    /// rest of the batch.
+    ///
+    /// # Arguments
+    /// * `frames` - The command frames, empty when the request carried no payload
+    ///
+    /// # Returns
+    /// * `Vec<Bytes>` - One formatted response frame per request frame
+    async fn handle_frames(&self, frames: &[Bytes]) -> Vec<Bytes> {
+        if frames.is_empty() {
+            warn!("Received empty message");
+            return vec![Bytes::from_static(b"Error: Received empty message")];
+        }
+        if frames.len() > MAX_BATCH_COMMANDS {
+            warn!("Batch too large: {} commands", frames.len());
+            return vec![Bytes::from(format!(
+                "Error: Batch too large: {} commands (max: {})",
+                frames.len(),
+                MAX_BATCH_COMMANDS
+            ))];
+        }
+
+        // Invalid frames get their error reply now, the others wait for the batch result
+        let mut errors: SmallVec<[Option<Bytes>; INLINE_BATCH]> = SmallVec::new();
+        let mut cmdlines = Batch::new();
+        for frame in frames {
+            match CommandLine::decode(frame) {
+                Ok(cmdline) => {
+                    match REQUEST_LOG.admit() {
+                        Some(0) => info!("Received command: '{}'", cmdline),
+                        Some(suppressed) => info!(
+                            "Received command: '{}' ({} more since the last one logged)",
+                            cmdline, suppressed
+                        ),
+                        None => debug!("Received command: '{}'", cmdline),
+                    }
+                    cmdlines.push(cmdline);
+                    errors.push(None);
+                }
+                Err(e) => {
+                    warn!("Invalid command received: {}", e);
+                    errors.push(Some(Bytes::from(format!("Error: {}", e))));
+                }
+            }
+        }
+
+        if cmdlines.len() == frames.len() {
+            return self.execute(cmdlines).await;
+        }
+        let mut results = self.execute(cmdlines).await.into_iter();
+        errors
+            .into_iter()
+            .map(|error| error.or_else(|| results.next()).unwrap_or_default())
+            .collect()
+    }
+
+    /// Format a command result into a string response
+    ///
+    /// This function takes the result of command execution and formats it
+    /// into a string response that can be sent back to the client.
+    /// It handles both success and error cases appropriately.
+    ///
+    /// # Arguments
+    /// * `result` - The command result to format
+    ///
+    /// # Returns
+    /// * `Bytes` - The formatted response frame, taking over the reply buffer
+    fn format_response(result: Result<String, CommandError>) -> Bytes {
+        let reply = match result {
+            Ok(msg) => {
+                debug!("Command executed successfully: '{}'", msg);
+                msg
+            }
+            Err(CommandError::ExecutionError(err)) => {
+                error!("Command execution error: {}", err);
+                format!("Error: {}", err)
+            }
+            Err(err) => {
+                warn!("Command error: {}", err);
+                format!("Error: {}", err)
+            }
+        };
+        Bytes::from(reply)
+    }
+}
+
 /// Main daemon server structure that handles ZeroMQ communication
 ///
 /// This struct manages the ZeroMQ socket and command registry, providing
 /// the interface between clients and the screen management functions.
 pub struct DaemonServer {
-    /// ZeroMQ reply socket for communication with clients
-    socket: RepSocket,
-    /// Command registry for dynamic command handling
-    registry: CommandRegistry,
+    /// ZeroMQ socket for communication with clients
+    socket: ServerSocket,
+    /// Executes received commands
+    dispatcher: Dispatcher,
+    /// Display event publisher, started with the server loop
+    publisher: Option<EventPublisher>,
 }
 
 impl DaemonServer {
     /// Create a new daemon server instance
     ///
+    /// The socket pattern is taken from `REGMSGD_SOCKET_MODE`, see `ServerMode::from_env`.
+    ///
+    /// # Returns
+    /// * `Result<DaemonServer, Box<dyn std::error::Error>>` - A new daemon server instance or an error
+    pub async fn new() -> Result<Self, Box<dyn std::error::Error>> {
+        Self::with_mode(ServerMode::from_env()).await
+    }
+
+    /// Create a new daemon server instance serving clients with the given socket pattern
+    ///
     /// This function initializes the server by:
-    /// - Removing any existing socket file
-    /// - Creating and binding a new ZeroMQ REP socket
-    /// - Setting appropriate file permissions on Unix systems
+    /// - Removing any existing socket and ready file
+    /// - Creating and binding a new ZeroMQ REP or ROUTER socket
+    /// - Binding the display event socket, if the display state can be watched
     /// - Initializing the command registry with all available commands
     ///
+    /// No display backend is touched: it is detected by the first command, so the
+    /// server accepts connections as early as possible.
+    ///
+    /// # Arguments
+    /// * `mode` - The socket pattern to bind
+    ///
     /// # Returns
     /// * `Result<DaemonServer, Box<dyn std::error::Error>>` - A new daemon server instance or an error
-    pub fn new() -> Result<Self, Box<dyn std::error::Error>> {
-        // Remove existing socket if present
+    pub async fn with_mode(mode: ServerMode) -> Result<Self, Box<dyn std::error::Error>> {
+        // Remove existing socket and a ready file left by a previous run
         let _ = fs::remove_file(config::DEFAULT_SOCKET_PATH);
+        readiness::clear();
 
-        let mut socket = RepSocket::new();
-
-        // Use blocking operation for bind to ensure it completes
-        async_std::task::block_on(async {
-            info!("Binding socket to ipc://{}", config::DEFAULT_SOCKET_PATH);
-            socket
-                .bind(&format!("ipc://{}", config::DEFAULT_SOCKET_PATH))
-                .await
-        })?;
+        let endpoint = format!("ipc://{}", config::DEFAULT_SOCKET_PATH);
 
         // Initialize command registry with all available commands
         let registry = commands::init_commands();
-        info!(
-            "Initialized {} commands",
-            registry.list_commands().lines().count()
-        );
+        info!("Initialized {} commands", registry.len());
+
+        let mut server = Self::bind(mode, &endpoint, registry).await?;
 
-        info!(
-            "Daemon server initialized on ipc://{}",
-            config::DEFAULT_SOCKET_PATH
-        );
+        // Display events are optional, clients can still poll without them
+        server.publisher = EventPublisher::bind()
+            .await
+            .map_err(|e| warn!("Display events disabled: {}", e))
+            .ok();
 
-        Ok(DaemonServer { socket, registry })
+        Ok(server)
+    }
+
+    /// Create a daemon server serving a registry on an arbitrary endpoint
+    ///
+    /// Unlike `with_mode`, this neither touches the default socket path nor publishes
+    /// display events, so benchmarks can bind a private endpoint.
+    ///
+    /// # Arguments
+    /// * `mode` - The socket pattern to bind
+    /// * `endpoint` - The ZeroMQ endpoint, e.g. `ipc:///tmp/regmsgd.sock`
+    /// * `registry` - The commands to serve
+    ///
+    /// # Returns
+    /// * `Result<DaemonServer, Box<dyn std::error::Error>>` - A new daemon server instance or an error
+    pub async fn bind(
+        mode: ServerMode,
+        endpoint: &str,
+        registry: CommandRegistry,
+    ) -> Result<Self, Box<dyn std::error::Error>> {
+        info!("Binding {:?} socket to {}", mode, endpoint);
+        let socket = match mode {
+            ServerMode::Rep => {
+                let mut socket = RepSocket::new();
+                socket
+                    .bind(endpoint)
+                    .await
+                    .map(|_| ServerSocket::Rep(socket))
+            }
+            ServerMode::Router => {
+                let mut socket = RouterSocket::new();
+                socket
+                    .bind(endpoint)
+                    .await
+                    .map(|_| ServerSocket::Router(socket))
+            }
+        }?;
+
+        info!("Daemon server initialized on {}", endpoint);
+
+        Ok(DaemonServer {
+            socket,
+            dispatcher: Dispatcher {
+                registry: Arc::new(registry),
+                running: Arc::new(AtomicUsize::new(0)),
+                setters: Arc::new(Coalescer::new(Duration::from_millis(
+                    config::SETTER_COALESCE_WINDOW_MS,
+                ))),
+            },
+            publisher: None,
+        })
     }
 
     /// Shutdown the daemon server gracefully
@@ -86,6 +427,8 @@ impl DaemonServer {
     /// * `Result<(), Box<dyn std::error::Error>>` - Ok if shutdown succeeds, or an error
     pub async fn shutdown(self) -> Result<(), Box<dyn std::error::Error>> {
         info!("Initiating graceful shutdown of daemon server");
+        readiness::clear();
+        EventPublisher::remove_socket();
         if let Err(e) = fs::remove_file(config::DEFAULT_SOCKET_PATH) {
             warn!(
                 "Failed to remove socket file {}: {}",
@@ -105,7 +448,8 @@ impl DaemonServer {
     ///
     /// This is the main server loop that continuously listens for incoming messages
     /// and handles shutdown signals. It uses a futures select to handle both
-    /// incoming commands and shutdown signals concurrently.
+    /// incoming commands and shutdown signals concurrently, including while a
+    /// command is still executing.
     ///
     /// # Arguments
     /// * `shutdown_rx` - Receiver for shutdown signal
@@ -118,15 +462,49 @@ impl DaemonServer {
     ) -> Result<(), Box<dyn std::error::Error>> {
         info!("Starting daemon server loop");
 
+        if let Some(publisher) = self.publisher.take() {
+            async_std::task::spawn(publisher.run());
+        }
+
+        match &mut self.socket {
+            ServerSocket::Rep(socket) => {
+                Self::run_rep(socket, &self.dispatcher, &shutdown_rx).await
+            }
+            ServerSocket::Router(socket) => {
+                Self::run_router(socket, &self.dispatcher, &shutdown_rx).await
+            }
+        }
+
+        info!("Daemon server loop stopped");
+        Ok(())
+    }
+
+    /// Serve a REP socket, answering one request before receiving the next
+    async fn run_rep(socket: &mut RepSocket, dispatcher: &Dispatcher, shutdown_rx: &Receiver<()>) {
         loop {
             // Use select to handle both messages and shutdown signal
             futures::select! {
-                msg = self.socket.recv().fuse() => {
+                msg = socket.recv().fuse() => {
                     match msg {
                         Ok(cmdline) => {
                             debug!("Received message from client");
-                            if let Err(e) = self.process_message(cmdline).await {
-                                error!("Error processing message: {:?}", e);
+                            let frames = cmdline.into_vec();
+                            let processing = dispatcher.handle_frames(&frames).fuse();
+                            futures::pin_mut!(processing);
+                            futures::select! {
+                                replies = processing => {
+                                    debug!("Sending reply: {:?}", replies);
+                                    let Ok(reply) = ZmqMessage::try_from(replies) else {
+                                        continue;
+                                    };
+                                    if let Err(e) = send_with_retry(socket, reply).await {
+                                        error!("Error processing message: {:?}", e);
+                                    }
+                                }
+                                _ = shutdown_rx.recv().fuse() => {
+                                    info!("Shutdown signal received while a command was running");
+                                    break;
+                                }
                             }
                         }
                         Err(e) => {
@@ -140,66 +518,127 @@ impl DaemonServer {
                 }
             }
         }
+    }
 
-        info!("Daemon server loop stopped");
-        Ok(())
+    /// Serve a ROUTER socket, running every request in its own task
+    ///
+    /// The loop owns the socket: it keeps receiving while commands execute and sends
+    /// each reply as soon as its task hands it back, so replies leave in completion
+    /// order rather than arrival order.
+    async fn run_router(
+        socket: &mut RouterSocket,
+        dispatcher: &Dispatcher,
+        shutdown_rx: &Receiver<()>,
+    ) {
+        let (reply_tx, reply_rx) = channel::unbounded();
+
+        loop {
+            futures::select! {
+                msg = socket.recv().fuse() => {
+                    match msg {
+                        Ok(request) => {
+                            debug!("Received message from client");
+                            async_std::task::spawn(Self::route_request(
+                                dispatcher.clone(),
+                                request,
+                                reply_tx.clone(),
+                            ));
+                        }
+                        Err(e) => {
+                            error!("Error receiving message: {:?}", e);
+                        }
+                    }
+                }
+                reply = reply_rx.recv().fuse() => {
+                    if let Ok(reply) = reply {
+                        // A failed send only affects the client that went away
+                        if let Err(e) = send_with_retry(socket, reply).await {
+                            error!("Dropping reply: {:?}", e);
+                        }
+                    }
+                }
+                _ = shutdown_rx.recv().fuse() => {
+                    info!("Shutdown signal received, stopping server loop");
+                    break;
+                }
+            }
+        }
     }
 
-    /// Process a received message
+    /// Execute one ROUTER request and hand its reply back to the socket loop
     ///
-    /// This function extracts the command string from the received message,
-    /// processes it using the command registry, and sends back the response.
-    /// It handles both successful results and errors appropriately.
+    /// The routing envelope is echoed unchanged in front of the reply, so the socket
+    /// delivers it to the right peer and DEALER clients can match it by request id.
     ///
     /// # Arguments
-    /// * `cmdline` - The received ZeroMQ message
-    ///
-    /// # Returns
-    /// * `Result<(), Box<dyn std::error::Error>>` - Ok if processing succeeds, or an error
-    async fn process_message(
-        &mut self,
-        cmdline: ZmqMessage,
-    ) -> Result<(), Box<dyn std::error::Error>> {
-        // Extract and validate command string from the message
-        let cmdline_str = match self.extract_command(&cmdline) {
-            Ok(s) => {
-                info!("Received command: '{}'", s);
-                s
-            }
-            Err(e) => {
-                warn!("Invalid command received: {}", e);
-                let error_msg = format!("Error: {}", e);
-                self.send_reply(error_msg).await?;
-                return Ok(());
-            }
-        };
+    /// * `dispatcher` - Executes the command
+    /// * `request` - The received message, starting with the peer identity
+    /// * `replies` - Channel read by the socket loop
+    async fn route_request(
+        dispatcher: Dispatcher,
+        request: ZmqMessage,
+        replies: Sender<ZmqMessage>,
+    ) {
+        let mut frames = request.into_vec();
+        let envelope = envelope_len(&frames);
 
-        // Handle the command using the registry
-        let result = self.registry.handle(&cmdline_str);
+        let reply = dispatcher.handle_frames(&frames[envelope..]).await;
+        debug!("Sending reply: {:?}", reply);
 
-        // Format and send the response back to the client
-        let reply = self.format_response(result);
-        debug!("Sending reply: '{}'", reply);
-        self.send_reply(reply).await
+        // Reuse the request frames: keep the envelope, replace the commands
+        frames.truncate(envelope);
+        frames.extend(reply);
+        if let Ok(reply) = ZmqMessage::try_from(frames) {
+            // Only fails once the socket loop has stopped
+            let _ = replies.send(reply).await;
+        }
     }
+}
 
-    /// Extract command string from ZeroMQ message with validation
+/// Returns the number of routing frames in front of the command of a ROUTER request
+///
+/// The envelope is the peer identity added by the ROUTER socket, followed by the empty
+/// delimiter frame sent by REQ clients and an optional `id:<token>` request id frame.
+///
+/// # Arguments
+/// * `frames` - The frames of the received message
+///
+/// # Returns
+/// * `usize` - The number of envelope frames, at most `frames.len()`
+pub(super) fn envelope_len(frames: &[Bytes]) -> usize {
+    // Peer identity
+    let mut len = 1;
+    if frames.get(len).is_some_and(|frame| frame.is_empty()) {
+        len += 1;
+    }
+    if frames
+        .get(len)
+        .is_some_and(|frame| frame.starts_with(REQUEST_ID_PREFIX))
+    {
+        len += 1;
+    }
+    len.min(frames.len())
+}
+
+/// A command line validated as UTF-8 in place
+///
+/// Wraps the request frame itself, so a command reaches the blocking pool without
+/// being copied.
+#[derive(Clone)]
+pub(super) struct CommandLine(Bytes);
+
+impl CommandLine {
+    /// Validate a request frame as a command line
     ///
-    /// This function validates the received message by checking its size
-    /// and ensuring it contains valid UTF-8 text. It returns the command
-    /// string or an appropriate error message.
+    /// This function checks the size of the frame and ensures it contains
+    /// valid UTF-8 text, without copying it.
     ///
     /// # Arguments
-    /// * `cmdline` - The ZeroMQ message to extract from
+    /// * `frame` - The frame holding the command line
     ///
     /// # Returns
-    /// * `Result<String, String>` - The extracted command string or error message
-    fn extract_command(&self, cmdline: &ZmqMessage) -> Result<String, String> {
-        let frame = cmdline.get(0).ok_or_else(|| {
-            warn!("Received empty message");
-            "Received empty message".to_string()
-        })?;
-
+    /// * `Result<CommandLine, String>` - The command line or error message
+    pub(super) fn decode(frame: &Bytes) -> Result<Self, String> {
         if frame.len() > MAX_MESSAGE_SIZE {
             warn!("Message too large: {} bytes", frame.len());
             return Err(format!(
@@ -209,10 +648,10 @@ impl DaemonServer {
             ));
         }
 
-        match String::from_utf8(frame.to_vec()) {
+        match std::str::from_utf8(frame) {
             Ok(s) => {
                 debug!("Successfully extracted command string: '{}'", s);
-                Ok(s)
+                Ok(CommandLine(frame.clone()))
             }
             Err(e) => {
                 warn!("Invalid UTF-8 message: {}", e);
@@ -221,72 +660,72 @@ impl DaemonServer {
         }
     }
 
-    /// Format a command result into a string response
-    ///
-    /// This function takes the result of command execution and formats it
-    /// into a string response that can be sent back to the client.
-    /// It handles both success and error cases appropriately.
-    ///
-    /// # Arguments
-    /// * `result` - The command result to format
-    ///
-    /// # Returns
-    /// * `String` - The formatted response string
-    fn format_response(&self, result: Result<String, CommandError>) -> String {
-        match result {
-            Ok(msg) => {
-                debug!("Command executed successfully: '{}'", msg);
-                msg
-            }
-            Err(CommandError::ExecutionError(err)) => {
-                error!("Command execution error: {}", err);
-                format!("Error: {}", err)
-            }
-            Err(err) => {
-                warn!("Command error: {}", err);
-                format!("Error: {}", err)
-            }
-        }
+    /// Returns the command line text
+    pub(super) fn as_str(&self) -> &str {
+        // SAFETY: the frame was validated as UTF-8 by `decode` and `Bytes` is immutable
+        unsafe { std::str::from_utf8_unchecked(&self.0) }
     }
+}
 
-    /// Send a reply to the client with retry logic
-    ///
-    /// This function attempts to send a reply to the client, with retry logic
-    /// in case of temporary failures. It waits between attempts with an
-    /// exponentially increasing delay to avoid overwhelming the system.
-    ///
-    /// # Arguments
-    /// * `reply` - The reply string to send
-    ///
-    /// # Returns
-    /// * `Result<(), Box<dyn std::error::Error>>` - Ok if send succeeds, or an error
-    async fn send_reply(&mut self, reply: String) -> Result<(), Box<dyn std::error::Error>> {
-        debug!("Attempting to send reply: '{}'", reply);
-
-        for attempt in 0..MAX_SEND_RETRIES {
-            match self.socket.send(ZmqMessage::from(reply.clone())).await {
-                Ok(_) => {
-                    if attempt > 0 {
-                        info!("Reply sent successfully on attempt {}", attempt + 1);
-                    } else {
-                        debug!("Reply sent successfully on first attempt");
-                    }
-                    return Ok(());
-                }
-                Err(e) if attempt < MAX_SEND_RETRIES - 1 => {
-                    warn!("Failed to send reply (attempt {}): {:?}", attempt + 1, e);
-                    // Wait with exponential backoff (100ms, 200ms, 300ms, etc.)
-                    async_std::task::sleep(Duration::from_millis(100 * (attempt as u64 + 1))).await;
-                }
-                Err(e) => {
-                    error!(
-                        "Failed to send reply after {} attempts: {:?}",
-                        MAX_SEND_RETRIES, e
-                    );
-                    return Err(Box::new(e));
+impl AsRef<str> for CommandLine {
+    fn as_ref(&self) -> &str {
+        self.as_str()
+    }
+}
+
+impl fmt::Display for CommandLine {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.write_str(self.as_str())
+    }
+}
+
+impl fmt::Debug for CommandLine {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        fmt::Debug::fmt(self.as_str(), f)
+    }
+}
+
+/// Send a message with retry logic
+///
+/// Retries resend a clone of the message, which shares its frame buffers.
+///
+/// This function attempts to send a message to the client, with retry logic
+/// in case of temporary failures. It waits between attempts with an
+/// exponentially increasing delay to avoid overwhelming the system.
+///
+/// # Arguments
+/// * `socket` - The socket to send on
+/// * `message` - The message to send
+///
+/// # Returns
+/// * `Result<(), Box<dyn std::error::Error>>` - Ok if send succeeds, or an error
+async fn send_with_retry<S: SocketSend>(
+    socket: &mut S,
+    message: ZmqMessage,
+) -> Result<(), Box<dyn std::error::Error>> {
+    for attempt in 0..MAX_SEND_RETRIES {
+        match socket.send(message.clone()).await {
+            Ok(_) => {
+                if attempt > 0 {
+                    info!("Reply sent successfully on attempt {}", attempt + 1);
+                } else {
+                    debug!("Reply sent successfully on first attempt");
                 }
+                return Ok(());
+            }
+            Err(e) if attempt < MAX_SEND_RETRIES - 1 => {
+                warn!("Failed to send reply (attempt {}): {:?}", attempt + 1, e);
+                // Wait with exponential backoff (100ms, 200ms, 300ms, etc.)
+                async_std::task::sleep(Duration::from_millis(100 * (attempt as u64 + 1))).await;
+            }
+            Err(e) => {
+                error!(
+                    "Failed to send reply after {} attempts: {:?}",
+                    MAX_SEND_RETRIES, e
+                );
+                return Err(Box::new(e));
             }
         }
-        unreachable!()
     }
+    unreachable!()
 }
@@ -0,0 +1,280 @@
+// Benchmarks for the daemon hot paths
+// These run as ignored tests against an in-memory backend, so they need no display
+// hardware. Run them with an optimized build and keep the output between releases:
+//
+//     cargo test --release -- --ignored --nocapture --test-threads=1 bench_
+//
+// Every benchmark prints the mean, p50 and p99 latency of one operation.
+
+use crate::screen;
+use crate::screen::backend::{
+    DisplayBackend, DisplayMode, DisplayOutput, MeteredBackend, ModeParams, RotationParams,
+};
+use crate::screen::cache::OutputCache;
+use crate::screen::mode_index::ModeIndex;
+use crate::screen::screenshot::Frame;
+use crate::server::commands;
+use crate::server::server::{DaemonServer, ServerMode};
+use crate::utils::error::{RegmsgError, Result};
+use std::hint::black_box;
+use std::sync::{Arc, OnceLock};
+use std::time::{Duration, Instant};
+
+/// Modes offered by the benchmark output, about what a 4K TV reports
+const OUTPUT_MODES: usize = 512;
+
+/// In-memory backend with a single connected output
+struct BenchBackend {
+    output: DisplayOutput,
+}
+
+/// Generates `count` distinct modes, from 640x480 upwards
+fn bench_modes(count: usize) -> Vec<DisplayMode> {
+    const REFRESH_RATES: [u32; 6] = [50, 59, 60, 75, 120, 144];
+    (0..count)
+        .map(|i| {
+            let width = 640 + (i % 100) as u32 * 32;
+            let height = 480 + (i / 100) as u32 * 18;
+            DisplayMode::new(width, height, REFRESH_RATES[i % REFRESH_RATES.len()] * 1000)
+        })
+        .collect()
+}
+
+impl BenchBackend {
+    fn new() -> Self {
+        let modes = bench_modes(OUTPUT_MODES);
+        Self {
+            output: DisplayOutput {
+                name: "HDMI-A-1".into(),
+                current_mode: modes.last().copied(),
+                modes,
+                is_connected: true,
+                rotation: 0,
+                position: None,
+            },
+        }
+    }
+
+    fn mode(&self) -> Result<DisplayMode> {
+        self.output
+            .current_mode
+            .ok_or_else(|| RegmsgError::NotFound("Current mode".to_string()))
+    }
+}
+
+impl DisplayBackend for BenchBackend {
+    fn list_outputs(&self) -> Result<Vec<DisplayOutput>> {
+        Ok(vec![self.output.clone()])
+    }
+
+    fn list_modes(&self, _screen: Option<&str>) -> Result<Vec<DisplayMode>> {
+        Ok(self.output.modes.clone())
+    }
+
+    fn current_mode(&self, _screen: Option<&str>) -> Result<DisplayMode> {
+        self.mode()
+    }
+
+    fn current_resolution(&self, _screen: Option<&str>) -> Result<(u32, u32)> {
+        self.mode().map(|mode| (mode.width, mode.height))
+    }
+
+    fn current_refresh_rate(&self, _screen: Option<&str>) -> Result<u32> {
+        self.mode().map(|mode| mode.refresh_rate())
+    }
+
+    fn current_rotation(&self, _screen: Option<&str>) -> Result<u32> {
+        Ok(self.output.rotation)
+    }
+
+    fn set_mode(&self, _screen: Option<&str>, _mode: &ModeParams) -> Result<()> {
+        Ok(())
+    }
+
+    fn set_rotation(&self, _screen: Option<&str>, _rotation: &RotationParams) -> Result<()> {
+        Ok(())
+    }
+
+    fn min_to_max_resolution(
+        &self,
+        _screen: Option<&str>,
+        _max_resolution: Option<&str>,
+    ) -> Result<()> {
+        Ok(())
+    }
+
+    fn capture_frame(&self) -> Result<Frame> {
+        Ok(Frame {
+            width: 1,
+            height: 1,
+            pixels: vec![0, 0, 0],
+        })
+    }
+
+    fn map_touchscreen(&self) -> Result<()> {
+        Ok(())
+    }
+
+    fn backend_name(&self) -> &'static str {
+        "Bench"
+    }
+
+    fn watch_changes(&self, cache: Arc<OutputCache>) -> Result<()> {
+        // Like the real backends with a working notification source
+        cache.set_live(true);
+        Ok(())
+    }
+}
+
+/// Routes the screen functions to the benchmark backend
+fn install_backend() {
+    static BACKEND: OnceLock<MeteredBackend<BenchBackend>> = OnceLock::new();
+    let backend = BACKEND.get_or_init(|| MeteredBackend(BenchBackend::new()));
+    screen::use_backend(backend);
+}
+
+/// Prints the latency distribution of a benchmark
+fn report(name: &str, mut samples: Vec<Duration>) {
+    samples.sort_unstable();
+    let percentile = |q: f64| samples[((samples.len() - 1) as f64 * q).round() as usize];
+    let mean = samples.iter().sum::<Duration>() / samples.len() as u32;
+    println!(
+        "bench {:<28} n={:<7} mean={:>10.2?} p50={:>10.2?} p99={:>10.2?}",
+        name,
+        samples.len(),
+        mean,
+        percentile(0.50),
+        percentile(0.99)
+    );
+}
+
+/// Times `samples` runs of `batch` calls each, after a short warm-up
+///
+/// Fast operations use a larger batch so the clock reads do not dominate; each sample
+/// is the mean latency of one call within its batch.
+fn bench<T>(name: &str, samples: usize, batch: u32, mut call: impl FnMut() -> T) {
+    for _ in 0..samples / 10 {
+        black_box(call());
+    }
+
+    let timings = (0..samples)
+        .map(|_| {
+            let start = Instant::now();
+            for _ in 0..batch {
+                black_box(call());
+            }
+            start.elapsed() / batch
+        })
+        .collect();
+    report(name, timings);
+}
+
+#[test]
+#[ignore = "benchmark"]
+fn bench_parse_mode() {
+    bench("parse_mode WxH@R", 10_000, 100, || {
+        screen::parse_mode(black_box("1920x1080@60"))
+    });
+    bench("parse_mode WxH", 10_000, 100, || {
+        screen::parse_mode(black_box("3840x2160"))
+    });
+}
+
+#[test]
+#[ignore = "benchmark"]
+fn bench_registry_dispatch() {
+    install_backend();
+    let registry = commands::init_commands();
+
+    bench("registry currentBackend", 10_000, 10, || {
+        registry.handle(black_box("currentBackend"))
+    });
+    bench("registry currentMode", 10_000, 10, || {
+        registry.handle(black_box("currentMode HDMI-A-1"))
+    });
+    bench("registry currentMode json", 10_000, 10, || {
+        registry.handle(black_box("--format json currentMode HDMI-A-1"))
+    });
+    bench("registry unknown command", 10_000, 10, || {
+        registry.handle(black_box("noSuchCommand"))
+    });
+}
+
+#[test]
+#[ignore = "benchmark"]
+fn bench_list_modes_formatting() {
+    install_backend();
+    let registry = commands::init_commands();
+
+    bench("list_modes text", 2_000, 1, || screen::list_modes(None));
+    bench("listModes json", 2_000, 1, || {
+        registry.handle(black_box("--format json listModes"))
+    });
+}
+
+#[test]
+#[ignore = "benchmark"]
+fn bench_best_mode_selection() {
+    let modes = bench_modes(OUTPUT_MODES);
+    let index = || {
+        ModeIndex::new(
+            modes
+                .iter()
+                .map(|mode| (mode.width, mode.height, mode.refresh_mhz)),
+        )
+    };
+
+    bench("mode index build", 2_000, 1, index);
+    let index = index();
+    bench("mode index best_within", 10_000, 100, || {
+        index.best_within(black_box(1920), black_box(1080))
+    });
+    bench("mode index nearest", 10_000, 100, || {
+        index.nearest(black_box(1920), black_box(552), black_box(59))
+    });
+}
+
+#[test]
+#[ignore = "benchmark"]
+fn bench_ipc_round_trip() {
+    use async_std::channel;
+    use zeromq::ReqSocket;
+    use zeromq::prelude::*;
+
+    const WARMUP: usize = 100;
+    const ROUND_TRIPS: usize = 5_000;
+
+    install_backend();
+    let path = std::env::temp_dir().join(format!("regmsgd-bench-{}.sock", std::process::id()));
+    let endpoint = format!("ipc://{}", path.display());
+
+    async_std::task::block_on(async {
+        let mut server =
+            DaemonServer::bind(ServerMode::Router, &endpoint, commands::init_commands())
+                .await
+                .expect("bind benchmark server");
+        let (shutdown_tx, shutdown_rx) = channel::bounded(1);
+        let server_task = async_std::task::spawn(async move {
+            server.run(shutdown_rx).await.map_err(|e| e.to_string())
+        });
+
+        let mut client = ReqSocket::new();
+        client.connect(&endpoint).await.expect("connect");
+
+        let mut samples = Vec::with_capacity(ROUND_TRIPS);
+        for round in 0..WARMUP + ROUND_TRIPS {
+            let start = Instant::now();
+            client.send("currentMode".into()).await.expect("send");
+            let reply = client.recv().await.expect("recv");
+            if round >= WARMUP {
+                samples.push(start.elapsed());
+            }
+            black_box(reply);
+        }
+        report("ipc round trip currentMode", samples);
+
+        shutdown_tx.send(()).await.expect("shutdown");
+        server_task.await.expect("server loop");
+    });
+    let _ = std::fs::remove_file(path);
+}
@@ -3,8 +3,8 @@
 // command registry, commands, and server components.
 
 use crate::server::command_registry::{
-    CommandRegistry, CommandHandler, CommandError, 
-    screen_command, screen_setter_command, SimpleCommand, ArgCommand
+    CommandRegistry, CommandHandler, CommandError, OutputFormat,
+    screen_command, screen_setter_command, structured_screen_command, SimpleCommand, ArgCommand
 };
 
 // Test for commands module functionality
@@ -18,7 +18,8 @@ mod commands_tests {
         let registry = crate::server::commands::init_commands();
 
         // Test that key commands are registered
-        let commands = registry.list_commands();
+        let catalogue = registry.catalogue();
+        let commands = catalogue.text();
         assert!(commands.contains("listModes"));
         assert!(commands.contains("currentMode"));
         assert!(commands.contains("setMode"));
@@ -47,6 +48,23 @@ mod commands_tests {
         assert!(output.contains("listModes") || output.contains("currentMode") || output.contains("setMode"));
     }
 
+    /// Test that listCommands serves the catalogue, including itself, in both formats
+    #[test]
+    fn test_list_commands_catalogue() {
+        let registry = crate::server::commands::init_commands();
+        let catalogue = registry.catalogue();
+
+        assert_eq!(registry.handle("listCommands").unwrap(), catalogue.text());
+        assert!(catalogue.text().contains("listCommands: List all available commands"));
+
+        let json = registry.handle("--format json listCommands").unwrap();
+        assert_eq!(json, catalogue.json());
+        let infos: Vec<serde_json::Value> = serde_json::from_str(&json).unwrap();
+        assert_eq!(infos.len(), registry.len());
+        let set_output = infos.iter().find(|info| info["name"] == "setOutput").unwrap();
+        assert_eq!(set_output["args"], 1);
+    }
+
     /// Test that invalid rotation values are properly rejected
     #[test]
     fn test_invalid_rotation() {
@@ -99,7 +117,8 @@ mod registry_tests {
     #[test]
     fn test_registry_creation() {
         let registry = CommandRegistry::new();
-        assert_eq!(registry.list_commands(), "");
+        assert_eq!(registry.len(), 0);
+        assert_eq!(registry.catalogue().text(), "");
     }
 
     #[test]
@@ -230,6 +249,76 @@ mod registry_tests {
         assert_eq!(result.unwrap(), "echo: HDMI1");
     }
     
+    #[test]
+    fn test_registry_handle_batch() {
+        let mut registry = CommandRegistry::new();
+        registry.register(
+            "set",
+            Box::new(ArgCommand {
+                name: "set".to_string(),
+                description: "Takes one argument".to_string(),
+                expected_args: 1,
+                executor: Box::new(|_args| Ok(())),
+            }),
+        );
+
+        let results: Vec<_> = registry
+            .handle_batch(&["set a", "unknown", "set", "set b"])
+            .collect();
+        assert_eq!(results.len(), 4);
+        assert_eq!(results[0].as_ref().unwrap(), "set executed successfully");
+        assert!(matches!(results[1], Err(CommandError::UnknownCommand(_))));
+        assert!(matches!(results[2], Err(CommandError::InvalidArguments(_))));
+        assert_eq!(results[3].as_ref().unwrap(), "set executed successfully");
+    }
+
+    #[test]
+    fn test_registry_json_format() {
+        let mut registry = CommandRegistry::new();
+        registry.register(
+            "mode",
+            structured_screen_command(
+                "Structured mode",
+                |screen| Ok(format!("1920x1080@60 on {}", screen.unwrap_or("all"))),
+                |screen| Ok(serde_json::json!({ "width": 1920, "screen": screen })),
+            ),
+        );
+        registry.register(
+            "backend",
+            crate::simple_command!("backend", "Text only", || Ok("Wayland".to_string())),
+        );
+
+        assert_eq!(registry.handle("mode HDMI-1").unwrap(), "1920x1080@60 on HDMI-1");
+        assert_eq!(
+            registry.handle("--format json mode HDMI-1").unwrap(),
+            r#"{"screen":"HDMI-1","width":1920}"#
+        );
+        assert_eq!(registry.handle("--format text mode").unwrap(), "1920x1080@60 on all");
+        // Text-only commands reply with a JSON string
+        assert_eq!(registry.handle("--format json backend").unwrap(), r#""Wayland""#);
+
+        assert!(matches!(
+            registry.handle("--format yaml mode"),
+            Err(CommandError::InvalidArguments(_))
+        ));
+        assert!(matches!(registry.handle("--format json"), Err(CommandError::EmptyCommand)));
+    }
+
+    #[test]
+    fn test_output_format_split_option() {
+        let parts = ["--format", "json", "listModes"];
+        let (format, rest) = OutputFormat::split_option(&parts).unwrap();
+        assert_eq!(format, OutputFormat::Json);
+        assert_eq!(rest, &["listModes"]);
+
+        let parts = ["listModes", "HDMI-1"];
+        let (format, rest) = OutputFormat::split_option(&parts).unwrap();
+        assert_eq!(format, OutputFormat::Text);
+        assert_eq!(rest, &parts);
+
+        assert!(OutputFormat::split_option(&["--format"]).is_err());
+    }
+
     #[test]
     fn test_list_commands() {
         let mut registry = CommandRegistry::new();
@@ -250,7 +339,8 @@ mod registry_tests {
             }),
         );
 
-        let commands_list = registry.list_commands();
+        let catalogue = registry.catalogue();
+        let commands_list = catalogue.text();
         assert!(commands_list.contains("test1: First test command"));
         assert!(commands_list.contains("test2: Second test command"));
     }
@@ -384,4 +474,141 @@ mod macro_tests {
         // ScreenSetterCommand's expected_args returns None (variable args)
         assert_eq!(setter_cmd.expected_args(), None);
     }
-}
\ No newline at end of file
+}
+// Tests for the ZeroMQ message framing
+#[cfg(test)]
+mod framing_tests {
+    use crate::server::server::{CommandLine, envelope_len};
+    use bytes::Bytes;
+
+    fn frames(parts: &[&'static str]) -> Vec<Bytes> {
+        parts.iter().map(|part| Bytes::from_static(part.as_bytes())).collect()
+    }
+
+    #[test]
+    fn test_envelope_req_client() {
+        // ROUTER prepends the identity, REQ adds the empty delimiter
+        assert_eq!(envelope_len(&frames(&["peer", "", "listModes"])), 2);
+    }
+
+    #[test]
+    fn test_envelope_dealer_with_request_id() {
+        assert_eq!(envelope_len(&frames(&["peer", "id:7", "listModes"])), 2);
+        assert_eq!(envelope_len(&frames(&["peer", "", "id:7", "listModes"])), 3);
+    }
+
+    #[test]
+    fn test_envelope_without_command() {
+        // The command frame is missing, the envelope never runs past the message
+        assert_eq!(envelope_len(&frames(&["peer", ""])), 2);
+        assert_eq!(envelope_len(&frames(&["peer"])), 1);
+    }
+
+    #[test]
+    fn test_decode_command() {
+        let frame = Bytes::from_static(b"setMode 1920x1080@60");
+        let cmdline = CommandLine::decode(&frame).unwrap();
+        assert_eq!(cmdline.as_str(), "setMode 1920x1080@60");
+        // The command line shares the frame buffer
+        assert_eq!(cmdline.as_str().as_ptr(), frame.as_ptr());
+
+        assert!(CommandLine::decode(&Bytes::from_static(&[0xff, 0xfe])).is_err());
+        assert!(CommandLine::decode(&Bytes::from(vec![b'a'; 1024 * 1024 + 1])).is_err());
+    }
+}
+
+// Tests for readiness notification
+#[cfg(test)]
+mod readiness_tests {
+    use crate::server::readiness::write_ready_file;
+
+    #[test]
+    fn test_write_ready_file() {
+        let path =
+            std::env::temp_dir().join(format!("regmsgd-ready-test-{}", std::process::id()));
+        write_ready_file(&path).unwrap();
+
+        let contents = std::fs::read_to_string(&path).unwrap();
+        assert_eq!(contents.trim(), std::process::id().to_string());
+        // The temporary file was renamed into place
+        assert!(!path.with_extension("tmp").exists());
+        std::fs::remove_file(&path).unwrap();
+    }
+}
+
+// Tests for the coalescing of mode setters
+#[cfg(test)]
+mod coalesce_tests {
+    use crate::server::coalesce::Coalescer;
+    use futures::channel::oneshot;
+    use futures::executor::block_on;
+    use std::sync::Mutex;
+    use std::time::Duration;
+
+    #[test]
+    fn test_superseded_requests_share_the_last_result() {
+        let coalescer = Coalescer::new(Duration::ZERO);
+        let applied = Mutex::new(Vec::new());
+        let (release, released) = oneshot::channel::<()>();
+
+        let apply = |request: u32| {
+            let applied = &applied;
+            async move {
+                applied.lock().unwrap().push(request);
+                request
+            }
+        };
+        // The first request is applying while the others wait for their turn
+        let first = coalescer.run("HDMI-A-1", async {
+            let _ = released.await;
+            apply(0).await
+        });
+        let results = block_on(async {
+            futures::join!(
+                first,
+                coalescer.run("HDMI-A-1", apply(1)),
+                coalescer.run("HDMI-A-1", apply(2)),
+                async { release.send(()).unwrap() },
+            )
+        });
+
+        assert_eq!((results.0, results.1, results.2), (Some(0), Some(2), Some(2)));
+        assert_eq!(*applied.lock().unwrap(), vec![0, 2]);
+    }
+
+    #[test]
+    fn test_keys_do_not_supersede_each_other() {
+        let coalescer = Coalescer::new(Duration::ZERO);
+        let results = block_on(async {
+            futures::join!(
+                coalescer.run("HDMI-A-1", async { 1 }),
+                coalescer.run("DSI-1", async { 2 }),
+            )
+        });
+        assert_eq!(results, (Some(1), Some(2)));
+        assert_eq!(block_on(coalescer.run("HDMI-A-1", async { 3 })), Some(3));
+    }
+
+    #[test]
+    fn test_mode_setters_are_coalesced_by_screen() {
+        let registry = crate::server::commands::init_commands();
+        assert_eq!(
+            registry.coalesce_key("setMode 1920x1080 HDMI-A-1"),
+            registry.coalesce_key("minToMaxResolution HDMI-A-1")
+        );
+        assert_eq!(
+            registry.coalesce_key("setMode 1920x1080"),
+            registry.coalesce_key("setOutput 1280x720")
+        );
+        assert_ne!(
+            registry.coalesce_key("setMode 1920x1080"),
+            registry.coalesce_key("setMode 1920x1080 HDMI-A-1")
+        );
+        assert_ne!(
+            registry.coalesce_key("setMode 1920x1080"),
+            registry.coalesce_key("--format json setMode 1920x1080")
+        );
+        assert_eq!(registry.coalesce_key("setRotation 90"), None);
+        assert_eq!(registry.coalesce_key("unknownCommand"), None);
+    }
+}
@@ -3,6 +3,7 @@
 //! This module contains shared utility functionality for the regmsg daemon.
 
 pub mod error;
+pub mod stats;
 pub mod tracing;
 
 /// Tests module for utils components
@@ -0,0 +1,306 @@
+//! Runtime Statistics
+//!
+//! This module keeps in-memory counters and latency histograms for the hot paths of the
+//! daemon, so regressions can be spotted in production through the `stats` command
+//! without attaching a profiler. Recording is lock-free once a metric exists: every
+//! histogram is a fixed set of atomic power-of-two buckets.
+//!
+//! Metrics are grouped by layer:
+//! - `COMMANDS`: every registry command, keyed by command name
+//! - `BACKEND`: every `DisplayBackend` method, keyed by method name
+//! - `CALLS`: the system calls behind them (DRM ioctls, sway IPC, subprocesses)
+//! - caches: hit and miss counters of the display caches
+
+use serde::Serialize;
+use std::collections::{BTreeMap, HashMap};
+use std::fmt;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, LazyLock, RwLock};
+use std::time::{Duration, Instant};
+
+/// Number of latency buckets; bucket `i` counts latencies below `2^i` microseconds and
+/// the last one everything slower (above ~4 s)
+const BUCKETS: usize = 23;
+
+/// Latency histogram with power-of-two microsecond buckets
+pub struct Histogram {
+    count: AtomicU64,
+    errors: AtomicU64,
+    total_us: AtomicU64,
+    max_us: AtomicU64,
+    buckets: [AtomicU64; BUCKETS],
+}
+
+/// Summary of a histogram; percentiles are bucket upper bounds
+#[derive(Debug, Clone, PartialEq, Serialize)]
+pub struct LatencySummary {
+    pub count: u64,
+    pub errors: u64,
+    pub mean_us: u64,
+    pub p50_us: u64,
+    pub p99_us: u64,
+    pub max_us: u64,
+}
+
+impl Histogram {
+    fn new() -> Self {
+        Self {
+            count: AtomicU64::new(0),
+            errors: AtomicU64::new(0),
+            total_us: AtomicU64::new(0),
+            max_us: AtomicU64::new(0),
+            buckets: std::array::from_fn(|_| AtomicU64::new(0)),
+        }
+    }
+
+    /// Records one call
+    ///
+    /// # Arguments
+    /// * `elapsed` - The duration of the call
+    /// * `ok` - Whether the call succeeded
+    pub fn record(&self, elapsed: Duration, ok: bool) {
+        let us = u64::try_from(elapsed.as_micros()).unwrap_or(u64::MAX);
+        let bucket = ((u64::BITS - us.leading_zeros()) as usize).min(BUCKETS - 1);
+
+        self.count.fetch_add(1, Ordering::Relaxed);
+        if !ok {
+            self.errors.fetch_add(1, Ordering::Relaxed);
+        }
+        self.total_us.fetch_add(us, Ordering::Relaxed);
+        self.max_us.fetch_max(us, Ordering::Relaxed);
+        self.buckets[bucket].fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Returns the upper bound of the bucket holding the `quantile` of all calls
+    fn percentile(&self, buckets: &[u64; BUCKETS], count: u64, quantile: f64) -> u64 {
+        let rank = ((count as f64 * quantile).ceil() as u64).max(1);
+        let mut seen = 0;
+        for (index, &calls) in buckets.iter().enumerate() {
+            seen += calls;
+            if seen >= rank {
+                return (1u64 << index).min(self.max_us.load(Ordering::Relaxed));
+            }
+        }
+        self.max_us.load(Ordering::Relaxed)
+    }
+
+    /// Takes a summary of the calls recorded so far
+    pub fn summary(&self) -> LatencySummary {
+        let buckets: [u64; BUCKETS] =
+            std::array::from_fn(|index| self.buckets[index].load(Ordering::Relaxed));
+        let count = buckets.iter().sum();
+        let total_us = self.total_us.load(Ordering::Relaxed);
+
+        LatencySummary {
+            count,
+            errors: self.errors.load(Ordering::Relaxed),
+            mean_us: if count == 0 { 0 } else { total_us / count },
+            p50_us: self.percentile(&buckets, count, 0.50),
+            p99_us: self.percentile(&buckets, count, 0.99),
+            max_us: self.max_us.load(Ordering::Relaxed),
+        }
+    }
+}
+
+/// A group of latency histograms keyed by name
+pub struct Metrics {
+    histograms: RwLock<HashMap<String, Arc<Histogram>>>,
+}
+
+impl Metrics {
+    fn new() -> Self {
+        Self {
+            histograms: RwLock::new(HashMap::new()),
+        }
+    }
+
+    /// Returns the histogram for `name`, creating it on first use
+    pub fn histogram(&self, name: &str) -> Arc<Histogram> {
+        if let Some(histogram) = self
+            .histograms
+            .read()
+            .unwrap_or_else(|e| e.into_inner())
+            .get(name)
+        {
+            return Arc::clone(histogram);
+        }
+
+        let mut histograms = self.histograms.write().unwrap_or_else(|e| e.into_inner());
+        Arc::clone(
+            histograms
+                .entry(name.to_string())
+                .or_insert_with(|| Arc::new(Histogram::new())),
+        )
+    }
+
+    /// Runs `call` and records its latency and outcome under `name`
+    ///
+    /// # Arguments
+    /// * `name` - The metric name
+    /// * `call` - The call to measure
+    ///
+    /// # Returns
+    /// The result of `call`
+    pub fn time<T, E, F>(&self, name: &str, call: F) -> std::result::Result<T, E>
+    where
+        F: FnOnce() -> std::result::Result<T, E>,
+    {
+        let start = Instant::now();
+        let result = call();
+        self.histogram(name).record(start.elapsed(), result.is_ok());
+        result
+    }
+
+    /// Takes a summary of every histogram, sorted by name
+    pub fn summaries(&self) -> BTreeMap<String, LatencySummary> {
+        self.histograms
+            .read()
+            .unwrap_or_else(|e| e.into_inner())
+            .iter()
+            .map(|(name, histogram)| (name.clone(), histogram.summary()))
+            .collect()
+    }
+}
+
+/// Hit and miss counters of a cache
+#[derive(Default)]
+pub struct CacheCounter {
+    hits: AtomicU64,
+    misses: AtomicU64,
+}
+
+/// Summary of a cache counter
+#[derive(Debug, Clone, PartialEq, Serialize)]
+pub struct CacheSummary {
+    pub hits: u64,
+    pub misses: u64,
+    /// Fraction of reads served from memory, from 0 to 1
+    pub hit_rate: f64,
+}
+
+impl CacheCounter {
+    /// Counts a read served from memory
+    pub fn hit(&self) {
+        self.hits.fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Counts a read that went to the backend
+    pub fn miss(&self) {
+        self.misses.fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Takes a summary of the reads counted so far
+    pub fn summary(&self) -> CacheSummary {
+        let hits = self.hits.load(Ordering::Relaxed);
+        let misses = self.misses.load(Ordering::Relaxed);
+        let reads = hits + misses;
+        CacheSummary {
+            hits,
+            misses,
+            hit_rate: if reads == 0 {
+                0.0
+            } else {
+                hits as f64 / reads as f64
+            },
+        }
+    }
+}
+
+/// Latency of every registry command
+pub static COMMANDS: LazyLock<Metrics> = LazyLock::new(Metrics::new);
+
+/// Latency of every `DisplayBackend` method
+pub static BACKEND: LazyLock<Metrics> = LazyLock::new(Metrics::new);
+
+/// Latency of DRM ioctls, sway IPC round-trips and subprocess spawns
+pub static CALLS: LazyLock<Metrics> = LazyLock::new(Metrics::new);
+
+/// Counters of the display caches, keyed by cache name
+static CACHES: LazyLock<RwLock<HashMap<String, Arc<CacheCounter>>>> =
+    LazyLock::new(|| RwLock::new(HashMap::new()));
+
+/// Time the daemon started recording statistics
+static STARTED: LazyLock<Instant> = LazyLock::new(Instant::now);
+
+/// Starts the uptime clock reported by `stats`
+pub fn start() {
+    LazyLock::force(&STARTED);
+}
+
+/// Returns the counter of the cache `name`, creating it on first use
+pub fn cache(name: &str) -> Arc<CacheCounter> {
+    let mut caches = CACHES.write().unwrap_or_else(|e| e.into_inner());
+    Arc::clone(caches.entry(name.to_string()).or_default())
+}
+
+/// Snapshot of all statistics, as returned by the `stats` command
+#[derive(Debug, Clone, Serialize)]
+pub struct StatsReport {
+    pub uptime_secs: u64,
+    pub commands: BTreeMap<String, LatencySummary>,
+    pub backend: BTreeMap<String, LatencySummary>,
+    pub calls: BTreeMap<String, LatencySummary>,
+    pub caches: BTreeMap<String, CacheSummary>,
+}
+
+/// Takes a snapshot of all statistics
+pub fn report() -> StatsReport {
+    StatsReport {
+        uptime_secs: STARTED.elapsed().as_secs(),
+        commands: COMMANDS.summaries(),
+        backend: BACKEND.summaries(),
+        calls: CALLS.summaries(),
+        caches: CACHES
+            .read()
+            .unwrap_or_else(|e| e.into_inner())
+            .iter()
+            .map(|(name, counter)| (name.clone(), counter.summary()))
+            .collect(),
+    }
+}
+
+impl fmt::Display for StatsReport {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        write!(f, "uptime: {}s", self.uptime_secs)?;
+
+        let sections = [
+            ("commands", &self.commands),
+            ("backend", &self.backend),
+            ("calls", &self.calls),
+        ];
+        for (title, metrics) in sections {
+            if metrics.is_empty() {
+                continue;
+            }
+            write!(f, "\n{}:", title)?;
+            for (name, summary) in metrics {
+                write!(
+                    f,
+                    "\n  {} count={} errors={} mean={}us p50<={}us p99<={}us max={}us",
+                    name,
+                    summary.count,
+                    summary.errors,
+                    summary.mean_us,
+                    summary.p50_us,
+                    summary.p99_us,
+                    summary.max_us
+                )?;
+            }
+        }
+
+        if !self.caches.is_empty() {
+            write!(f, "\ncaches:")?;
+            for (name, summary) in &self.caches {
+                write!(
+                    f,
+                    "\n  {} hits={} misses={} hit_rate={:.1}%",
+                    name,
+                    summary.hits,
+                    summary.misses,
+                    summary.hit_rate * 100.0
+                )?;
+            }
+        }
+        Ok(())
+    }
+}
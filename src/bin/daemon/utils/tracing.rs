@@ -2,56 +2,317 @@
 //!
 //! This module contains tracing functionality for the regmsg daemon,
 //! including logging configuration with file output.
+//!
+//! The sink is selected with `REGMSGD_LOG`:
+//! - `file`: the log file only (the default when stdout is not a terminal)
+//! - `console`: stdout only
+//! - `both`: the log file and stdout (the default on a terminal)
+//! - `journald`: the systemd journal, through its native socket
+//!
+//! Events are filtered once for all sinks, by `RUST_LOG` at startup and by the
+//! `logLevel` command at runtime.
 
-use crate::config::DEFAULT_LOG_PATH;
+use crate::config::{DEFAULT_LOG_PATH, JOURNALD_SOCKET_PATH, LOG_SINK_ENV};
+use crate::utils::error::{RegmsgError, Result};
 use std::fs::OpenOptions;
-use std::sync::Once;
+use std::io::{self, IsTerminal, Write};
+use std::os::unix::net::UnixDatagram;
+use std::sync::{Mutex, Once, OnceLock};
+use std::time::{Duration, Instant};
+use tracing::{Level, Metadata};
 use tracing_appender::non_blocking::WorkerGuard;
-use tracing_subscriber::{EnvFilter, fmt, layer::SubscriberExt, util::SubscriberInitExt, Layer};
+use tracing_subscriber::fmt::MakeWriter;
+use tracing_subscriber::{
+    EnvFilter, Registry, fmt, layer::SubscriberExt, reload, util::SubscriberInitExt,
+};
 
 static mut WORKER_GUARD: Option<WorkerGuard> = None;
 static INIT: Once = Once::new();
 
-/// Initializes the tracing subscriber with file and console output
+/// Handle replacing the event filter at runtime
+static FILTER: OnceLock<reload::Handle<EnvFilter, Registry>> = OnceLock::new();
+
+/// Where log events are written
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum LogSink {
+    File,
+    Console,
+    Both,
+    Journald,
+}
+
+impl LogSink {
+    /// Parses a sink name as accepted by `REGMSGD_LOG`
+    pub fn parse(name: &str) -> Option<Self> {
+        match name {
+            "file" => Some(LogSink::File),
+            "console" => Some(LogSink::Console),
+            "both" => Some(LogSink::Both),
+            "journald" => Some(LogSink::Journald),
+            _ => None,
+        }
+    }
+
+    /// Reads the sink from `REGMSGD_LOG`
+    ///
+    /// Without the variable, stdout is only written when it is a terminal, so a
+    /// backgrounded daemon formats every event once.
+    pub fn from_env() -> Self {
+        let default = if io::stdout().is_terminal() {
+            LogSink::Both
+        } else {
+            LogSink::File
+        };
+        match std::env::var(LOG_SINK_ENV) {
+            Ok(name) => Self::parse(&name).unwrap_or_else(|| {
+                eprintln!(
+                    "Unknown {} value '{}', using {:?}",
+                    LOG_SINK_ENV, name, default
+                );
+                default
+            }),
+            Err(_) => default,
+        }
+    }
+
+    fn file(self) -> bool {
+        matches!(self, LogSink::File | LogSink::Both)
+    }
+
+    fn console(self) -> bool {
+        matches!(self, LogSink::Console | LogSink::Both)
+    }
+}
+
+/// Initializes the tracing subscriber with the sink selected by `REGMSGD_LOG`
 /// Uses DEFAULT_LOG_PATH from config for the log file location
 pub fn setup_tracing() {
     INIT.call_once(|| {
-        // Open log file for appending
-        let file = OpenOptions::new()
-            .append(true)
-            .create(true)
-            .open(DEFAULT_LOG_PATH)
-            .expect("Failed to open log file");
-
-        // Create non-blocking writer for better performance
-        let (non_blocking, guard) = tracing_appender::non_blocking::NonBlocking::new(file);
-        
-        // Store the guard in a static variable to ensure it lives for the duration of the program
-        unsafe {
-            WORKER_GUARD = Some(guard);
-        }
+        let mut sink = LogSink::from_env();
 
-        let env_filter = EnvFilter::try_from_default_env()
-            .unwrap_or_else(|_| EnvFilter::new("info")); // Default to info level if not set
+        let journal_layer = if sink == LogSink::Journald {
+            match JournalWriter::connect() {
+                Ok(writer) => Some(
+                    fmt::layer()
+                        .with_writer(writer)
+                        .with_ansi(false)
+                        .without_time(),
+                ),
+                Err(e) => {
+                    eprintln!("Failed to connect to journald, logging to file: {}", e);
+                    sink = LogSink::File;
+                    None
+                }
+            }
+        } else {
+            None
+        };
 
-        // Configure file layer
-        let file_layer = fmt::layer()
-            .with_writer(non_blocking)
-            .with_ansi(false)
-            .with_filter(env_filter.clone());
+        let file_layer = sink.file().then(|| {
+            // Open log file for appending
+            let file = OpenOptions::new()
+                .append(true)
+                .create(true)
+                .open(DEFAULT_LOG_PATH)
+                .expect("Failed to open log file");
+
+            // Create non-blocking writer for better performance
+            let (non_blocking, guard) = tracing_appender::non_blocking::NonBlocking::new(file);
+
+            // Store the guard in a static variable to ensure it lives for the duration of the program
+            unsafe {
+                WORKER_GUARD = Some(guard);
+            }
+
+            fmt::layer().with_writer(non_blocking).with_ansi(false)
+        });
 
         // Configure stdout layer for console output
-        let stdout_layer = fmt::layer()
-            .with_writer(std::io::stdout)
-            .with_ansi(true)
-            .with_filter(env_filter);
+        let stdout_layer = sink
+            .console()
+            .then(|| fmt::layer().with_writer(io::stdout).with_ansi(true));
+
+        // Default to info level if not set
+        let env_filter =
+            EnvFilter::try_from_default_env().unwrap_or_else(|_| EnvFilter::new("info"));
+        let (filter, handle) = reload::Layer::new(env_filter);
+        let _ = FILTER.set(handle);
 
-        // Set up the subscriber with both file and console output
+        // Set up the subscriber, filtering each event once for every sink
         tracing_subscriber::registry()
+            .with(filter)
             .with(file_layer)
             .with(stdout_layer)
+            .with(journal_layer)
             .try_init()
             .expect("Failed to initialize tracing subscriber");
     });
 }
 
+/// Returns the active filter directives, e.g. `info` or `debug,regmsgd::server=trace`
+pub fn log_level() -> Result<String> {
+    let handle = FILTER
+        .get()
+        .ok_or_else(|| RegmsgError::SystemError("Tracing is not initialized".to_string()))?;
+    handle
+        .with_current(|filter| filter.to_string())
+        .map_err(|e| RegmsgError::SystemError(e.to_string()))
+}
+
+/// Replaces the filter directives of every sink at runtime
+///
+/// # Arguments
+/// * `directives` - Directives in `RUST_LOG` syntax, e.g. `debug` or `info,regmsgd::screen=trace`
+///
+/// # Returns
+/// A `Result` with an `InvalidArguments` error if the directives do not parse
+pub fn set_log_level(directives: &str) -> Result<()> {
+    let filter = EnvFilter::try_new(directives).map_err(|e| {
+        RegmsgError::InvalidArguments(format!("Invalid log level '{}': {}", directives, e))
+    })?;
+    let handle = FILTER
+        .get()
+        .ok_or_else(|| RegmsgError::SystemError("Tracing is not initialized".to_string()))?;
+    handle
+        .reload(filter)
+        .map_err(|e| RegmsgError::SystemError(e.to_string()))?;
+    tracing::info!("Log level set to '{}'", directives);
+    Ok(())
+}
+
+/// Limits how many events of one kind are logged per second
+///
+/// Used for per-request lines, so a busy client cannot flood the log; calls past the
+/// budget are counted and the next admitted event reports how many were skipped.
+pub struct RateLimit {
+    per_second: u32,
+    window: Mutex<Window>,
+}
+
+struct Window {
+    start: Option<Instant>,
+    admitted: u32,
+    suppressed: u32,
+}
+
+impl RateLimit {
+    /// Creates a limit admitting `per_second` events per second
+    pub const fn new(per_second: u32) -> Self {
+        Self {
+            per_second,
+            window: Mutex::new(Window {
+                start: None,
+                admitted: 0,
+                suppressed: 0,
+            }),
+        }
+    }
+
+    /// Admits an event if the budget of the current second allows it
+    ///
+    /// # Returns
+    /// The number of events suppressed since the last admitted one, or `None` if this
+    /// event should be suppressed
+    pub fn admit(&self) -> Option<u32> {
+        let now = Instant::now();
+        let mut window = self.window.lock().unwrap_or_else(|e| e.into_inner());
+        if window
+            .start
+            .is_none_or(|start| now.duration_since(start) >= Duration::from_secs(1))
+        {
+            window.start = Some(now);
+            window.admitted = 0;
+        }
+        if window.admitted >= self.per_second {
+            window.suppressed += 1;
+            return None;
+        }
+        window.admitted += 1;
+        Some(std::mem::take(&mut window.suppressed))
+    }
+}
+
+/// Writes events to the systemd journal through its native datagram protocol
+pub struct JournalWriter {
+    socket: UnixDatagram,
+}
+
+impl JournalWriter {
+    /// Connects to the journal socket
+    pub fn connect() -> io::Result<Self> {
+        let socket = UnixDatagram::unbound()?;
+        socket.connect(JOURNALD_SOCKET_PATH)?;
+        Ok(Self { socket })
+    }
+}
+
+/// Maps a tracing level to a syslog priority
+fn journal_priority(level: &Level) -> u8 {
+    match *level {
+        Level::ERROR => 3,
+        Level::WARN => 4,
+        Level::INFO => 6,
+        Level::DEBUG | Level::TRACE => 7,
+    }
+}
+
+/// One journal entry, sent as a single datagram when the event is formatted
+pub struct JournalEntry<'a> {
+    socket: &'a UnixDatagram,
+    priority: u8,
+    message: Vec<u8>,
+}
+
+impl Write for JournalEntry<'_> {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.message.extend_from_slice(buf);
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        Ok(())
+    }
+}
+
+impl Drop for JournalEntry<'_> {
+    fn drop(&mut self) {
+        let message = self.message.strip_suffix(b"\n").unwrap_or(&self.message);
+        let _ = self
+            .socket
+            .send(&encode_journal_entry(self.priority, message));
+    }
+}
+
+/// Encodes a journal entry; the message uses the length-prefixed field form so it may
+/// contain newlines
+pub fn encode_journal_entry(priority: u8, message: &[u8]) -> Vec<u8> {
+    let mut entry = Vec::with_capacity(message.len() + 64);
+    entry.extend_from_slice(
+        format!("PRIORITY={}\nSYSLOG_IDENTIFIER=regmsgd\n", priority).as_bytes(),
+    );
+    entry.extend_from_slice(b"MESSAGE\n");
+    entry.extend_from_slice(&(message.len() as u64).to_le_bytes());
+    entry.extend_from_slice(message);
+    entry.push(b'\n');
+    entry
+}
+
+impl<'a> MakeWriter<'a> for JournalWriter {
+    type Writer = JournalEntry<'a>;
+
+    fn make_writer(&'a self) -> Self::Writer {
+        JournalEntry {
+            socket: &self.socket,
+            priority: journal_priority(&Level::INFO),
+            message: Vec::new(),
+        }
+    }
+
+    fn make_writer_for(&'a self, meta: &Metadata<'_>) -> Self::Writer {
+        JournalEntry {
+            socket: &self.socket,
+            priority: journal_priority(meta.level()),
+            message: Vec::new(),
+        }
+    }
+}
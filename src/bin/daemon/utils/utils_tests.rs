@@ -411,6 +411,64 @@ mod integration_tests {
     }
 }
 
+// Tests for the runtime statistics
+#[cfg(test)]
+mod stats_tests {
+    use super::*;
+    use crate::utils::stats;
+    use std::time::Duration;
+
+    /// Test that percentiles report the upper bound of their bucket
+    #[test]
+    fn test_histogram_summary() {
+        let histogram = stats::CALLS.histogram("test.histogram");
+        for _ in 0..99 {
+            histogram.record(Duration::from_micros(1), true);
+        }
+        histogram.record(Duration::from_micros(1000), false);
+
+        let summary = histogram.summary();
+        assert_eq!(summary.count, 100);
+        assert_eq!(summary.errors, 1);
+        assert_eq!(summary.mean_us, (99 + 1000) / 100);
+        assert_eq!(summary.p50_us, 2);
+        assert_eq!(summary.p99_us, 2);
+        assert_eq!(summary.max_us, 1000);
+    }
+
+    /// Test that timed calls record their outcome and keep their result
+    #[test]
+    fn test_metrics_time() {
+        let ok: Result<u32> = stats::CALLS.time("test.time", || Ok(7));
+        assert_eq!(ok.unwrap(), 7);
+        let err: Result<u32> = stats::CALLS.time("test.time", || {
+            Err(RegmsgError::NotFound("missing".to_string()))
+        });
+        assert!(err.is_err());
+
+        let summary = &stats::CALLS.summaries()["test.time"];
+        assert_eq!((summary.count, summary.errors), (2, 1));
+    }
+
+    /// Test cache hit rates and their place in the report
+    #[test]
+    fn test_cache_counter_report() {
+        let counter = stats::cache("test.cache");
+        for _ in 0..3 {
+            counter.hit();
+        }
+        counter.miss();
+
+        let report = stats::report();
+        assert_eq!(report.caches["test.cache"].hit_rate, 0.75);
+        assert!(
+            report
+                .to_string()
+                .contains("test.cache hits=3 misses=1 hit_rate=75.0%")
+        );
+    }
+}
+
 // Tests for the tracing module functionality
 #[cfg(test)]
 mod tracing_tests {
@@ -460,4 +518,42 @@ mod tracing_tests {
         // This test will ensure tracing is set up without panicking
         tracing::info!("Test log message from tracing utils");
     }
-}
\ No newline at end of file
+}
+// Tests for the logging sinks and request log rate limit
+#[cfg(test)]
+mod logging_tests {
+    use crate::utils::tracing::{LogSink, RateLimit, encode_journal_entry};
+
+    #[test]
+    fn test_log_sink_parse() {
+        assert_eq!(LogSink::parse("file"), Some(LogSink::File));
+        assert_eq!(LogSink::parse("console"), Some(LogSink::Console));
+        assert_eq!(LogSink::parse("both"), Some(LogSink::Both));
+        assert_eq!(LogSink::parse("journald"), Some(LogSink::Journald));
+        assert_eq!(LogSink::parse("syslog"), None);
+    }
+
+    #[test]
+    fn test_rate_limit_counts_suppressed() {
+        let limit = RateLimit::new(2);
+        assert_eq!(limit.admit(), Some(0));
+        assert_eq!(limit.admit(), Some(0));
+        assert_eq!(limit.admit(), None);
+        assert_eq!(limit.admit(), None);
+
+        // The next second reports the events skipped in the previous one
+        std::thread::sleep(std::time::Duration::from_millis(1010));
+        assert_eq!(limit.admit(), Some(2));
+        assert_eq!(limit.admit(), Some(0));
+    }
+
+    #[test]
+    fn test_encode_journal_entry() {
+        let entry = encode_journal_entry(6, b"two\nlines");
+
+        let mut expected = b"PRIORITY=6\nSYSLOG_IDENTIFIER=regmsgd\nMESSAGE\n".to_vec();
+        expected.extend_from_slice(&9u64.to_le_bytes());
+        expected.extend_from_slice(b"two\nlines\n");
+        assert_eq!(entry, expected);
+    }
+}